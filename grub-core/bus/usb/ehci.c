@@ -1986,7 +1986,9 @@ static struct grub_usb_controller_dev usb_controller = {
   .portstatus = grub_ehci_portstatus,
   .detect_dev = grub_ehci_detect_dev,
   /* estimated max. count of TDs for one bulk transfer */
-  .max_bulk_tds = GRUB_EHCI_N_TD * 3 / 4 
+  .max_bulk_tds = GRUB_EHCI_N_TD * 3 / 4,
+  /* one TD covers 4 pages even if the buffer is not page aligned */
+  .max_bulk_transaction_len = GRUB_EHCI_MAXBUFLEN - GRUB_EHCI_BUFPAGELEN
 };
 
 GRUB_MOD_INIT (ehci)
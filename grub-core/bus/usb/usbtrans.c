@@ -47,6 +47,7 @@ grub_usb_execute_and_wait_transfer (grub_usb_device_t dev,
   grub_usb_err_t err;
   grub_uint64_t endtime;
 
+  *actual = 0;
   err = dev->controller.dev->setup_transfer (&dev->controller, transfer);
   if (err)
     return err;
@@ -226,7 +227,7 @@ grub_usb_bulk_setup_readwrite (grub_usb_device_t dev,
   int i;
   grub_usb_transfer_t transfer;
   int datablocks;
-  unsigned int max;
+  unsigned int max, trlen;
   volatile char *data;
   grub_uint32_t data_addr;
   struct grub_pci_dma_chunk *data_chunk;
@@ -258,7 +259,13 @@ grub_usb_bulk_setup_readwrite (grub_usb_device_t dev,
 
   max = grub_usb_bulk_maxpacket (dev, endpoint);
 
-  datablocks = ((size + max - 1) / max);
+  /* Let each transaction carry as many whole packets as the controller
+     takes in one TD.  */
+  trlen = dev->controller.dev->max_bulk_transaction_len / max * max;
+  if (trlen < max)
+    trlen = max;
+
+  datablocks = ((size + trlen - 1) / trlen);
   transfer->transcnt = datablocks;
   transfer->size = size - 1;
   transfer->endpoint = endpoint->endp_addr;
@@ -286,30 +293,47 @@ grub_usb_bulk_setup_readwrite (grub_usb_device_t dev,
     {
       grub_usb_transaction_t tr = &transfer->transactions[i];
 
-      tr->size = (size > max) ? max : size;
+      tr->size = (size > trlen) ? trlen : size;
       /* XXX: Use the right most bit as the data toggle.  Simple and
-	 effective.  */
+	 effective.  The toggle flips with every packet.  */
       tr->toggle = toggle;
-      toggle = toggle ? 0 : 1;
+      toggle ^= ((tr->size + max - 1) / max) & 1;
       tr->pid = type;
-      tr->data = data_addr + i * max;
-      tr->preceding = i * max;
+      tr->data = data_addr + i * trlen;
+      tr->preceding = i * trlen;
       size -= tr->size;
     }
   return transfer;
 }
 
 static void
-grub_usb_bulk_finish_readwrite (grub_usb_transfer_t transfer)
+grub_usb_bulk_finish_readwrite (grub_usb_transfer_t transfer,
+				grub_size_t actual)
 {
   grub_usb_device_t dev = transfer->dev;
   int toggle = dev->toggle[transfer->endpoint];
 
   /* We must remember proper toggle value even if some transactions
-   * were not processed - correct value should be inversion of last
-   * processed transaction (TD). */
+   * were not processed - correct value should be toggle of last
+   * processed transaction (TD), flipped once per packet it moved.
+   * A transaction cut short ended with a short packet. */
   if (transfer->last_trans >= 0)
-    toggle = transfer->transactions[transfer->last_trans].toggle ? 0 : 1;
+    {
+      grub_usb_transaction_t tr
+	= &transfer->transactions[transfer->last_trans];
+      grub_size_t done = tr->size, packets;
+
+      if (actual >= tr->preceding && actual - tr->preceding < done)
+	{
+	  done = actual - tr->preceding;
+	  packets = done / transfer->max + 1;
+	}
+      else
+	packets = (done + transfer->max - 1) / transfer->max;
+      if (!packets)
+	packets = 1;
+      toggle = tr->toggle ^ (packets & 1);
+    }
   else
     toggle = dev->toggle[transfer->endpoint]; /* Nothing done, take original */
   grub_dprintf ("usb", "bulk: toggle=%d\n", toggle);
@@ -345,7 +369,7 @@ grub_usb_bulk_readwrite (grub_usb_device_t dev,
     return GRUB_USB_ERR_INTERNAL;
   err = grub_usb_execute_and_wait_transfer (dev, transfer, timeout, actual);
 
-  grub_usb_bulk_finish_readwrite (transfer);
+  grub_usb_bulk_finish_readwrite (transfer, *actual);
 
   return err;
 }
@@ -418,7 +442,7 @@ grub_usb_check_transfer (grub_usb_transfer_t transfer, grub_size_t *actual)
   if (err == GRUB_USB_ERR_WAIT)
     return err;
 
-  grub_usb_bulk_finish_readwrite (transfer);
+  grub_usb_bulk_finish_readwrite (transfer, *actual);
 
   return err;
 }
@@ -65,7 +65,7 @@ hash_file (grub_file_t file, const gcry_md_spec_t *hash, void *result)
 {
   void *context;
   grub_uint8_t *readbuf;
-#define BUF_SIZE 4096
+#define BUF_SIZE 65536
   readbuf = grub_malloc (BUF_SIZE);
   if (!readbuf)
     return grub_errno;
@@ -0,0 +1,171 @@
+/* netbench.c - Command to measure network file transfer performance  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2017  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/mm.h>
+#include <grub/file.h>
+#include <grub/time.h>
+#include <grub/misc.h>
+#include <grub/dl.h>
+#include <grub/extcmd.h>
+#include <grub/i18n.h>
+#include <grub/net.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define DEFAULT_BLOCK_SIZE	65536
+#define DEFAULT_INTERVAL	1000
+
+static const struct grub_arg_option options[] =
+  {
+    {"size", 's', 0, N_("Specify size for each read operation"), 0, ARG_TYPE_INT},
+    {"interval", 'i', 0, N_("Report throughput every MS milliseconds"),
+     N_("MS"), ARG_TYPE_INT},
+    {0, 0, 0, 0, 0, 0}
+  };
+
+static unsigned long long
+kibps (grub_uint64_t bytes, grub_uint64_t ms)
+{
+  if (!ms)
+    return 0;
+  return grub_divmod64 (bytes * 1000, ms * 1024, 0);
+}
+
+static grub_err_t
+grub_cmd_netbench (grub_extcmd_context_t ctxt, int argc, char **args)
+{
+  struct grub_arg_list *state = ctxt->state;
+  grub_uint64_t start, end, last, now, busy;
+  grub_uint64_t interval, last_size = 0;
+  grub_ssize_t block_size;
+  grub_uint64_t total_size = 0;
+  char *buffer, *ptr;
+  grub_file_t file;
+  struct grub_net_stats *st = &grub_net_stats;
+
+  if (argc == 0)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("filename expected"));
+
+  block_size = DEFAULT_BLOCK_SIZE;
+  if (state[0].set)
+    {
+      block_size = grub_strtoul (state[0].arg, &ptr, 0);
+      if (grub_errno || *ptr || block_size <= 0)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("invalid block size"));
+    }
+
+  interval = DEFAULT_INTERVAL;
+  if (state[1].set)
+    {
+      interval = grub_strtoul (state[1].arg, &ptr, 0);
+      if (grub_errno || *ptr)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("invalid interval"));
+    }
+
+  buffer = grub_malloc (block_size);
+  if (buffer == NULL)
+    return grub_errno;
+
+  grub_memset (st, 0, sizeof (*st));
+  start = last = grub_get_time_ms ();
+
+  file = grub_file_open (args[0]);
+  if (file == NULL)
+    goto quit;
+
+  while (1)
+    {
+      grub_ssize_t size = grub_file_read (file, buffer, block_size);
+      if (size <= 0)
+	break;
+      total_size += size;
+      now = grub_get_time_ms ();
+      if (interval && now - last >= interval)
+	{
+	  grub_printf_ (N_("%llu ms: %llu KiB, %llu KiB/s\n"),
+			(unsigned long long) (now - start),
+			(unsigned long long) (total_size >> 10),
+			kibps (total_size - last_size, now - last));
+	  last = now;
+	  last_size = total_size;
+	}
+    }
+  end = grub_get_time_ms ();
+  grub_file_close (file);
+  if (grub_errno)
+    goto quit;
+
+  grub_printf_ (N_("File size: %llu bytes\n"),
+		(unsigned long long) total_size);
+  grub_printf_ (N_("Elapsed time: %llu ms\n"),
+		(unsigned long long) (end - start));
+  grub_printf_ (N_("Throughput: %llu KiB/s\n"),
+		kibps (total_size, end - start));
+  grub_printf_ (N_("Packets: %llu received (%llu KiB), %llu sent (%llu KiB)\n"),
+		(unsigned long long) st->rx_packets,
+		(unsigned long long) (st->rx_bytes >> 10),
+		(unsigned long long) st->tx_packets,
+		(unsigned long long) (st->tx_bytes >> 10));
+  grub_printf_ (N_("Retransmits: %llu\n"),
+		(unsigned long long) st->retransmits);
+  grub_printf_ (N_("Duplicates: %llu, out of order: %llu, bad checksums: %llu\n"),
+		(unsigned long long) st->duplicates,
+		(unsigned long long) st->out_of_order,
+		(unsigned long long) st->bad_checksums);
+  if (st->rtt_samples)
+    grub_printf_ (N_("RTT: min %llu ms, avg %llu ms, max %llu ms "
+		     "(%llu samples)\n"),
+		  (unsigned long long) st->rtt_min_ms,
+		  (unsigned long long) grub_divmod64 (st->rtt_total_ms,
+						      st->rtt_samples, 0),
+		  (unsigned long long) st->rtt_max_ms,
+		  (unsigned long long) st->rtt_samples);
+  else
+    grub_printf_ (N_("RTT: no samples\n"));
+
+  /* Whatever isn't spent in the drivers or the stack is the file layer,
+     copying to the caller and timer overhead.  */
+  busy = st->driver_ms + st->idle_ms + st->stack_ms;
+  grub_printf_ (N_("Time: driver %llu ms, waiting %llu ms, stack %llu ms, "
+		   "other %llu ms\n"),
+		(unsigned long long) st->driver_ms,
+		(unsigned long long) st->idle_ms,
+		(unsigned long long) st->stack_ms,
+		(unsigned long long) (end - start > busy ? end - start - busy : 0));
+
+ quit:
+  grub_free (buffer);
+
+  return grub_errno;
+}
+
+static grub_extcmd_t cmd;
+
+GRUB_MOD_INIT(netbench)
+{
+  cmd = grub_register_extcmd ("netbench", grub_cmd_netbench, 0,
+			      N_("[-s SIZE] [-i MS] FILENAME"),
+			      N_("Measure network file transfer performance."),
+			      options);
+}
+
+GRUB_MOD_FINI(netbench)
+{
+  grub_unregister_extcmd (cmd);
+}
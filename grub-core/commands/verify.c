@@ -36,7 +36,22 @@ GRUB_MOD_LICENSE ("GPLv3+");
 struct grub_verified
 {
   grub_file_t file;
+  /* The whole file once it has been verified, or NULL while the signature
+     is still being checked as the file is streamed.  */
   void *buf;
+  /* Streaming state: the signature check in progress, how much of FILE has
+     been hashed so far, and a copy of its first HEAD_LEN bytes so that
+     headers may be read again.  Once all of FILE has been hashed, CTX is
+     gone and DIGEST holds the hash of its contents.  */
+  struct verify_ctx *ctx;
+  grub_off_t hashed;
+  grub_uint8_t *head;
+  grub_size_t head_len;
+  const gcry_md_spec_t *hash;
+  grub_uint8_t digest[GRUB_CRYPTO_MAX_MDLEN];
+  /* Set once the signature check has failed.  Every later read and the
+     close then fail too, so that the rejected data is never handed out.  */
+  int failed;
 };
 typedef struct grub_verified *grub_verified_t;
 
@@ -445,22 +460,27 @@ rsa_pad (gcry_mpi_t *hmpi, grub_uint8_t *hval,
   return ret;
 }
 
-static grub_err_t
-grub_verify_signature_real (char *buf, grub_size_t size,
-			    grub_file_t f, grub_file_t sig,
-			    struct grub_public_key *pkey)
+/* A signature check split around the signed data: verify_start parses the
+   signature packet up to the hash algorithm, the caller feeds the data to
+   HASH, and verify_finish hashes the trailer and checks the result.  */
+struct verify_ctx
 {
-  grub_size_t len;
-  grub_uint8_t v;
-  grub_uint8_t h;
-  grub_uint8_t t;
-  grub_uint8_t pk;
+  grub_file_t sig;
   const gcry_md_spec_t *hash;
+  void *context;
+  grub_uint8_t v;
   struct signature_v4_header v4;
-  grub_err_t err;
-  grub_size_t i;
-  gcry_mpi_t mpis[10];
+};
+
+static grub_err_t
+verify_start (grub_file_t sig, struct verify_ctx *ctx)
+{
+  grub_size_t len;
   grub_uint8_t type = 0;
+  grub_err_t err;
+
+  ctx->sig = sig;
+  ctx->context = NULL;
 
   err = read_packet_header (sig, &type, &len);
   if (err)
@@ -469,198 +489,238 @@ grub_verify_signature_real (char *buf, grub_size_t size,
   if (type != 0x2)
     return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
 
-  if (grub_file_read (sig, &v, sizeof (v)) != sizeof (v))
+  if (grub_file_read (sig, &ctx->v, sizeof (ctx->v)) != sizeof (ctx->v))
     return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
 
-  if (v != 4)
+  if (ctx->v != 4)
     return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
 
-  if (grub_file_read (sig, &v4, sizeof (v4)) != sizeof (v4))
+  if (grub_file_read (sig, &ctx->v4, sizeof (ctx->v4)) != sizeof (ctx->v4))
     return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
 
-  h = v4.hash;
-  t = v4.type;
-  pk = v4.pkeyalgo;
-  
-  if (t != 0)
+  if (ctx->v4.type != 0)
     return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
 
-  if (h >= ARRAY_SIZE (hashes) || hashes[h] == NULL)
+  if (ctx->v4.hash >= ARRAY_SIZE (hashes) || hashes[ctx->v4.hash] == NULL)
     return grub_error (GRUB_ERR_BAD_SIGNATURE, "unknown hash");
 
-  if (pk >= ARRAY_SIZE (pkalgos) || pkalgos[pk].name == NULL)
+  if (ctx->v4.pkeyalgo >= ARRAY_SIZE (pkalgos)
+      || pkalgos[ctx->v4.pkeyalgo].name == NULL)
     return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
 
-  hash = grub_crypto_lookup_md_by_name (hashes[h]);
-  if (!hash)
-    return grub_error (GRUB_ERR_BAD_SIGNATURE, "hash `%s' not loaded", hashes[h]);
+  ctx->hash = grub_crypto_lookup_md_by_name (hashes[ctx->v4.hash]);
+  if (!ctx->hash)
+    return grub_error (GRUB_ERR_BAD_SIGNATURE, "hash `%s' not loaded",
+		       hashes[ctx->v4.hash]);
 
   grub_dprintf ("crypt", "alive\n");
 
-  {
-    void *context = NULL;
-    unsigned char *hval;
-    grub_ssize_t rem = grub_be_to_cpu16 (v4.hashed_sub);
-    grub_uint32_t headlen = grub_cpu_to_be32 (rem + 6);
-    grub_uint8_t s;
-    grub_uint16_t unhashed_sub;
-    grub_ssize_t r;
-    grub_uint8_t hash_start[2];
-    gcry_mpi_t hmpi;
-    grub_uint64_t keyid = 0;
-    struct grub_public_subkey *sk;
-    grub_uint8_t *readbuf = NULL;
-
-    context = grub_zalloc (hash->contextsize);
-    readbuf = grub_zalloc (READBUF_SIZE);
-    if (!context || !readbuf)
-      goto fail;
+  ctx->context = grub_zalloc (ctx->hash->contextsize);
+  if (!ctx->context)
+    return grub_errno;
+  ctx->hash->init (ctx->context);
 
-    hash->init (context);
-    if (buf)
-      hash->write (context, buf, size);
-    else 
-      while (1)
-	{
-	  r = grub_file_read (f, readbuf, READBUF_SIZE);
-	  if (r < 0)
-	    goto fail;
-	  if (r == 0)
-	    break;
-	  hash->write (context, readbuf, r);
-	}
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+verify_finish (struct verify_ctx *ctx, struct grub_public_key *pkey)
+{
+  const gcry_md_spec_t *hash = ctx->hash;
+  void *context = ctx->context;
+  grub_file_t sig = ctx->sig;
+  grub_uint8_t pk = ctx->v4.pkeyalgo;
+  grub_size_t i;
+  gcry_mpi_t mpis[10];
+
+  unsigned char *hval;
+  grub_ssize_t rem = grub_be_to_cpu16 (ctx->v4.hashed_sub);
+  grub_uint32_t headlen = grub_cpu_to_be32 (rem + 6);
+  grub_uint8_t s;
+  grub_uint16_t unhashed_sub;
+  grub_ssize_t r;
+  grub_uint8_t hash_start[2];
+  gcry_mpi_t hmpi;
+  grub_uint64_t keyid = 0;
+  struct grub_public_subkey *sk;
+  grub_uint8_t *readbuf = NULL;
+
+  readbuf = grub_zalloc (READBUF_SIZE);
+  if (!readbuf)
+    goto fail;
 
-    hash->write (context, &v, sizeof (v));
-    hash->write (context, &v4, sizeof (v4));
-    while (rem)
+  hash->write (context, &ctx->v, sizeof (ctx->v));
+  hash->write (context, &ctx->v4, sizeof (ctx->v4));
+  while (rem)
+    {
+      r = grub_file_read (sig, readbuf,
+			  rem < READBUF_SIZE ? rem : READBUF_SIZE);
+      if (r < 0)
+	goto fail;
+      if (r == 0)
+	break;
+      hash->write (context, readbuf, r);
+      rem -= r;
+    }
+  hash->write (context, &ctx->v, sizeof (ctx->v));
+  s = 0xff;
+  hash->write (context, &s, sizeof (s));
+  hash->write (context, &headlen, sizeof (headlen));
+  r = grub_file_read (sig, &unhashed_sub, sizeof (unhashed_sub));
+  if (r != sizeof (unhashed_sub))
+    goto fail;
+  {
+    grub_uint8_t *ptr;
+    grub_uint32_t l;
+    rem = grub_be_to_cpu16 (unhashed_sub);
+    if (rem > READBUF_SIZE)
+      goto fail;
+    r = grub_file_read (sig, readbuf, rem);
+    if (r != rem)
+      goto fail;
+    for (ptr = readbuf; ptr < readbuf + rem; ptr += l)
       {
-	r = grub_file_read (sig, readbuf,
-			    rem < READBUF_SIZE ? rem : READBUF_SIZE);
-	if (r < 0)
-	  goto fail;
-	if (r == 0)
-	  break;
-	hash->write (context, readbuf, r);
-	rem -= r;
+	if (*ptr < 192)
+	  l = *ptr++;
+	else if (*ptr < 255)
+	  {
+	    if (ptr + 1 >= readbuf + rem)
+	      break;
+	    l = (((ptr[0] & ~192) << GRUB_CHAR_BIT) | ptr[1]) + 192;
+	    ptr += 2;
+	  }
+	else
+	  {
+	    if (ptr + 5 >= readbuf + rem)
+	      break;
+	    l = grub_be_to_cpu32 (grub_get_unaligned32 (ptr + 1));
+	    ptr += 5;
+	  }
+	if (*ptr == 0x10 && l >= 8)
+	  keyid = grub_get_unaligned64 (ptr + 1);
       }
-    hash->write (context, &v, sizeof (v));
-    s = 0xff;
-    hash->write (context, &s, sizeof (s));
-    hash->write (context, &headlen, sizeof (headlen));
-    r = grub_file_read (sig, &unhashed_sub, sizeof (unhashed_sub));
-    if (r != sizeof (unhashed_sub))
-      goto fail;
+  }
+
+  hash->final (context);
+
+  grub_dprintf ("crypt", "alive\n");
+
+  hval = hash->read (context);
+
+  if (grub_file_read (sig, hash_start, sizeof (hash_start)) != sizeof (hash_start))
+    goto fail;
+  if (grub_memcmp (hval, hash_start, sizeof (hash_start)) != 0)
+    goto fail;
+
+  grub_dprintf ("crypt", "@ %x\n", (int)grub_file_tell (sig));
+
+  for (i = 0; i < pkalgos[pk].nmpisig; i++)
     {
-      grub_uint8_t *ptr;
-      grub_uint32_t l;
-      rem = grub_be_to_cpu16 (unhashed_sub);
-      if (rem > READBUF_SIZE)
+      grub_uint16_t l;
+      grub_size_t lb;
+      grub_dprintf ("crypt", "alive\n");
+      if (grub_file_read (sig, &l, sizeof (l)) != sizeof (l))
 	goto fail;
-      r = grub_file_read (sig, readbuf, rem);
-      if (r != rem)
+      grub_dprintf ("crypt", "alive\n");
+      lb = (grub_be_to_cpu16 (l) + 7) / 8;
+      grub_dprintf ("crypt", "l = 0x%04x\n", grub_be_to_cpu16 (l));
+      if (lb > READBUF_SIZE - sizeof (grub_uint16_t))
 	goto fail;
-      for (ptr = readbuf; ptr < readbuf + rem; ptr += l)
-	{
-	  if (*ptr < 192)
-	    l = *ptr++;
-	  else if (*ptr < 255)
-	    {
-	      if (ptr + 1 >= readbuf + rem)
-		break;
-	      l = (((ptr[0] & ~192) << GRUB_CHAR_BIT) | ptr[1]) + 192;
-	      ptr += 2;
-	    }
-	  else
-	    {
-	      if (ptr + 5 >= readbuf + rem)
-		break;
-	      l = grub_be_to_cpu32 (grub_get_unaligned32 (ptr + 1));
-	      ptr += 5;
-	    }
-	  if (*ptr == 0x10 && l >= 8)
-	    keyid = grub_get_unaligned64 (ptr + 1);
-	}
-    }
+      grub_dprintf ("crypt", "alive\n");
+      if (grub_file_read (sig, readbuf + sizeof (grub_uint16_t), lb) != (grub_ssize_t) lb)
+	goto fail;
+      grub_dprintf ("crypt", "alive\n");
+      grub_memcpy (readbuf, &l, sizeof (l));
+      grub_dprintf ("crypt", "alive\n");
 
-    hash->final (context);
+      if (gcry_mpi_scan (&mpis[i], GCRYMPI_FMT_PGP,
+			 readbuf, lb + sizeof (grub_uint16_t), 0))
+	goto fail;
+      grub_dprintf ("crypt", "alive\n");
+    }
 
-    grub_dprintf ("crypt", "alive\n");
+  if (pkey)
+    sk = grub_crypto_pk_locate_subkey (keyid, pkey);
+  else
+    sk = grub_crypto_pk_locate_subkey_in_trustdb (keyid);
+  if (!sk)
+    {
+      /* TRANSLATORS: %08x is 32-bit key id.  */
+      grub_error (GRUB_ERR_BAD_SIGNATURE, N_("public key %08x not found"),
+		  keyid);
+      goto fail;
+    }
 
-    hval = hash->read (context);
+  if (pkalgos[pk].pad (&hmpi, hval, hash, sk))
+    goto fail;
+  if (!*pkalgos[pk].algo)
+    {
+      grub_dl_load (pkalgos[pk].module);
+      grub_errno = GRUB_ERR_NONE;
+    }
 
-    if (grub_file_read (sig, hash_start, sizeof (hash_start)) != sizeof (hash_start))
-      goto fail;
-    if (grub_memcmp (hval, hash_start, sizeof (hash_start)) != 0)
+  if (!*pkalgos[pk].algo)
+    {
+      grub_error (GRUB_ERR_BAD_SIGNATURE, N_("module `%s' isn't loaded"),
+		  pkalgos[pk].module);
       goto fail;
+    }
+  if ((*pkalgos[pk].algo)->verify (0, hmpi, mpis, sk->mpis, 0, 0))
+    goto fail;
 
-    grub_dprintf ("crypt", "@ %x\n", (int)grub_file_tell (sig));
+  grub_free (readbuf);
 
-    for (i = 0; i < pkalgos[pk].nmpisig; i++)
-      {
-	grub_uint16_t l;
-	grub_size_t lb;
-	grub_dprintf ("crypt", "alive\n");
-	if (grub_file_read (sig, &l, sizeof (l)) != sizeof (l))
-	  goto fail;
-	grub_dprintf ("crypt", "alive\n");
-	lb = (grub_be_to_cpu16 (l) + 7) / 8;
-	grub_dprintf ("crypt", "l = 0x%04x\n", grub_be_to_cpu16 (l));
-	if (lb > READBUF_SIZE - sizeof (grub_uint16_t))
-	  goto fail;
-	grub_dprintf ("crypt", "alive\n");
-	if (grub_file_read (sig, readbuf + sizeof (grub_uint16_t), lb) != (grub_ssize_t) lb)
-	  goto fail;
-	grub_dprintf ("crypt", "alive\n");
-	grub_memcpy (readbuf, &l, sizeof (l));
-	grub_dprintf ("crypt", "alive\n");
+  return GRUB_ERR_NONE;
 
-	if (gcry_mpi_scan (&mpis[i], GCRYMPI_FMT_PGP,
-			   readbuf, lb + sizeof (grub_uint16_t), 0))
-	  goto fail;
-	grub_dprintf ("crypt", "alive\n");
-      }
+ fail:
+  grub_free (readbuf);
+  if (!grub_errno)
+    return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+  return grub_errno;
+}
 
-    if (pkey)
-      sk = grub_crypto_pk_locate_subkey (keyid, pkey);
-    else
-      sk = grub_crypto_pk_locate_subkey_in_trustdb (keyid);
-    if (!sk)
-      {
-	/* TRANSLATORS: %08x is 32-bit key id.  */
-	grub_error (GRUB_ERR_BAD_SIGNATURE, N_("public key %08x not found"),
-		    keyid);
-	goto fail;
-      }
 
-    if (pkalgos[pk].pad (&hmpi, hval, hash, sk))
-      goto fail;
-    if (!*pkalgos[pk].algo)
-      {
-	grub_dl_load (pkalgos[pk].module);
-	grub_errno = GRUB_ERR_NONE;
-      }
+static grub_err_t
+grub_verify_signature_real (char *buf, grub_size_t size,
+			    grub_file_t f, grub_file_t sig,
+			    struct grub_public_key *pkey)
+{
+  struct verify_ctx ctx;
+  grub_err_t err;
 
-    if (!*pkalgos[pk].algo)
-      {
-	grub_error (GRUB_ERR_BAD_SIGNATURE, N_("module `%s' isn't loaded"),
-		    pkalgos[pk].module);
-	goto fail;
-      }
-    if ((*pkalgos[pk].algo)->verify (0, hmpi, mpis, sk->mpis, 0, 0))
-      goto fail;
+  err = verify_start (sig, &ctx);
+  if (err)
+    goto out;
 
-    grub_free (context);
-    grub_free (readbuf);
+  if (buf)
+    ctx.hash->write (ctx.context, buf, size);
+  else
+    {
+      grub_uint8_t *readbuf;
+      grub_ssize_t r;
 
-    return GRUB_ERR_NONE;
+      readbuf = grub_malloc (READBUF_SIZE);
+      if (!readbuf)
+	{
+	  err = grub_errno;
+	  goto out;
+	}
+      while ((r = grub_file_read (f, readbuf, READBUF_SIZE)) > 0)
+	ctx.hash->write (ctx.context, readbuf, r);
+      grub_free (readbuf);
+      if (r < 0)
+	{
+	  err = grub_errno;
+	  if (!err)
+	    err = grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+	  goto out;
+	}
+    }
 
-  fail:
-    grub_free (context);
-    grub_free (readbuf);
-    if (!grub_errno)
-      return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
-    return grub_errno;
-  }
+  err = verify_finish (&ctx, pkey);
+ out:
+  grub_free (ctx.context);
+  return err;
 }
 
 grub_err_t
@@ -815,22 +875,214 @@ grub_cmd_verify_signature (grub_extcmd_context_t ctxt,
 
 static int sec = 0;
 
+/* Bytes kept from the start of a streamed file, and the largest forward
+   seek that is hashed through rather than making us buffer the file.  */
+#define VERIFY_HEAD_SIZE 0x8000
+#define VERIFY_SKIP_MAX (1 << 20)
+
+static void
+verify_ctx_free (struct verify_ctx *ctx)
+{
+  if (ctx)
+    {
+      grub_file_close (ctx->sig);
+      grub_free (ctx->context);
+      grub_free (ctx);
+    }
+}
+
 static void
 verified_free (grub_verified_t verified)
 {
   if (verified)
     {
+      verify_ctx_free (verified->ctx);
+      grub_free (verified->head);
       grub_free (verified->buf);
       grub_free (verified);
     }
 }
 
+/* Store in VERIFIED->digest the hash of what has been streamed so far.  */
+static grub_err_t
+verified_digest (grub_verified_t verified)
+{
+  struct verify_ctx *ctx = verified->ctx;
+  void *copy;
+
+  copy = grub_malloc (ctx->hash->contextsize);
+  if (!copy)
+    return grub_errno;
+  grub_memcpy (copy, ctx->context, ctx->hash->contextsize);
+  ctx->hash->final (copy);
+  grub_memcpy (verified->digest, ctx->hash->read (copy), ctx->hash->mdlen);
+  grub_free (copy);
+  return GRUB_ERR_NONE;
+}
+
+/* Read LEN bytes of the underlying file at the hash position into BUF (or
+   into a scratch buffer if BUF is NULL) and hash them.  Once the whole file
+   has gone through, check the signature.  */
+static grub_err_t
+verified_stream (grub_verified_t verified, grub_uint8_t *buf, grub_size_t len)
+{
+  struct verify_ctx *ctx = verified->ctx;
+  grub_uint8_t *scratch = NULL;
+  grub_err_t err;
+
+  if (!buf)
+    {
+      scratch = grub_malloc (READBUF_SIZE);
+      if (!scratch)
+	return grub_errno;
+    }
+
+  grub_file_seek (verified->file, verified->hashed);
+  while (len)
+    {
+      grub_size_t n = len;
+      grub_uint8_t *dst = buf;
+
+      if (scratch)
+	{
+	  dst = scratch;
+	  if (n > READBUF_SIZE)
+	    n = READBUF_SIZE;
+	}
+      if (grub_file_read (verified->file, dst, n) != (grub_ssize_t) n)
+	{
+	  grub_free (scratch);
+	  if (!grub_errno)
+	    grub_error (GRUB_ERR_FILE_READ_ERROR, N_("premature end of file %s"),
+			verified->file->name);
+	  return grub_errno;
+	}
+      ctx->hash->write (ctx->context, dst, n);
+
+      if (verified->hashed < verified->head_len)
+	{
+	  grub_size_t h = verified->head_len - verified->hashed;
+
+	  if (h > n)
+	    h = n;
+	  grub_memcpy (verified->head + verified->hashed, dst, h);
+	}
+
+      verified->hashed += n;
+      len -= n;
+      if (buf)
+	buf += n;
+    }
+  grub_free (scratch);
+
+  if (verified->hashed < verified->file->size)
+    return GRUB_ERR_NONE;
+
+  err = verified_digest (verified);
+  if (!err)
+    err = verify_finish (ctx, NULL);
+  verify_ctx_free (ctx);
+  verified->ctx = NULL;
+  /* Without CTX nothing can be checked any more, so whatever went wrong
+     here is final.  */
+  if (err)
+    verified->failed = 1;
+  return err;
+}
+
+/* Give up on streaming and keep the whole file in memory from now on.  The
+   part already streamed is read again if it is not in HEAD, and must hash
+   to what was hashed the first time; the rest goes through the signature
+   check as usual.  */
+static grub_err_t
+verified_buffer (grub_verified_t verified)
+{
+  grub_size_t hashed = verified->hashed;
+  grub_uint8_t *buf;
+  grub_err_t err;
+
+  buf = grub_malloc (verified->file->size);
+  if (!buf)
+    return grub_errno;
+
+  if (hashed <= verified->head_len)
+    grub_memcpy (buf, verified->head, hashed);
+  else
+    {
+      grub_uint8_t again[GRUB_CRYPTO_MAX_MDLEN];
+
+      if (verified->ctx && verified_digest (verified))
+	{
+	  grub_free (buf);
+	  return grub_errno;
+	}
+      grub_file_seek (verified->file, 0);
+      if (grub_file_read (verified->file, buf, hashed) != (grub_ssize_t) hashed)
+	{
+	  grub_free (buf);
+	  if (!grub_errno)
+	    grub_error (GRUB_ERR_FILE_READ_ERROR, N_("premature end of file %s"),
+			verified->file->name);
+	  return grub_errno;
+	}
+      grub_crypto_hash (verified->hash, again, buf, hashed);
+      if (grub_memcmp (again, verified->digest, verified->hash->mdlen) != 0)
+	{
+	  grub_free (buf);
+	  verified->failed = 1;
+	  return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+	}
+    }
+
+  if (verified->ctx)
+    {
+      err = verified_stream (verified, buf + hashed,
+			     verified->file->size - hashed);
+      if (err)
+	{
+	  grub_free (buf);
+	  return err;
+	}
+    }
+  verified->buf = buf;
+  return GRUB_ERR_NONE;
+}
+
 static grub_ssize_t
 verified_read (struct grub_file *file, char *buf, grub_size_t len)
 {
   grub_verified_t verified = file->data;
+  grub_off_t offset = file->offset;
 
-  grub_memcpy (buf, (char *) verified->buf + file->offset, len);
+  if (verified->failed)
+    {
+      grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+      return -1;
+    }
+
+  if (!verified->buf)
+    {
+      if (offset + len <= verified->head_len
+	  && offset + len <= verified->hashed)
+	{
+	  grub_memcpy (buf, verified->head + offset, len);
+	  return len;
+	}
+      if (verified->ctx && offset >= verified->hashed
+	  && offset - verified->hashed <= VERIFY_SKIP_MAX)
+	{
+	  if (offset > verified->hashed
+	      && verified_stream (verified, NULL, offset - verified->hashed))
+	    return -1;
+	  if (verified_stream (verified, (grub_uint8_t *) buf, len))
+	    return -1;
+	  return len;
+	}
+      if (verified_buffer (verified))
+	return -1;
+    }
+
+  grub_memcpy (buf, (char *) verified->buf + offset, len);
   return len;
 }
 
@@ -839,6 +1091,15 @@ verified_close (struct grub_file *file)
 {
   grub_verified_t verified = file->data;
 
+  /* A failed check is reported again in case the caller ignored it.
+     Callers that defer the check read the whole file; if one did not, what
+     it read was never verified.  */
+  if (verified->failed && grub_errno == GRUB_ERR_NONE)
+    grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+  else if (verified->ctx && grub_errno == GRUB_ERR_NONE)
+    grub_error (GRUB_ERR_BAD_SIGNATURE, N_("file %s was not verified"),
+		verified->file->name);
+
   grub_file_close (verified->file);
   verified_free (verified);
   file->data = 0;
@@ -866,6 +1127,7 @@ grub_pubkey_open (grub_file_t io, const char *filename)
   grub_file_filter_t curfilt[GRUB_FILE_FILTER_MAX];
   grub_file_t ret;
   grub_verified_t verified;
+  int deferred = grub_file_pubkey_deferred;
 
   if (!sec)
     return io;
@@ -907,18 +1169,59 @@ grub_pubkey_open (grub_file_t io, const char *filename)
       grub_free (ret);
       return NULL;
     }
-  verified = grub_malloc (sizeof (*verified));
+  verified = grub_zalloc (sizeof (*verified));
   if (!verified)
     {
       grub_file_close (sig);
       grub_free (ret);
       return NULL;
     }
+  verified->file = io;
+
+  if (deferred)
+    {
+      /* Check the signature as the caller reads the file.  */
+      verified->ctx = grub_malloc (sizeof (*verified->ctx));
+      if (!verified->ctx)
+	{
+	  grub_file_close (sig);
+	  verified_free (verified);
+	  grub_free (ret);
+	  return NULL;
+	}
+      err = verify_start (sig, verified->ctx);
+      if (err)
+	{
+	  grub_free (verified->ctx->context);
+	  grub_free (verified->ctx);
+	  verified->ctx = NULL;
+	  grub_file_close (sig);
+	  verified_free (verified);
+	  grub_free (ret);
+	  return NULL;
+	}
+      verified->hash = verified->ctx->hash;
+      verified->head_len = ret->size < VERIFY_HEAD_SIZE ? ret->size
+	: VERIFY_HEAD_SIZE;
+      if (verified->head_len)
+	verified->head = grub_malloc (verified->head_len);
+      /* An empty file has nothing left to stream.  */
+      if ((verified->head_len && !verified->head)
+	  || (!ret->size && verified_stream (verified, NULL, 0)))
+	{
+	  verified_free (verified);
+	  grub_free (ret);
+	  return NULL;
+	}
+      ret->data = verified;
+      return ret;
+    }
+
   verified->buf = grub_malloc (ret->size);
   if (!verified->buf)
     {
       grub_file_close (sig);
-      grub_free (verified);
+      verified_free (verified);
       grub_free (ret);
       return NULL;
     }
@@ -941,7 +1244,6 @@ grub_pubkey_open (grub_file_t io, const char *filename)
       grub_free (ret);
       return NULL;
     }
-  verified->file = io;
   ret->data = verified;
   return ret;
 }
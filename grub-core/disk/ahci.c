@@ -37,6 +37,14 @@ struct grub_ahci_cmd_head
   grub_uint32_t unused[4];
 };
 
+/* A PRDT entry can describe up to 4 MiB, but the bounce buffer is split
+   into smaller chunks so that large transfers don't need one huge
+   contiguous DMA allocation.  */
+#define GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH 0x200000
+#define GRUB_AHCI_MAX_PRDT_ENTRIES 8
+#define GRUB_AHCI_MAX_TRANSFER (GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH \
+				* GRUB_AHCI_MAX_PRDT_ENTRIES)
+
 struct grub_ahci_prdt_entry
 {
   grub_uint64_t data_base;
@@ -49,7 +57,7 @@ struct grub_ahci_cmd_table
   grub_uint8_t cfis[0x40];
   grub_uint8_t command[0x10];
   grub_uint8_t reserved[0x30];
-  struct grub_ahci_prdt_entry prdt[1];
+  struct grub_ahci_prdt_entry prdt[GRUB_AHCI_MAX_PRDT_ENTRIES];
 };
 
 struct grub_ahci_hba_port
@@ -160,8 +168,6 @@ enum
 #define GRUB_AHCI_CONFIG_PRDT_LENGTH_SHIFT 16
 #define GRUB_AHCI_INTERRUPT_ON_COMPLETE 0x80000000
 
-#define GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH 0x200000
-
 static struct grub_ahci_device *grub_ahci_devices;
 static int numdevs;
 
@@ -378,9 +384,9 @@ grub_ahci_pciinit (grub_pci_device_t dev,
 	adevs[i]->command_table = grub_dma_get_virt (adevs[i]->command_table_chunk);
 
 	grub_memset ((void *) adevs[i]->command_list, 0,
-		     sizeof (struct grub_ahci_cmd_table));
-	grub_memset ((void *) adevs[i]->command_table, 0,
 		     sizeof (struct grub_ahci_cmd_head) * 32);
+	grub_memset ((void *) adevs[i]->command_table, 0,
+		     sizeof (struct grub_ahci_cmd_table));
 
 	adevs[i]->command_list->command_table_base
 	  = grub_dma_get_phys (adevs[i]->command_table_chunk);
@@ -904,9 +910,10 @@ grub_ahci_readwrite_real (struct grub_ahci_device *dev,
 			  struct grub_disk_ata_pass_through_parms *parms,
 			  int spinup, int reset)
 {
-  struct grub_pci_dma_chunk *bufc;
+  struct grub_pci_dma_chunk *bufc[GRUB_AHCI_MAX_PRDT_ENTRIES];
   grub_uint64_t endtime;
-  unsigned i;
+  grub_size_t off;
+  unsigned i, nprdt;
   grub_err_t err = GRUB_ERR_NONE;
 
   grub_dprintf ("ahci", "AHCI tfd = %x\n",
@@ -931,13 +938,25 @@ grub_ahci_readwrite_real (struct grub_ahci_device *dev,
   if (parms->cmdsize != 0 && parms->cmdsize != 12 && parms->cmdsize != 16)
     return grub_error (GRUB_ERR_BUG, "incorrect ATAPI command size");
 
-  if (parms->size > GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH)
+  if (parms->size > GRUB_AHCI_MAX_TRANSFER)
     return grub_error (GRUB_ERR_BUG, "too big data buffer");
 
-  if (parms->size)
-    bufc = grub_memalign_dma32 (1024, parms->size + (parms->size & 1));
-  else
-    bufc = grub_memalign_dma32 (1024, 512);
+  nprdt = ALIGN_UP (parms->size, GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH)
+    / GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH;
+  for (i = 0; i < nprdt; i++)
+    {
+      grub_size_t len = parms->size - i * GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH;
+
+      if (len > GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH)
+	len = GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH;
+      bufc[i] = grub_memalign_dma32 (1024, len + (len & 1));
+      if (!bufc[i])
+	{
+	  while (i--)
+	    grub_dma_free (bufc[i]);
+	  return grub_errno;
+	}
+    }
 
   grub_dprintf ("ahci", "AHCI tfd = %x, CL=%p\n",
 		dev->hba->ports[dev->port].task_file_data,
@@ -947,7 +966,7 @@ grub_ahci_readwrite_real (struct grub_ahci_device *dev,
     = (5 << GRUB_AHCI_CONFIG_CFIS_LENGTH_SHIFT)
     //    | GRUB_AHCI_CONFIG_CLEAR_R_OK
     | (0 << GRUB_AHCI_CONFIG_PMP_SHIFT)
-    | ((parms->size ? 1 : 0) << GRUB_AHCI_CONFIG_PRDT_LENGTH_SHIFT)
+    | (nprdt << GRUB_AHCI_CONFIG_PRDT_LENGTH_SHIFT)
     | (parms->cmdsize ? GRUB_AHCI_CONFIG_ATAPI : 0)
     | (parms->write ? GRUB_AHCI_CONFIG_WRITE : GRUB_AHCI_CONFIG_READ)
     | (parms->taskfile.cmd == 8 ? (1 << 8) : 0);
@@ -989,20 +1008,26 @@ grub_ahci_readwrite_real (struct grub_ahci_device *dev,
 		dev->command_table[0].cfis[12], dev->command_table[0].cfis[13],
 		dev->command_table[0].cfis[14], dev->command_table[0].cfis[15]);
 
-  dev->command_table[0].prdt[0].data_base = grub_dma_get_phys (bufc);
-  dev->command_table[0].prdt[0].unused = 0;
-  dev->command_table[0].prdt[0].size = (parms->size - 1);
+  for (i = 0, off = 0; i < nprdt; i++, off += GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH)
+    {
+      grub_size_t len = parms->size - off;
+
+      if (len > GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH)
+	len = GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH;
+
+      dev->command_table[0].prdt[i].data_base = grub_dma_get_phys (bufc[i]);
+      dev->command_table[0].prdt[i].unused = 0;
+      dev->command_table[0].prdt[i].size = (len - 1);
 
-  grub_dprintf ("ahci", "PRDT = %" PRIxGRUB_UINT64_T ", %x, %x (%"
-		PRIuGRUB_SIZE ")\n",
-		dev->command_table[0].prdt[0].data_base,
-		dev->command_table[0].prdt[0].unused,
-		dev->command_table[0].prdt[0].size,
-		(grub_size_t) ((char *) &dev->command_table[0].prdt[0]
-			       - (char *) &dev->command_table[0]));
+      grub_dprintf ("ahci", "PRDT %u = %" PRIxGRUB_UINT64_T ", %x, %x\n", i,
+		    dev->command_table[0].prdt[i].data_base,
+		    dev->command_table[0].prdt[i].unused,
+		    dev->command_table[0].prdt[i].size);
 
-  if (parms->write)
-    grub_memcpy ((char *) grub_dma_get_virt (bufc), parms->buffer, parms->size);
+      if (parms->write)
+	grub_memcpy ((char *) grub_dma_get_virt (bufc[i]),
+		     (char *) parms->buffer + off, len);
+    }
 
   grub_dprintf ("ahci", "AHCI command scheduled\n");
   grub_dprintf ("ahci", "AHCI tfd = %x\n",
@@ -1069,9 +1094,17 @@ grub_ahci_readwrite_real (struct grub_ahci_device *dev,
 		((grub_uint32_t *) grub_dma_get_virt (dev->rfis))[0x16],
 		((grub_uint32_t *) grub_dma_get_virt (dev->rfis))[0x17]);
 
-  if (!parms->write)
-    grub_memcpy (parms->buffer, (char *) grub_dma_get_virt (bufc), parms->size);
-  grub_dma_free (bufc);
+  for (i = 0, off = 0; i < nprdt; i++, off += GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH)
+    {
+      grub_size_t len = parms->size - off;
+
+      if (len > GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH)
+	len = GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH;
+      if (!parms->write)
+	grub_memcpy ((char *) parms->buffer + off,
+		     (char *) grub_dma_get_virt (bufc[i]), len);
+      grub_dma_free (bufc[i]);
+    }
 
   return err;
 }
@@ -1104,7 +1137,7 @@ grub_ahci_open (int id, int devnum, struct grub_ata *ata)
   ata->data = dev;
   ata->dma = 1;
   ata->atapi = dev->atapi;
-  ata->maxbuffer = GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH;
+  ata->maxbuffer = GRUB_AHCI_MAX_TRANSFER;
   ata->present = &dev->present;
 
   return GRUB_ERR_NONE;
@@ -288,11 +288,15 @@ grub_ata_readwrite (grub_disk_t disk, grub_disk_addr_t sector,
   grub_size_t batch;
   int cmd, cmd_write;
   grub_size_t nsectors = 0;
+  grub_size_t maxsectors = ata->maxbuffer >> ata->log_sector_size;
 
   grub_dprintf("ata", "grub_ata_readwrite (size=%llu, rw=%d)\n",
 	       (unsigned long long) size, rw);
 
-  if (addressing == GRUB_ATA_LBA48 && ((sector + size) >> 28) != 0)
+  /* LBA48 commands are also used for low sectors when the controller can
+     take more than 256 sectors at once.  */
+  if (addressing == GRUB_ATA_LBA48
+      && (((sector + size) >> 28) != 0 || (size > 256 && maxsectors > 256)))
     {
       if (ata->dma)
 	{
@@ -321,7 +325,9 @@ grub_ata_readwrite (grub_disk_t disk, grub_disk_addr_t sector,
 	}
     }
 
-  if (addressing != GRUB_ATA_CHS)
+  if (addressing == GRUB_ATA_LBA48)
+    batch = maxsectors < 65536 ? maxsectors : 65536;
+  else if (addressing != GRUB_ATA_CHS)
     batch = 256;
   else
     batch = 1;
@@ -345,6 +351,14 @@ grub_ata_readwrite (grub_disk_t disk, grub_disk_addr_t sector,
 	parms.dma = 1;
   
       err = ata->dev->readwrite (ata, &parms, 0);
+      /* Controllers bounce transfers through DMA memory, which may not be
+	 available in one piece for the largest ones.  */
+      if (err == GRUB_ERR_OUT_OF_MEMORY && batch > 1)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  batch >>= 1;
+	  continue;
+	}
       if (err)
 	return err;
       if (parms.size != batch << ata->log_sector_size)
@@ -451,7 +465,7 @@ grub_ata_iterate (grub_disk_dev_iterate_hook_t hook, void *hook_data,
 static grub_err_t
 grub_ata_open (const char *name, grub_disk_t disk)
 {
-  unsigned id, bus;
+  unsigned id, bus, maxsectors;
   struct grub_ata *ata;
 
   for (id = 0; id < GRUB_SCSI_NUM_SUBSYSTEMS; id++)
@@ -471,8 +485,9 @@ grub_ata_open (const char *name, grub_disk_t disk)
 
   disk->total_sectors = ata->size;
   disk->max_agglomerate = (ata->maxbuffer >> (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS));
-  if (disk->max_agglomerate > (256U >> (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS - ata->log_sector_size)))
-    disk->max_agglomerate = (256U >> (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS - ata->log_sector_size));
+  maxsectors = (ata->addr == GRUB_ATA_LBA48) ? 65536U : 256U;
+  if (disk->max_agglomerate > (maxsectors >> (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS - ata->log_sector_size)))
+    disk->max_agglomerate = (maxsectors >> (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS - ata->log_sector_size));
 
   disk->log_sector_size = ata->log_sector_size;
 
@@ -54,21 +54,19 @@ static inline int GF_PER_SECTOR (const struct grub_cryptodisk *dev)
 static grub_cryptodisk_t cryptodisk_list = NULL;
 static grub_uint8_t last_cryptodisk_id = 0;
 
+/* Multiply the little-endian XTS tweak by x, a 64-bit half at a time.  */
 static void
 gf_mul_x (grub_uint8_t *g)
 {
-  int over = 0, over2 = 0;
-  unsigned j;
-
-  for (j = 0; j < GRUB_CRYPTODISK_GF_BYTES; j++)
-    {
-      over2 = !!(g[j] & 0x80);
-      g[j] <<= 1;
-      g[j] |= over;
-      over = over2;
-    }
-  if (over)
-    g[0] ^= GF_POLYNOM;
+  grub_uint64_t lo, hi, over;
+
+  lo = grub_le_to_cpu64 (grub_get_unaligned64 (g));
+  hi = grub_le_to_cpu64 (grub_get_unaligned64 (g + sizeof (lo)));
+  over = hi >> 63;
+  hi = (hi << 1) | (lo >> 63);
+  lo = (lo << 1) ^ (GF_POLYNOM & -over);
+  grub_set_unaligned64 (g, grub_cpu_to_le64 (lo));
+  grub_set_unaligned64 (g + sizeof (lo), grub_cpu_to_le64 (hi));
 }
 
 
@@ -331,29 +329,26 @@ grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
 	  break;
 	case GRUB_CRYPTODISK_MODE_XTS:
 	  {
-	    unsigned j;
-	    err = grub_crypto_ecb_encrypt (dev->secondary_cipher, iv, iv,
-					   dev->cipher->cipher->blocksize);
+	    grub_size_t bs = dev->cipher->cipher->blocksize;
+	    grub_uint8_t *ptr, *end = data + i + (1U << dev->log_sector_size);
+	    gcry_cipher_encrypt_t crypt = (do_encrypt
+					   ? dev->cipher->cipher->encrypt
+					   : dev->cipher->cipher->decrypt);
+
+	    if (!crypt || bs != GRUB_CRYPTODISK_GF_BYTES)
+	      return GPG_ERR_NOT_SUPPORTED;
+	    err = grub_crypto_ecb_encrypt (dev->secondary_cipher, iv, iv, bs);
 	    if (err)
 	      return err;
-	    
-	    for (j = 0; j < (1U << dev->log_sector_size);
-		 j += dev->cipher->cipher->blocksize)
+
+	    /* The whole sector is handled here: the cipher is called
+	       directly for each block instead of through the ECB wrapper,
+	       which would check its arguments again every 16 bytes.  */
+	    for (ptr = data + i; ptr < end; ptr += bs)
 	      {
-		grub_crypto_xor (data + i + j, data + i + j, iv,
-				 dev->cipher->cipher->blocksize);
-		if (do_encrypt)
-		  err = grub_crypto_ecb_encrypt (dev->cipher, data + i + j, 
-						 data + i + j,
-						 dev->cipher->cipher->blocksize);
-		else
-		  err = grub_crypto_ecb_decrypt (dev->cipher, data + i + j, 
-						 data + i + j,
-						 dev->cipher->cipher->blocksize);
-		if (err)
-		  return err;
-		grub_crypto_xor (data + i + j, data + i + j, iv,
-				 dev->cipher->cipher->blocksize);
+		grub_crypto_xor (ptr, ptr, iv, bs);
+		crypt (dev->cipher->ctx, ptr, ptr);
+		grub_crypto_xor (ptr, ptr, iv, bs);
 		gf_mul_x ((grub_uint8_t *) iv);
 	      }
 	  }
@@ -566,11 +561,196 @@ grub_cryptodisk_close (grub_disk_t disk)
   dev->source_disk = NULL;
 }
 
+/*
+ * Plaintext of recently read sectors, in aligned chunks keyed by device id
+ * and chunk number.  Small reads go through it: a miss decrypts a batch of
+ * chunks with one read of the source disk, and once the reads have been
+ * sequential for a while the batch grows up to CRYPTODISK_BATCH_CHUNKS, so
+ * a reader walking a file in small pieces is served from memory between
+ * large source reads.  The chunks of a batch share its buffer, which is
+ * freed with the last of them.  Requests of CRYPTODISK_DIRECT_CHUNKS or
+ * more are decrypted straight into the caller's buffer.
+ */
+#define CRYPTODISK_CHUNK_BITS 15
+#define CRYPTODISK_CACHE_CHUNKS 128
+#define CRYPTODISK_CACHE_BYTES (4 * 1024 * 1024)
+#define CRYPTODISK_BATCH_CHUNKS 32
+#define CRYPTODISK_DIRECT_CHUNKS 4
+
+struct cryptodisk_batch
+{
+  unsigned refs;
+  grub_size_t size;
+  char *data;
+};
+
+struct cryptodisk_chunk
+{
+  unsigned long dev_id;
+  grub_disk_addr_t chunk;
+  grub_uint64_t used;
+  grub_size_t size;
+  struct cryptodisk_batch *batch;
+  char *data;
+};
+
+static struct cryptodisk_chunk chunk_cache[CRYPTODISK_CACHE_CHUNKS];
+static grub_size_t chunk_cache_bytes;
+static grub_uint64_t chunk_cache_clock;
+static unsigned long chunk_cache_generation;
+
+/* Where the last read ended, how many reads in a row were sequential and
+   how many chunks to read beyond a miss.  */
+static unsigned long readahead_dev_id;
+static grub_disk_addr_t readahead_next;
+static unsigned readahead_run;
+static unsigned readahead_chunks;
+
+static void
+chunk_cache_release (struct cryptodisk_chunk *e)
+{
+  if (!e->batch)
+    return;
+  if (--e->batch->refs == 0)
+    {
+      chunk_cache_bytes -= e->batch->size;
+      grub_free (e->batch->data);
+      grub_free (e->batch);
+    }
+  e->batch = NULL;
+}
+
+static void
+chunk_cache_flush (void)
+{
+  unsigned i;
+
+  for (i = 0; i < CRYPTODISK_CACHE_CHUNKS; i++)
+    chunk_cache_release (&chunk_cache[i]);
+}
+
+static struct cryptodisk_chunk *
+chunk_cache_lookup (grub_cryptodisk_t dev, grub_disk_addr_t chunk)
+{
+  unsigned i;
+
+  for (i = 0; i < CRYPTODISK_CACHE_CHUNKS; i++)
+    if (chunk_cache[i].batch && chunk_cache[i].chunk == chunk
+	&& chunk_cache[i].dev_id == dev->id)
+      {
+	chunk_cache[i].used = ++chunk_cache_clock;
+	return &chunk_cache[i];
+      }
+  return NULL;
+}
+
+/* Decrypt up to COUNT chunks starting at CHUNK into the cache with a single
+   read of the source disk.  The batch stops early at the end of the device
+   and at the first chunk that is already cached.  */
+static grub_err_t
+chunk_cache_fill (grub_disk_t disk, grub_cryptodisk_t dev,
+		  grub_disk_addr_t chunk, unsigned count)
+{
+  unsigned shift = CRYPTODISK_CHUNK_BITS - disk->log_sector_size;
+  grub_disk_addr_t first = chunk << shift;
+  struct cryptodisk_batch *batch;
+  grub_size_t nsec, len, pos;
+  gcry_err_code_t gcry_err;
+  grub_err_t err;
+  unsigned i, k;
+
+  if (count > CRYPTODISK_BATCH_CHUNKS)
+    count = CRYPTODISK_BATCH_CHUNKS;
+  for (k = 1; k < count; k++)
+    if (((chunk + k) << shift) >= disk->total_sectors
+	|| chunk_cache_lookup (dev, chunk + k))
+      break;
+  count = k;
+
+  nsec = (grub_size_t) count << shift;
+  if (first + nsec > disk->total_sectors)
+    nsec = disk->total_sectors - first;
+  len = nsec << disk->log_sector_size;
+
+  /* The data gets its own allocation: the ciphers are slower on buffers
+     that are not aligned for them.  */
+  batch = grub_malloc (sizeof (*batch));
+  if (!batch)
+    return grub_errno;
+  batch->data = grub_malloc (len);
+  if (!batch->data)
+    {
+      grub_free (batch);
+      return grub_errno;
+    }
+  batch->size = len;
+  batch->refs = 0;
+
+  err = grub_disk_read (dev->source_disk,
+			(first << (disk->log_sector_size
+				   - GRUB_DISK_SECTOR_BITS)) + dev->offset, 0,
+			len, batch->data);
+  if (err)
+    {
+      grub_dprintf ("cryptodisk", "grub_disk_read failed with error %d\n", err);
+      grub_free (batch->data);
+      grub_free (batch);
+      return err;
+    }
+  gcry_err = grub_cryptodisk_endecrypt (dev, (grub_uint8_t *) batch->data,
+					len, first, 0);
+  if (gcry_err)
+    {
+      grub_free (batch->data);
+      grub_free (batch);
+      return grub_crypto_gcry_error (gcry_err);
+    }
+
+  /* Evict least recently used chunks until the batch fits.  */
+  while (1)
+    {
+      struct cryptodisk_chunk *lru = NULL;
+      unsigned nfree = 0;
+
+      for (i = 0; i < CRYPTODISK_CACHE_CHUNKS; i++)
+	if (!chunk_cache[i].batch)
+	  nfree++;
+	else if (!lru || chunk_cache[i].used < lru->used)
+	  lru = &chunk_cache[i];
+      if ((nfree >= count
+	   && chunk_cache_bytes + len <= CRYPTODISK_CACHE_BYTES) || !lru)
+	break;
+      chunk_cache_release (lru);
+    }
+
+  chunk_cache_bytes += len;
+  for (pos = 0, k = 0, i = 0; pos < len;
+       pos += 1 << CRYPTODISK_CHUNK_BITS, k++)
+    {
+      struct cryptodisk_chunk *e;
+
+      while (chunk_cache[i].batch)
+	i++;
+      e = &chunk_cache[i];
+      e->dev_id = dev->id;
+      e->chunk = chunk + k;
+      e->used = ++chunk_cache_clock;
+      e->data = batch->data + pos;
+      e->size = len - pos;
+      if (e->size > 1 << CRYPTODISK_CHUNK_BITS)
+	e->size = 1 << CRYPTODISK_CHUNK_BITS;
+      e->batch = batch;
+      batch->refs++;
+    }
+  return GRUB_ERR_NONE;
+}
+
 static grub_err_t
 grub_cryptodisk_read (grub_disk_t disk, grub_disk_addr_t sector,
 		      grub_size_t size, char *buf)
 {
   grub_cryptodisk_t dev = (grub_cryptodisk_t) disk->data;
+  unsigned shift = CRYPTODISK_CHUNK_BITS - disk->log_sector_size;
   grub_err_t err;
   gcry_err_code_t gcry_err;
 
@@ -595,6 +775,63 @@ grub_cryptodisk_read (grub_disk_t disk, grub_disk_addr_t sector,
 		PRIxGRUB_UINT64_T " with offset of %" PRIuGRUB_UINT64_T "\n",
 		size, sector, dev->offset);
 
+  if (chunk_cache_generation != grub_disk_generation)
+    {
+      chunk_cache_flush ();
+      chunk_cache_generation = grub_disk_generation;
+    }
+
+  if (readahead_dev_id != dev->id || readahead_next != sector)
+    readahead_run = readahead_chunks = 0;
+  else if (++readahead_run >= 2)
+    readahead_chunks = (readahead_chunks ? readahead_chunks * 2 : 2);
+  if (readahead_chunks > CRYPTODISK_BATCH_CHUNKS)
+    readahead_chunks = CRYPTODISK_BATCH_CHUNKS;
+  readahead_dev_id = dev->id;
+  readahead_next = sector + size;
+
+  while (size < ((grub_size_t) CRYPTODISK_DIRECT_CHUNKS << shift))
+    {
+      grub_disk_addr_t chunk = sector >> shift;
+      grub_size_t skip = sector - (chunk << shift), n;
+      struct cryptodisk_chunk *e;
+
+      if (size == 0)
+	return GRUB_ERR_NONE;
+
+      e = chunk_cache_lookup (dev, chunk);
+      if (!e)
+	{
+	  err = chunk_cache_fill (disk, dev, chunk,
+				  ((sector + size - 1) >> shift) - chunk + 1
+				  + readahead_chunks);
+	  /* The batch covers whole chunks and the read-ahead, which may
+	     reach sectors the request does not; read just the requested
+	     range directly so only an error in it is reported.  */
+	  if (err == GRUB_ERR_OUT_OF_MEMORY || err == GRUB_ERR_READ_ERROR
+	      || err == GRUB_ERR_OUT_OF_RANGE || err == GRUB_ERR_UNKNOWN_DEVICE)
+	    {
+	      grub_errno = GRUB_ERR_NONE;
+	      readahead_run = readahead_chunks = 0;
+	      break;
+	    }
+	  if (err)
+	    return err;
+	  e = chunk_cache_lookup (dev, chunk);
+	  if (!e)
+	    break;
+	}
+
+      n = (e->size >> disk->log_sector_size) - skip;
+      if (n > size)
+	n = size;
+      grub_memcpy (buf, e->data + (skip << disk->log_sector_size),
+		   n << disk->log_sector_size);
+      buf += n << disk->log_sector_size;
+      sector += n;
+      size -= n;
+    }
+
   err = grub_disk_read (dev->source_disk,
 			(sector << (disk->log_sector_size
 				   - GRUB_DISK_SECTOR_BITS)) + dev->offset, 0,
@@ -1150,5 +1387,6 @@ GRUB_MOD_FINI (cryptodisk)
 {
   grub_disk_dev_unregister (&grub_cryptodisk_dev);
   cryptodisk_cleanup ();
+  chunk_cache_flush ();
   grub_procfs_unregister (&luks_script);
 }
@@ -39,6 +39,25 @@ grub_diskfilter_t grub_diskfilter_list;
 static int inscnt = 0;
 static int lv_num = 0;
 
+/* Largest part of a read, in sectors, split into one request per member
+   of a striped or RAID 4/5/6 segment.  */
+#define GRUB_DISKFILTER_MAX_GROUPED_READ (8 << (20 - GRUB_DISK_SECTOR_BITS))
+
+/* The chunk of a degraded RAID 4/5/6 member that was reconstructed last.
+   Recovery has to read the same range from every other member, so it is
+   done a whole chunk at a time and later reads of the missing member
+   within that chunk are served from here.  The chunk is stale once
+   grub_disk_generation has moved on.  */
+static struct
+{
+  const struct grub_diskfilter_segment *seg;
+  grub_uint64_t disknr;
+  grub_disk_addr_t sector;
+  unsigned long generation;
+  char *buf;
+  grub_size_t alloc;
+} recovered;
+
 static struct grub_diskfilter_lv *
 find_lv (const char *name);
 static int is_lv_readable (struct grub_diskfilter_lv *lv, int easily);
@@ -486,6 +505,90 @@ grub_diskfilter_read_node (const struct grub_diskfilter_node *node,
 }
 
 
+static grub_err_t
+recover_node (struct grub_diskfilter_segment *seg, grub_uint64_t disknr,
+	      grub_uint64_t p, grub_disk_addr_t sector, grub_size_t size,
+	      char *buf)
+{
+  if (seg->type == GRUB_DISKFILTER_RAID6)
+    return ((grub_raid6_recover_func) ?
+	    (*grub_raid6_recover_func) (seg, disknr, p, buf, sector, size) :
+	    grub_error (GRUB_ERR_BAD_DEVICE,
+			N_("module `%s' isn't loaded"),
+			"raid6rec"));
+
+  return ((grub_raid5_recover_func) ?
+	  (*grub_raid5_recover_func) (seg, disknr, buf, sector, size) :
+	  grub_error (GRUB_ERR_BAD_DEVICE,
+		      N_("module `%s' isn't loaded"),
+		      "raid5rec"));
+}
+
+/* Whether the chunk of member DISKNR of SEG starting at CHUNK is the one
+   in RECOVERED.  A stale chunk is dropped.  */
+static int
+recovered_chunk_p (const struct grub_diskfilter_segment *seg,
+		   grub_uint64_t disknr, grub_disk_addr_t chunk)
+{
+  if (recovered.generation != grub_disk_generation)
+    recovered.seg = NULL;
+  return (recovered.seg == seg && recovered.disknr == disknr
+	  && recovered.sector == chunk);
+}
+
+/* Reconstruct SIZE sectors at offset B of the chunk of member DISKNR that
+   starts at CHUNK.  */
+static grub_err_t
+recover_chunk (struct grub_diskfilter_segment *seg, grub_uint64_t disknr,
+	       grub_uint64_t p, grub_disk_addr_t chunk, grub_uint64_t b,
+	       grub_size_t size, char *buf)
+{
+  grub_size_t chunk_bytes = (grub_size_t) seg->stripe_size
+    << GRUB_DISK_SECTOR_BITS;
+  grub_err_t err;
+
+  if (recovered_chunk_p (seg, disknr, chunk))
+    {
+      grub_memcpy (buf, recovered.buf + (b << GRUB_DISK_SECTOR_BITS),
+		   size << GRUB_DISK_SECTOR_BITS);
+      return GRUB_ERR_NONE;
+    }
+
+  recovered.seg = NULL;
+  if (recovered.alloc < chunk_bytes)
+    {
+      grub_free (recovered.buf);
+      recovered.alloc = 0;
+      recovered.buf = grub_malloc (chunk_bytes);
+      if (!recovered.buf)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  return recover_node (seg, disknr, p, chunk + b, size, buf);
+	}
+      recovered.alloc = chunk_bytes;
+    }
+
+  err = recover_node (seg, disknr, p, chunk, seg->stripe_size, recovered.buf);
+  if (err)
+    {
+      /* The chunk may run past the end of a member; fall back to the
+	 requested range alone.  */
+      if (err != GRUB_ERR_READ_ERROR && err != GRUB_ERR_OUT_OF_RANGE
+	  && err != GRUB_ERR_UNKNOWN_DEVICE)
+	return err;
+      grub_errno = GRUB_ERR_NONE;
+      return recover_node (seg, disknr, p, chunk + b, size, buf);
+    }
+
+  recovered.seg = seg;
+  recovered.disknr = disknr;
+  recovered.sector = chunk;
+  recovered.generation = grub_disk_generation;
+  grub_memcpy (buf, recovered.buf + (b << GRUB_DISK_SECTOR_BITS),
+	       size << GRUB_DISK_SECTOR_BITS);
+  return GRUB_ERR_NONE;
+}
+
 static grub_err_t
 validate_segment (struct grub_diskfilter_segment *seg);
 
@@ -575,6 +678,196 @@ validate_segment (struct grub_diskfilter_segment *seg)
 
 }
 
+/* Locate SECTOR of a RAID 4/5/6 segment.  Return the start of its chunk
+   on the member, and store its offset in the chunk in B, the member
+   holding it in DISKNR and the member holding the parity of its row
+   in P.  */
+static grub_disk_addr_t
+raid456_locate (const struct grub_diskfilter_segment *seg,
+		grub_disk_addr_t sector, grub_uint64_t *b,
+		grub_uint64_t *disknr, grub_uint64_t *p)
+{
+  grub_disk_addr_t read_sector;
+  grub_uint64_t n;
+
+  /* n = 1 for level 4 and 5, 2 for level 6.  */
+  n = seg->type / 3;
+
+  read_sector = grub_divmod64 (sector, seg->stripe_size, b);
+  read_sector = grub_divmod64 (read_sector, seg->node_count - n,
+			       disknr);
+  if (seg->type >= 5)
+    {
+      grub_divmod64 (read_sector, seg->node_count, p);
+
+      if (! (seg->layout & GRUB_RAID_LAYOUT_RIGHT_MASK))
+	*p = seg->node_count - 1 - *p;
+
+      if (seg->layout & GRUB_RAID_LAYOUT_SYMMETRIC_MASK)
+	{
+	  *disknr += *p + n;
+	}
+      else
+	{
+	  grub_uint32_t q;
+
+	  q = *p + (n - 1);
+	  if (q >= seg->node_count)
+	    q -= seg->node_count;
+
+	  if (*disknr >= *p)
+	    *disknr += n;
+	  else if (*disknr >= q)
+	    *disknr += q + 1;
+	}
+
+      if (*disknr >= seg->node_count)
+	*disknr -= seg->node_count;
+    }
+  else
+    *p = seg->node_count - n;
+
+  return read_sector * seg->stripe_size;
+}
+
+/* Locate SECTOR of a striped or RAID 4/5/6 segment: return its position
+   on member *DISKNR.  */
+static grub_disk_addr_t
+locate_data (const struct grub_diskfilter_segment *seg,
+	     grub_disk_addr_t sector, grub_uint64_t *disknr)
+{
+  grub_disk_addr_t row;
+  grub_uint64_t b, p;
+
+  if (seg->type != GRUB_DISKFILTER_STRIPED)
+    return raid456_locate (seg, sector, &b, disknr, &p) + b;
+
+  row = grub_divmod64 (sector, seg->stripe_size, &b);
+  row = grub_divmod64 (row, seg->node_count, disknr);
+  return row * seg->stripe_size + b;
+}
+
+/* Read SIZE sectors at SECTOR of a striped or RAID 4/5/6 segment with a
+   single request per member.  The chunks of consecutive rows lie back to
+   back on each member, so the span of every member is read into a bounce
+   buffer, parity chunks included, and its data chunks are copied out.  */
+static grub_err_t
+read_grouped_range (struct grub_diskfilter_segment *seg,
+		    grub_disk_addr_t sector, grub_size_t size, char *buf)
+{
+  grub_disk_addr_t *span, from, to, pos;
+  grub_size_t max = 0;
+  grub_uint64_t disknr, d;
+  char *tmp = NULL;
+  grub_err_t err = GRUB_ERR_NONE;
+
+  /* First and end sector of the range read on each member.  */
+  span = grub_malloc (2 * seg->node_count * sizeof (span[0]));
+  if (!span)
+    return grub_errno;
+  for (d = 0; d < seg->node_count; d++)
+    {
+      span[2 * d] = ~(grub_disk_addr_t) 0;
+      span[2 * d + 1] = 0;
+    }
+
+  for (from = sector; from < sector + size; from = to)
+    {
+      to = (grub_divmod64 (from, seg->stripe_size, NULL) + 1)
+	* seg->stripe_size;
+      if (to > sector + size)
+	to = sector + size;
+      pos = locate_data (seg, from, &disknr);
+      if (pos < span[2 * disknr])
+	span[2 * disknr] = pos;
+      if (pos + (to - from) > span[2 * disknr + 1])
+	span[2 * disknr + 1] = pos + (to - from);
+    }
+
+  for (d = 0; d < seg->node_count; d++)
+    if (span[2 * d + 1] > span[2 * d]
+	&& span[2 * d + 1] - span[2 * d] > max)
+      max = span[2 * d + 1] - span[2 * d];
+
+  tmp = grub_malloc (max << GRUB_DISK_SECTOR_BITS);
+  if (!tmp)
+    {
+      err = grub_errno;
+      goto out;
+    }
+
+  for (d = 0; d < seg->node_count; d++)
+    {
+      if (span[2 * d + 1] <= span[2 * d])
+	continue;
+
+      err = grub_diskfilter_read_node (&seg->nodes[d], span[2 * d],
+				       span[2 * d + 1] - span[2 * d], tmp);
+      if (err)
+	goto out;
+
+      for (from = sector; from < sector + size; from = to)
+	{
+	  to = (grub_divmod64 (from, seg->stripe_size, NULL) + 1)
+	    * seg->stripe_size;
+	  if (to > sector + size)
+	    to = sector + size;
+	  pos = locate_data (seg, from, &disknr);
+	  if (disknr != d)
+	    continue;
+	  grub_memcpy (buf + ((from - sector) << GRUB_DISK_SECTOR_BITS),
+		       tmp + ((pos - span[2 * d]) << GRUB_DISK_SECTOR_BITS),
+		       (to - from) << GRUB_DISK_SECTOR_BITS);
+	}
+    }
+
+ out:
+  grub_free (tmp);
+  grub_free (span);
+  return err;
+}
+
+/* Whether a read of SIZE sectors at SECTOR of a striped or RAID 4/5/6
+   segment crosses chunks and can be split into one request per member.
+   Degraded arrays are left to the chunk by chunk path.  */
+static int
+want_grouped_read (struct grub_diskfilter_segment *seg,
+		   grub_disk_addr_t sector, grub_size_t size)
+{
+  grub_uint64_t b;
+  unsigned i;
+
+  grub_divmod64 (sector, seg->stripe_size, &b);
+  if (b + size <= seg->stripe_size)
+    return 0;
+
+  for (i = 0; i < seg->node_count; i++)
+    if (!is_node_readable (&seg->nodes[i], 1))
+      return 0;
+  return 1;
+}
+
+static grub_err_t
+read_segment_grouped (struct grub_diskfilter_segment *seg,
+		      grub_disk_addr_t sector, grub_size_t size, char *buf)
+{
+  while (size)
+    {
+      grub_size_t len = size;
+      grub_err_t err;
+
+      if (len > GRUB_DISKFILTER_MAX_GROUPED_READ)
+	len = GRUB_DISKFILTER_MAX_GROUPED_READ;
+      err = read_grouped_range (seg, sector, len, buf);
+      if (err)
+	return err;
+      sector += len;
+      size -= len;
+      buf += len << GRUB_DISK_SECTOR_BITS;
+    }
+  return GRUB_ERR_NONE;
+}
+
 static grub_err_t
 read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
 	      grub_size_t size, char *buf)
@@ -586,6 +879,8 @@ read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
       if (seg->node_count == 1)
 	return grub_diskfilter_read_node (&seg->nodes[0],
 					  sector, size, buf);
+      if (want_grouped_read (seg, sector, size))
+	return read_segment_grouped (seg, sector, size, buf);
       /* Fallthrough.  */
     case GRUB_DISKFILTER_MIRROR:
     case GRUB_DISKFILTER_RAID10:
@@ -695,44 +990,20 @@ read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
 	grub_disk_addr_t read_sector;
 	grub_uint64_t b, p, n, disknr, e;
 
+	if (want_grouped_read (seg, sector, size))
+	  {
+	    err = read_segment_grouped (seg, sector, size, buf);
+	    if (err != GRUB_ERR_READ_ERROR && err != GRUB_ERR_UNKNOWN_DEVICE)
+	      return err;
+	    /* Let the chunk by chunk path rebuild what failed.  */
+	    grub_errno = GRUB_ERR_NONE;
+	  }
+
 	/* n = 1 for level 4 and 5, 2 for level 6.  */
 	n = seg->type / 3;
 
 	/* Find the first sector to read. */
-	read_sector = grub_divmod64 (sector, seg->stripe_size, &b);
-	read_sector = grub_divmod64 (read_sector, seg->node_count - n,
-				     &disknr);
-	if (seg->type >= 5)
-	  {
-	    grub_divmod64 (read_sector, seg->node_count, &p);
-
-	    if (! (seg->layout & GRUB_RAID_LAYOUT_RIGHT_MASK))
-	      p = seg->node_count - 1 - p;
-
-	    if (seg->layout & GRUB_RAID_LAYOUT_SYMMETRIC_MASK)
-	      {
-		disknr += p + n;
-	      }
-	    else
-	      {
-		grub_uint32_t q;
-
-		q = p + (n - 1);
-		if (q >= seg->node_count)
-		  q -= seg->node_count;
-
-		if (disknr >= p)
-		  disknr += n;
-		else if (disknr >= q)
-		  disknr += q + 1;
-	      }
-
-	    if (disknr >= seg->node_count)
-	      disknr -= seg->node_count;
-	  }
-	else
-	  p = seg->node_count - n;
-	read_sector *= seg->stripe_size;
+	read_sector = raid456_locate (seg, sector, &b, &disknr, &p);
 
 	while (1)
 	  {
@@ -749,10 +1020,14 @@ read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
 		|| grub_errno == GRUB_ERR_UNKNOWN_DEVICE)
 	      grub_errno = GRUB_ERR_NONE;
 
-	    err = grub_diskfilter_read_node (&seg->nodes[disknr],
-					     read_sector + b,
-					     read_size,
-					     buf);
+	    /* A member already found missing in this chunk is not retried.  */
+	    if (recovered_chunk_p (seg, disknr, read_sector))
+	      err = GRUB_ERR_UNKNOWN_DEVICE;
+	    else
+	      err = grub_diskfilter_read_node (&seg->nodes[disknr],
+					       read_sector + b,
+					       read_size,
+					       buf);
 
 	    if ((err) && (err != GRUB_ERR_READ_ERROR
 			  && err != GRUB_ERR_UNKNOWN_DEVICE))
@@ -762,27 +1037,8 @@ read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
 	    if (err)
 	      {
 		grub_errno = GRUB_ERR_NONE;
-		if (seg->type == GRUB_DISKFILTER_RAID6)
-		  {
-		    err = ((grub_raid6_recover_func) ?
-			   (*grub_raid6_recover_func) (seg, disknr, p,
-						       buf, read_sector + b,
-						       read_size) :
-			   grub_error (GRUB_ERR_BAD_DEVICE,
-				       N_("module `%s' isn't loaded"),
-				       "raid6rec"));
-		  }
-		else
-		  {
-		    err = ((grub_raid5_recover_func) ?
-			   (*grub_raid5_recover_func) (seg, disknr,
-						       buf, read_sector + b,
-						       read_size) :
-			   grub_error (GRUB_ERR_BAD_DEVICE,
-				       N_("module `%s' isn't loaded"),
-				       "raid5rec"));
-		  }
-
+		err = recover_chunk (seg, disknr, p, read_sector, b,
+				     read_size, buf);
 		if (err)
 		  return err;
 	      }
@@ -1249,6 +1505,9 @@ insert_array (grub_disk_t disk, const struct grub_diskfilter_pv_id *id,
 static void
 free_array (void)
 {
+  grub_free (recovered.buf);
+  grub_memset (&recovered, 0, sizeof (recovered));
+
   while (array_list)
     {
       struct grub_diskfilter_vg *vg;
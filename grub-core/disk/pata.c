@@ -29,12 +29,57 @@
 #define GRUB_MACHINE_PCI_IO_BASE  0xb4000000
 #endif
 #include <grub/time.h>
+#include <grub/env.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
 /* At the moment, only two IDE ports are supported.  */
 static const grub_port_t grub_pata_ioaddress[] = { GRUB_ATA_CH0_PORT1,
 						   GRUB_ATA_CH1_PORT1 };
+static const grub_port_t grub_pata_ioaddress2[] = { GRUB_ATA_CH0_PORT2,
+						    GRUB_ATA_CH1_PORT2 };
+
+/* Device control register bits.  */
+enum
+  {
+    GRUB_PATA_CONTROL_SRST = 0x04
+  };
+
+/* PCI IDE bus master registers, relative to the base of a channel.  */
+enum
+  {
+    GRUB_PATA_BM_REG_COMMAND = 0,
+    GRUB_PATA_BM_REG_STATUS = 2,
+    GRUB_PATA_BM_REG_PRDT = 4
+  };
+
+enum
+  {
+    GRUB_PATA_BM_COMMAND_START = 0x01,
+    GRUB_PATA_BM_COMMAND_READ = 0x08
+  };
+
+enum
+  {
+    GRUB_PATA_BM_STATUS_ACTIVE = 0x01,
+    GRUB_PATA_BM_STATUS_ERROR = 0x02,
+    GRUB_PATA_BM_STATUS_INTERRUPT = 0x04
+  };
+
+/* A PRD entry covers at most 64 KiB and must not cross a 64 KiB
+   boundary.  */
+#define GRUB_PATA_PRD_MAX_LENGTH 0x10000
+#define GRUB_PATA_PRD_EOT 0x80000000
+#define GRUB_PATA_PRD_ENTRIES 64
+/* Leaves one entry for a bounce buffer not aligned to 64 KiB.  */
+#define GRUB_PATA_DMA_MAX_TRANSFER ((GRUB_PATA_PRD_ENTRIES - 1) \
+				    * GRUB_PATA_PRD_MAX_LENGTH)
+
+struct grub_pata_prd
+{
+  grub_uint32_t addr;
+  grub_uint32_t size;
+} GRUB_PACKED;
 
 struct grub_pata_device
 {
@@ -44,6 +89,7 @@ struct grub_pata_device
   /* IO addresses on which the registers for this device can be
      found.  */
   grub_port_t ioaddress;
+  grub_port_t ioaddress2;
 
   /* Two devices can be connected to a single cable.  Use this field
      to select device 0 (commonly known as "master") or device 1
@@ -52,6 +98,15 @@ struct grub_pata_device
 
   int present;
 
+  /* Bus master registers of the channel, 0 if it can't do DMA.  */
+  grub_port_t bmaddr;
+
+  /* Cleared when the bus master failed or a DMA command timed out,
+     further commands use PIO.  */
+  int dma;
+
+  struct grub_pci_dma_chunk *prdt_chunk;
+
   struct grub_pata_device *next;
 };
 
@@ -146,6 +201,194 @@ grub_pata_pio_write (struct grub_pata_device *dev, char *buf, grub_size_t size)
     grub_outw(grub_cpu_to_ata16 (grub_get_unaligned16 (buf + 2 * i)), dev->ioaddress + GRUB_ATA_REG_DATA);
 }
 
+static void
+grub_pata_settaskfile (struct grub_pata_device *dev,
+		       struct grub_disk_ata_pass_through_parms *parms)
+{
+  int i;
+
+  for (i = GRUB_ATA_REG_SECTORS; i <= GRUB_ATA_REG_LBAHIGH; i++)
+    grub_pata_regset (dev, i,
+		     parms->taskfile.raw[7 + (i - GRUB_ATA_REG_SECTORS)]);
+  for (i = GRUB_ATA_REG_FEATURES; i <= GRUB_ATA_REG_LBAHIGH; i++)
+    grub_pata_regset (dev, i, parms->taskfile.raw[i - GRUB_ATA_REG_FEATURES]);
+}
+
+static void
+grub_pata_gettaskfile (struct grub_pata_device *dev,
+		       struct grub_disk_ata_pass_through_parms *parms)
+{
+  int i;
+
+  for (i = GRUB_ATA_REG_ERROR; i <= GRUB_ATA_REG_STATUS; i++)
+    parms->taskfile.raw[i - GRUB_ATA_REG_FEATURES] = grub_pata_regget (dev, i);
+}
+
+/* PIO command doing the same transfer as a DMA one.  */
+static grub_uint8_t
+grub_pata_pio_cmd (grub_uint8_t cmd)
+{
+  switch (cmd)
+    {
+    case GRUB_ATA_CMD_READ_SECTORS_DMA:
+      return GRUB_ATA_CMD_READ_SECTORS;
+    case GRUB_ATA_CMD_READ_SECTORS_DMA_EXT:
+      return GRUB_ATA_CMD_READ_SECTORS_EXT;
+    case GRUB_ATA_CMD_WRITE_SECTORS_DMA:
+      return GRUB_ATA_CMD_WRITE_SECTORS;
+    case GRUB_ATA_CMD_WRITE_SECTORS_DMA_EXT:
+      return GRUB_ATA_CMD_WRITE_SECTORS_EXT;
+    }
+  return cmd;
+}
+
+#ifndef GRUB_MACHINE_MIPS_QEMU_MIPS
+/* Abort whatever command the devices on the channel of DEV are stuck in
+   with a software reset.  */
+static grub_err_t
+grub_pata_reset (struct grub_pata_device *dev)
+{
+  grub_outb (GRUB_PATA_CONTROL_SRST, dev->ioaddress2 + GRUB_ATA_REG2_CONTROL);
+  /* SRST must be held for at least 5us.  */
+  grub_millisleep (1);
+  grub_outb (0, dev->ioaddress2 + GRUB_ATA_REG2_CONTROL);
+  /* And BSY only becomes valid 2ms after it is released.  */
+  grub_millisleep (2);
+  return grub_pata_wait_not_busy (dev, GRUB_ATA_TOUT_SPINUP);
+}
+
+static grub_err_t
+grub_pata_dma_readwrite (struct grub_pata_device *dev,
+			 struct grub_disk_ata_pass_through_parms *parms,
+			 int spinup)
+{
+  volatile struct grub_pata_prd *prdt;
+  struct grub_pci_dma_chunk *bufc;
+  grub_uint32_t phys, end;
+  grub_uint64_t endtime;
+  grub_uint8_t bmcmd, bmsts;
+  grub_err_t err = GRUB_ERR_NONE;
+  unsigned n = 0;
+
+  if (!dev->prdt_chunk)
+    {
+      /* Aligning the table to its size keeps it within 64 KiB.  */
+      dev->prdt_chunk = grub_memalign_dma32 (sizeof (struct grub_pata_prd)
+					     * GRUB_PATA_PRD_ENTRIES,
+					     sizeof (struct grub_pata_prd)
+					     * GRUB_PATA_PRD_ENTRIES);
+      if (!dev->prdt_chunk)
+	return grub_errno;
+    }
+  prdt = grub_dma_get_virt (dev->prdt_chunk);
+
+  bufc = grub_memalign_dma32 (1024, parms->size);
+  if (!bufc)
+    return grub_errno;
+
+  /* Split the buffer at 64 KiB boundaries.  */
+  for (phys = grub_dma_get_phys (bufc), end = phys + parms->size;
+       phys < end; phys = ALIGN_UP (phys + 1, GRUB_PATA_PRD_MAX_LENGTH))
+    {
+      grub_uint32_t len = ALIGN_UP (phys + 1, GRUB_PATA_PRD_MAX_LENGTH) - phys;
+
+      if (len > end - phys)
+	len = end - phys;
+      prdt[n].addr = grub_cpu_to_le32 (phys);
+      /* A size of 0 stands for 64 KiB.  */
+      prdt[n].size = grub_cpu_to_le32 (len & 0xffff);
+      n++;
+    }
+  prdt[n - 1].size |= grub_cpu_to_le32_compile_time (GRUB_PATA_PRD_EOT);
+
+  if (parms->write)
+    grub_memcpy ((char *) grub_dma_get_virt (bufc), parms->buffer,
+		 parms->size);
+
+  grub_pata_regset (dev, GRUB_ATA_REG_DISK, (dev->device << 4)
+		    | (parms->taskfile.disk & 0xef));
+  if (grub_pata_check_ready (dev, spinup))
+    {
+      err = grub_errno;
+      goto out;
+    }
+
+  bmcmd = parms->write ? 0 : GRUB_PATA_BM_COMMAND_READ;
+  grub_outb (bmcmd, dev->bmaddr + GRUB_PATA_BM_REG_COMMAND);
+  grub_outl (grub_dma_get_phys (dev->prdt_chunk),
+	     dev->bmaddr + GRUB_PATA_BM_REG_PRDT);
+  grub_outb (grub_inb (dev->bmaddr + GRUB_PATA_BM_REG_STATUS)
+	     | GRUB_PATA_BM_STATUS_ERROR | GRUB_PATA_BM_STATUS_INTERRUPT,
+	     dev->bmaddr + GRUB_PATA_BM_REG_STATUS);
+
+  grub_pata_settaskfile (dev, parms);
+  grub_pata_regset (dev, GRUB_ATA_REG_CMD, parms->taskfile.cmd);
+  grub_outb (bmcmd | GRUB_PATA_BM_COMMAND_START,
+	     dev->bmaddr + GRUB_PATA_BM_REG_COMMAND);
+
+  /* The engine stays active until the PRDs are exhausted, the drive
+     raises its interrupt when the command is done.  */
+  endtime = grub_get_time_ms () + GRUB_ATA_TOUT_DATA;
+  while (1)
+    {
+      bmsts = grub_inb (dev->bmaddr + GRUB_PATA_BM_REG_STATUS);
+      if ((bmsts & (GRUB_PATA_BM_STATUS_ERROR | GRUB_PATA_BM_STATUS_INTERRUPT))
+	  || !(bmsts & GRUB_PATA_BM_STATUS_ACTIVE))
+	break;
+      if (grub_get_time_ms () > endtime)
+	{
+	  err = grub_error (GRUB_ERR_TIMEOUT, "PATA DMA timeout");
+	  break;
+	}
+    }
+
+  grub_outb (bmcmd, dev->bmaddr + GRUB_PATA_BM_REG_COMMAND);
+  grub_outb (bmsts | GRUB_PATA_BM_STATUS_ERROR | GRUB_PATA_BM_STATUS_INTERRUPT,
+	     dev->bmaddr + GRUB_PATA_BM_REG_STATUS);
+  grub_dprintf ("pata", "DMA status=0x%x, %u PRDs\n", bmsts, n);
+  if (err)
+    goto fail;
+
+  if (grub_pata_wait_not_busy (dev, GRUB_ATA_TOUT_DATA))
+    {
+      err = grub_errno;
+      goto fail;
+    }
+
+  grub_pata_gettaskfile (dev, parms);
+  /* A drive still asking for data didn't get it from the bus master.  */
+  if ((bmsts & GRUB_PATA_BM_STATUS_ERROR)
+      || (parms->taskfile.status & GRUB_ATA_STATUS_DRQ))
+    {
+      err = grub_error (parms->write ? GRUB_ERR_WRITE_ERROR
+			: GRUB_ERR_READ_ERROR, "PATA bus master error");
+      goto fail;
+    }
+  if (parms->taskfile.status & GRUB_ATA_STATUS_ERR)
+    {
+      err = grub_error (parms->write ? GRUB_ERR_WRITE_ERROR
+			: GRUB_ERR_READ_ERROR, "PATA DMA transfer failed");
+      goto out;
+    }
+
+  if (!parms->write)
+    grub_memcpy (parms->buffer, (char *) grub_dma_get_virt (bufc),
+		 parms->size);
+
+ out:
+  grub_dma_free (bufc);
+  return err;
+
+ fail:
+  /* Some controllers get DMA wrong.  Use PIO from now on, after getting
+     the drive out of the DMA command it may still be in.  */
+  dev->dma = 0;
+  grub_pata_reset (dev);
+  grub_errno = err;
+  goto out;
+}
+#endif
+
 /* ATA pass through support, used by hdparm.mod.  */
 static grub_err_t
 grub_pata_readwrite (struct grub_ata *disk,
@@ -154,7 +397,24 @@ grub_pata_readwrite (struct grub_ata *disk,
 {
   struct grub_pata_device *dev = (struct grub_pata_device *) disk->data;
   grub_size_t nread = 0;
-  int i;
+
+#ifndef GRUB_MACHINE_MIPS_QEMU_MIPS
+  if (parms->dma && dev->dma && !parms->cmdsize && parms->size)
+    {
+      if (grub_pata_dma_readwrite (dev, parms, spinup) == GRUB_ERR_NONE)
+	return GRUB_ERR_NONE;
+
+      /* Retry with PIO, which also reports errors of the drive itself
+	 the usual way.  */
+      grub_dprintf ("pata", "DMA failed on ata%d (%s), retrying with PIO\n",
+		    dev->port * 2 + dev->device,
+		    dev->dma ? "drive error" : "DMA disabled");
+      grub_errno = GRUB_ERR_NONE;
+    }
+#endif
+
+  if (parms->dma)
+    parms->taskfile.cmd = grub_pata_pio_cmd (parms->taskfile.cmd);
 
   if (! (parms->cmdsize == 0 || parms->cmdsize == 12))
     return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
@@ -176,11 +436,7 @@ grub_pata_readwrite (struct grub_ata *disk,
   if (grub_pata_check_ready (dev, spinup))
     return grub_errno;
 
-  for (i = GRUB_ATA_REG_SECTORS; i <= GRUB_ATA_REG_LBAHIGH; i++)
-    grub_pata_regset (dev, i,
-		     parms->taskfile.raw[7 + (i - GRUB_ATA_REG_SECTORS)]);
-  for (i = GRUB_ATA_REG_FEATURES; i <= GRUB_ATA_REG_LBAHIGH; i++)
-    grub_pata_regset (dev, i, parms->taskfile.raw[i - GRUB_ATA_REG_FEATURES]);
+  grub_pata_settaskfile (dev, parms);
 
   /* Start command. */
   grub_pata_regset (dev, GRUB_ATA_REG_CMD, parms->taskfile.cmd);
@@ -265,8 +521,7 @@ grub_pata_readwrite (struct grub_ata *disk,
     return grub_errno;
 
   /* Return registers.  */
-  for (i = GRUB_ATA_REG_ERROR; i <= GRUB_ATA_REG_STATUS; i++)
-    parms->taskfile.raw[i - GRUB_ATA_REG_FEATURES] = grub_pata_regget (dev, i);
+  grub_pata_gettaskfile (dev, parms);
 
   grub_dprintf ("pata", "status=0x%x, error=0x%x, sectors=0x%x\n",
 	        parms->taskfile.status,
@@ -306,7 +561,8 @@ check_device (struct grub_pata_device *dev)
 }
 
 static grub_err_t
-grub_pata_device_initialize (int port, int device, int addr)
+grub_pata_device_initialize (int port, int device, int addr, int bmaddr,
+			     int addr2)
 {
   struct grub_pata_device *dev;
   struct grub_pata_device **devp;
@@ -323,7 +579,11 @@ grub_pata_device_initialize (int port, int device, int addr)
   dev->port = port;
   dev->device = device;
   dev->ioaddress = addr + GRUB_MACHINE_PCI_IO_BASE;
+  dev->ioaddress2 = addr2 + GRUB_MACHINE_PCI_IO_BASE;
   dev->present = 1;
+  dev->bmaddr = bmaddr ? bmaddr + GRUB_MACHINE_PCI_IO_BASE : 0;
+  dev->dma = !!bmaddr;
+  dev->prdt_chunk = NULL;
   dev->next = NULL;
 
   /* Register the device.  */
@@ -348,7 +608,8 @@ grub_pata_pciinit (grub_pci_device_t dev,
   grub_uint32_t class;
   grub_uint32_t bar1;
   grub_uint32_t bar2;
-  int rega;
+  grub_uint32_t bar4 = 0;
+  int rega, regb, regc;
   int i;
   static int controller = 0;
   int cs5536 = 0;
@@ -369,6 +630,26 @@ grub_pata_pciinit (grub_pci_device_t dev,
   if (!cs5536 && (class >> 16 != 0x0101))
     return 0;
 
+  /* Bus master registers, for controllers which advertise them.  DMA
+     through the Bonito bridge of loongson machines is left alone, QEMU
+     doesn't emulate it correctly.  */
+#ifndef GRUB_MACHINE_MIPS_LOONGSON
+  if (!cs5536 && (class & 0x8000))
+    {
+      addr = grub_pci_make_address (dev, GRUB_PCI_REG_ADDRESS_REG4);
+      bar4 = grub_pci_read (addr);
+      if ((bar4 & 1) && (bar4 & ~3))
+	{
+	  addr = grub_pci_make_address (dev, GRUB_PCI_REG_COMMAND);
+	  grub_pci_write_word (addr, grub_pci_read_word (addr)
+			       | GRUB_PCI_COMMAND_IO_ENABLED
+			       | GRUB_PCI_COMMAND_BUS_MASTER);
+	}
+      else
+	bar4 = 0;
+    }
+#endif
+
   for (i = 0; i < nports; i++)
     {
       /* Set to 0 when the channel operated in compatibility mode.  */
@@ -381,12 +662,15 @@ grub_pata_pciinit (grub_pci_device_t dev,
 	compat = (class >> (8 + 2 * i)) & 1;
 
       rega = 0;
+      regb = bar4 ? (bar4 & ~3) + 8 * i : 0;
+      regc = 0;
 
       /* If the channel is in compatibility mode, just assign the
 	 default registers.  */
       if (compat == 0 && !compat_use[i])
 	{
 	  rega = grub_pata_ioaddress[i];
+	  regc = grub_pata_ioaddress2[i];
 	  compat_use[i] = 1;
 	}
       else if (compat)
@@ -405,6 +689,8 @@ grub_pata_pciinit (grub_pci_device_t dev,
 	  if ((bar1 & 1) && (bar2 & 1) && (bar1 & ~3))
 	    {
 	      rega = bar1 & ~3;
+	      /* The control register is the third byte of its block.  */
+	      regc = (bar2 & ~3) + 2;
 	      addr = grub_pci_make_address (dev, GRUB_PCI_REG_COMMAND);
 	      grub_pci_write_word (addr, grub_pci_read_word (addr)
 				   | GRUB_PCI_COMMAND_IO_ENABLED
@@ -415,14 +701,16 @@ grub_pata_pciinit (grub_pci_device_t dev,
 	}
 
       grub_dprintf ("pata",
-		    "PCI dev (%d,%d,%d) compat=%d rega=0x%x\n",
+		    "PCI dev (%d,%d,%d) compat=%d rega=0x%x regb=0x%x"
+		    " regc=0x%x\n",
 		    grub_pci_get_bus (dev), grub_pci_get_device (dev),
-		    grub_pci_get_function (dev), compat, rega);
+		    grub_pci_get_function (dev), compat, rega, regb, regc);
 
       if (rega)
 	{
 	  grub_errno = GRUB_ERR_NONE;
-	  grub_pata_device_initialize (controller * 2 + i, 0, rega);
+	  grub_pata_device_initialize (controller * 2 + i, 0, rega, regb,
+				       regc);
 
 	  /* Most errors raised by grub_ata_device_initialize() are harmless.
 	     They just indicate this particular drive is not responding, most
@@ -434,7 +722,8 @@ grub_pata_pciinit (grub_pci_device_t dev,
 	      grub_errno = GRUB_ERR_NONE;
 	    }
 
-	  grub_pata_device_initialize (controller * 2 + i, 1, rega);
+	  grub_pata_device_initialize (controller * 2 + i, 1, rega, regb,
+				       regc);
 
 	  /* Likewise.  */
 	  if (grub_errno)
@@ -463,8 +752,10 @@ grub_pata_initialize (void)
   int i;
   for (i = 0; i < 2; i++)
     {
-      grub_pata_device_initialize (i, 0, grub_pata_ioaddress[i]);
-      grub_pata_device_initialize (i, 1, grub_pata_ioaddress[i]);
+      grub_pata_device_initialize (i, 0, grub_pata_ioaddress[i], 0,
+				   grub_pata_ioaddress2[i]);
+      grub_pata_device_initialize (i, 1, grub_pata_ioaddress[i], 0,
+				   grub_pata_ioaddress2[i]);
     }
   return 0;
 }
@@ -475,6 +766,7 @@ grub_pata_open (int id, int devnum, struct grub_ata *ata)
 {
   struct grub_pata_device *dev;
   struct grub_pata_device *devfnd = 0;
+  const char *val;
   grub_err_t err;
 
   if (id != GRUB_SCSI_SUBSYSTEM_PATA)
@@ -498,9 +790,12 @@ grub_pata_open (int id, int devnum, struct grub_ata *ata)
   if (err)
     return err;
 
+  /* Setting pata_dma to 0 forces PIO, e.g. to compare the two.  */
+  val = grub_env_get ("pata_dma");
+
   ata->data = devfnd;
-  ata->dma = 0;
-  ata->maxbuffer = 256 * 512;
+  ata->dma = devfnd->dma && !(val && grub_strcmp (val, "0") == 0);
+  ata->maxbuffer = ata->dma ? GRUB_PATA_DMA_MAX_TRANSFER : 256 * 512;
   ata->present = &devfnd->present;
 
   return GRUB_ERR_NONE;
@@ -33,16 +33,25 @@ static grub_uint8_t powx[255 * 2];
 static unsigned powx_inv[256];
 static const grub_uint8_t poly = 0x1d;
 
+/* Multiply each byte of V by x.  */
+static inline grub_uint64_t
+grub_raid_word_mulx (grub_uint64_t v)
+{
+  grub_uint64_t carry;
+
+  carry = (v >> 7) & 0x0101010101010101ULL;
+  return ((v & 0x7f7f7f7f7f7f7f7fULL) << 1) ^ (carry * poly);
+}
+
+/* Fill TABLE so that TABLE[y] = x**MUL * y.  */
 static void
-grub_raid_block_mulx (unsigned mul, char *buf, grub_size_t size)
+grub_raid_mul_table (unsigned mul, grub_uint8_t *table)
 {
-  grub_size_t i;
-  grub_uint8_t *p;
+  unsigned y;
 
-  p = (grub_uint8_t *) buf;
-  for (i = 0; i < size; i++, p++)
-    if (*p)
-      *p = powx[mul + powx_inv[*p]];
+  table[0] = 0;
+  for (y = 1; y < 256; y++)
+    table[y] = powx[mul + powx_inv[y]];
 }
 
 static void
@@ -77,11 +86,15 @@ static grub_err_t
 grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
                     char *buf, grub_disk_addr_t sector, grub_size_t size)
 {
-  int i, q, pos;
-  int bad1 = -1, bad2 = -1;
-  char *pbuf = 0, *qbuf = 0;
+  int c, q, pos, cmax, have_p, use_q, started;
+  int bad1, bad2;
+  grub_uint64_t *pbuf = 0, *qbuf = 0, *dbuf = 0;
+  grub_uint8_t *pb, *qb;
+  grub_uint8_t tp[256], tq[256];
+  grub_size_t j, nwords;
 
   size <<= GRUB_DISK_SECTOR_BITS;
+  nwords = size / sizeof (grub_uint64_t);
   pbuf = grub_zalloc (size);
   if (!pbuf)
     goto quit;
@@ -90,102 +103,152 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
   if (!qbuf)
     goto quit;
 
+  dbuf = grub_malloc (size);
+  if (!dbuf)
+    goto quit;
+
   q = p + 1;
   if (q == (int) array->node_count)
     q = 0;
 
-  pos = q + 1;
-  if (pos == (int) array->node_count)
-    pos = 0;
+  if (array->layout & GRUB_RAID_LAYOUT_MUL_FROM_POS)
+    cmax = array->node_count - 1;
+  else
+    cmax = array->node_count - 3;
+
+  /* While P and the other data blocks are readable their XOR is all that
+     is needed, so the Q syndrome is only computed once that fails.  */
+  have_p = ! grub_diskfilter_read_node (&array->nodes[p], sector,
+					size >> GRUB_DISK_SECTOR_BITS, buf);
+  if (! have_p)
+    grub_errno = GRUB_ERR_NONE;
+  use_q = ! have_p;
+
+ again:
+  bad1 = -1;
+  bad2 = -1;
+  started = 0;
 
-  for (i = 0; i < (int) array->node_count - 2; i++)
+  /* Sum the surviving data blocks into PBUF and their Q syndrome terms
+     x**c * D_c into QBUF.  Walking c downwards evaluates the syndrome by
+     Horner's rule, so each block only costs a multiplication by x applied
+     a word at a time.  */
+  for (c = cmax; c >= 0; c--)
     {
-      int c;
+      int have = 0;
+
       if (array->layout & GRUB_RAID_LAYOUT_MUL_FROM_POS)
-	c = pos;
+	pos = c;
       else
-	c = i;
+	{
+	  pos = q + 1 + c;
+	  if (pos >= (int) array->node_count)
+	    pos -= array->node_count;
+	}
+
       if (pos == disknr)
         bad1 = c;
-      else
-        {
-          if (! grub_diskfilter_read_node (&array->nodes[pos], sector,
-					   size >> GRUB_DISK_SECTOR_BITS, buf))
-            {
-              grub_crypto_xor (pbuf, pbuf, buf, size);
-              grub_raid_block_mulx (c, buf, size);
-              grub_crypto_xor (qbuf, qbuf, buf, size);
-            }
-          else
-            {
-              /* Too many bad devices */
-              if (bad2 >= 0)
-                goto quit;
-
-              bad2 = c;
-              grub_errno = GRUB_ERR_NONE;
-            }
-        }
-
-      pos++;
-      if (pos == (int) array->node_count)
-        pos = 0;
+      else if (pos != p && pos != q)
+	{
+	  if (! grub_diskfilter_read_node (&array->nodes[pos], sector,
+					   size >> GRUB_DISK_SECTOR_BITS,
+					   (char *) dbuf))
+	    have = 1;
+	  else
+	    {
+	      /* Too many bad devices */
+	      if (bad2 >= 0 || ! have_p)
+		goto quit;
+
+	      grub_errno = GRUB_ERR_NONE;
+	      if (! use_q)
+		{
+		  use_q = 1;
+		  goto again;
+		}
+	      bad2 = c;
+	    }
+	}
+
+      if (have && ! started)
+	{
+	  grub_memcpy (pbuf, dbuf, size);
+	  if (use_q)
+	    grub_memcpy (qbuf, dbuf, size);
+	  started = 1;
+	}
+      else if (have && use_q)
+	for (j = 0; j < nwords; j++)
+	  {
+	    pbuf[j] ^= dbuf[j];
+	    qbuf[j] = grub_raid_word_mulx (qbuf[j]) ^ dbuf[j];
+	  }
+      else if (have)
+	for (j = 0; j < nwords; j++)
+	  pbuf[j] ^= dbuf[j];
+      else if (started && use_q)
+	for (j = 0; j < nwords; j++)
+	  qbuf[j] = grub_raid_word_mulx (qbuf[j]);
     }
 
   /* Invalid disknr or p */
   if (bad1 < 0)
     goto quit;
 
-  if (bad2 < 0)
+  if (! started)
+    grub_memset (pbuf, 0, size);
+
+  pb = (grub_uint8_t *) pbuf;
+  qb = (grub_uint8_t *) qbuf;
+
+  if (bad2 < 0 && have_p)
     {
       /* One bad device */
-      if ((! grub_diskfilter_read_node (&array->nodes[p], sector,
-					size >> GRUB_DISK_SECTOR_BITS, buf)))
-        {
-          grub_crypto_xor (buf, buf, pbuf, size);
-          goto quit;
-        }
-
-      grub_errno = GRUB_ERR_NONE;
+      grub_crypto_xor (buf, buf, pbuf, size);
+    }
+  else if (bad2 < 0)
+    {
+      /* One bad device and P */
       if (grub_diskfilter_read_node (&array->nodes[q], sector,
-				     size >> GRUB_DISK_SECTOR_BITS, buf))
+				     size >> GRUB_DISK_SECTOR_BITS,
+				     (char *) dbuf))
         goto quit;
 
-      grub_crypto_xor (buf, buf, qbuf, size);
-      grub_raid_block_mulx (255 - bad1, buf,
-                           size);
+      grub_raid_mul_table (255 - bad1, tq);
+      for (j = 0; j < nwords; j++)
+	qbuf[j] ^= dbuf[j];
+      for (j = 0; j < size; j++)
+	buf[j] = tq[qb[j]];
     }
   else
     {
       /* Two bad devices */
-      unsigned c;
-
-      if (grub_diskfilter_read_node (&array->nodes[p], sector,
-				     size >> GRUB_DISK_SECTOR_BITS, buf))
-        goto quit;
+      unsigned cq, cp;
 
       grub_crypto_xor (pbuf, pbuf, buf, size);
 
       if (grub_diskfilter_read_node (&array->nodes[q], sector,
-				     size >> GRUB_DISK_SECTOR_BITS, buf))
+				     size >> GRUB_DISK_SECTOR_BITS,
+				     (char *) dbuf))
         goto quit;
 
-      grub_crypto_xor (qbuf, qbuf, buf, size);
-
-      c = mod_255((255 ^ bad1)
-		  + (255 ^ powx_inv[(powx[bad2 + (bad1 ^ 255)] ^ 1)]));
-      grub_raid_block_mulx (c, qbuf, size);
+      for (j = 0; j < nwords; j++)
+	qbuf[j] ^= dbuf[j];
 
-      c = mod_255((unsigned) bad2 + c);
-      grub_raid_block_mulx (c, pbuf, size);
+      cq = mod_255((255 ^ bad1)
+		   + (255 ^ powx_inv[(powx[bad2 + (bad1 ^ 255)] ^ 1)]));
+      cp = mod_255((unsigned) bad2 + cq);
+      grub_raid_mul_table (cq, tq);
+      grub_raid_mul_table (cp, tp);
 
-      grub_crypto_xor (pbuf, pbuf, qbuf, size);
-      grub_memcpy (buf, pbuf, size);
+      for (j = 0; j < size; j++)
+	buf[j] = tq[qb[j]] ^ tp[pb[j]];
     }
 
 quit:
   grub_free (pbuf);
   grub_free (qbuf);
+  grub_free (dbuf);
 
   return grub_errno;
 }
@@ -28,6 +28,10 @@ GRUB_MOD_LICENSE ("GPLv3+");
 
 #define GRUB_USBMS_DIRECTION_BIT	7
 
+/* Largest data phase of one command.  64 KiB is what other common hosts
+   issue, so mass storage devices are expected to cope with it.  */
+#define GRUB_USBMS_MAX_TRANSFER		65536
+
 /* Length of CBI command should be always 12 bytes */
 #define GRUB_USBMS_CBI_CMD_SIZE         12
 /* CBI class-specific USB request ADSC - it sends CBI (scsi) command to
@@ -621,6 +625,7 @@ grub_usbms_open (int id, int devnum, struct grub_scsi *scsi)
 
   scsi->data = grub_usbms_devices[devnum];
   scsi->luns = grub_usbms_devices[devnum]->luns;
+  scsi->maxbuffer = GRUB_USBMS_MAX_TRANSFER;
 
   return GRUB_ERR_NONE;
 }
@@ -29,6 +29,7 @@
 #include <minilzo.h>
 #include <grub/i18n.h>
 #include <grub/btrfs.h>
+#include <grub/fshelp.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -66,7 +67,10 @@ struct grub_btrfs_superblock
   grub_uint64_t chunk_tree;
   grub_uint8_t dummy2[0x20];
   grub_uint64_t root_dir_objectid;
-  grub_uint8_t dummy3[0x41];
+  grub_uint64_t num_devices;
+  grub_uint32_t sectorsize;
+  grub_uint32_t nodesize;
+  grub_uint8_t dummy3[0x31];
   struct grub_btrfs_device this_device;
   char label[0x100];
   grub_uint8_t dummy4[0x100];
@@ -88,6 +92,27 @@ struct grub_btrfs_device_desc
   grub_uint64_t id;
 };
 
+/* Chunk looked up in the chunk tree.  */
+struct grub_btrfs_chunk_map
+{
+  struct grub_btrfs_key key;
+  struct grub_btrfs_chunk_item *chunk;
+};
+
+/* Tree node read in whole.  */
+struct grub_btrfs_node_cache
+{
+  grub_disk_addr_t addr;
+  grub_uint64_t used;
+  grub_uint8_t *buf;
+};
+
+/* Memory for tree nodes kept around while a filesystem is mounted.  */
+#define GRUB_BTRFS_NODE_CACHE_BYTES	(512 * 1024)
+
+/* Most data read from striped chunks with one read per device.  */
+#define GRUB_BTRFS_MAX_STRIPED_READ	(8 * 1024 * 1024)
+
 struct grub_btrfs_data
 {
   struct grub_btrfs_superblock sblock;
@@ -105,6 +130,18 @@ struct grub_btrfs_data
   grub_uint64_t exttree;
   grub_size_t extsize;
   struct grub_btrfs_extent_data *extent;
+
+  /* Chunks looked up so far, sorted by logical address.  */
+  struct grub_btrfs_chunk_map *chunks;
+  unsigned n_chunks;
+  unsigned n_chunks_allocated;
+
+  /* Recently used tree nodes.  */
+  grub_uint32_t nodesize;
+  struct grub_btrfs_node_cache *nodes;
+  unsigned n_nodes;
+  unsigned n_nodes_allocated;
+  grub_uint64_t node_clock;
 };
 
 struct grub_btrfs_chunk_item
@@ -278,6 +315,67 @@ key_cmp (const struct grub_btrfs_key *a, const struct grub_btrfs_key *b)
   return 0;
 }
 
+/* Return the tree node at ADDR in *NODE, reading it in whole unless it was
+   used recently.  *NODE stays valid until the next call.  */
+static grub_err_t
+read_node (struct grub_btrfs_data *data, grub_disk_addr_t addr,
+	   int recursion_depth, const grub_uint8_t **node)
+{
+  struct grub_btrfs_node_cache *slot;
+  struct btrfs_header *head;
+  grub_uint8_t *buf;
+  grub_size_t itemsize;
+  unsigned i;
+  grub_err_t err;
+
+  for (i = 0; i < data->n_nodes; i++)
+    if (data->nodes[i].addr == addr)
+      {
+	data->nodes[i].used = ++data->node_clock;
+	*node = data->nodes[i].buf;
+	return GRUB_ERR_NONE;
+      }
+
+  buf = grub_malloc (data->nodesize);
+  if (!buf)
+    return grub_errno;
+  /* Reading may look up chunks in other nodes, so only pick the slot
+     afterwards.  */
+  err = grub_btrfs_read_logical (data, addr, buf, data->nodesize,
+				 recursion_depth);
+  if (err)
+    {
+      grub_free (buf);
+      return err;
+    }
+
+  head = (struct btrfs_header *) buf;
+  itemsize = head->level ? sizeof (struct grub_btrfs_internal_node)
+    : sizeof (struct grub_btrfs_leaf_node);
+  if (grub_le_to_cpu32 (head->nitems)
+      > (data->nodesize - sizeof (*head)) / itemsize)
+    {
+      grub_free (buf);
+      return grub_error (GRUB_ERR_BAD_FS, "invalid btrfs node");
+    }
+
+  if (data->n_nodes < data->n_nodes_allocated)
+    slot = &data->nodes[data->n_nodes++];
+  else
+    {
+      slot = &data->nodes[0];
+      for (i = 1; i < data->n_nodes; i++)
+	if (data->nodes[i].used < slot->used)
+	  slot = &data->nodes[i];
+      grub_free (slot->buf);
+    }
+  slot->addr = addr;
+  slot->used = ++data->node_clock;
+  slot->buf = buf;
+  *node = buf;
+  return GRUB_ERR_NONE;
+}
+
 static void
 free_iterator (struct grub_btrfs_leaf_descriptor *desc)
 {
@@ -314,6 +412,7 @@ next (struct grub_btrfs_data *data,
 {
   grub_err_t err;
   struct grub_btrfs_leaf_node leaf;
+  const grub_uint8_t *nodebuf;
 
   for (; desc->depth > 0; desc->depth--)
     {
@@ -329,29 +428,27 @@ next (struct grub_btrfs_data *data,
       struct grub_btrfs_internal_node node;
       struct btrfs_header head;
 
-      err = grub_btrfs_read_logical (data, desc->data[desc->depth - 1].iter
-				     * sizeof (node)
-				     + sizeof (struct btrfs_header)
-				     + desc->data[desc->depth - 1].addr,
-				     &node, sizeof (node), 0);
+      err = read_node (data, desc->data[desc->depth - 1].addr, 0, &nodebuf);
       if (err)
 	return -err;
+      grub_memcpy (&node, nodebuf + sizeof (struct btrfs_header)
+		   + desc->data[desc->depth - 1].iter * sizeof (node),
+		   sizeof (node));
 
-      err = grub_btrfs_read_logical (data, grub_le_to_cpu64 (node.addr),
-				     &head, sizeof (head), 0);
+      err = read_node (data, grub_le_to_cpu64 (node.addr), 0, &nodebuf);
       if (err)
 	return -err;
+      grub_memcpy (&head, nodebuf, sizeof (head));
 
       save_ref (desc, grub_le_to_cpu64 (node.addr), 0,
 		grub_le_to_cpu32 (head.nitems), !head.level);
     }
-  err = grub_btrfs_read_logical (data, desc->data[desc->depth - 1].iter
-				 * sizeof (leaf)
-				 + sizeof (struct btrfs_header)
-				 + desc->data[desc->depth - 1].addr, &leaf,
-				 sizeof (leaf), 0);
+  err = read_node (data, desc->data[desc->depth - 1].addr, 0, &nodebuf);
   if (err)
     return -err;
+  grub_memcpy (&leaf, nodebuf + sizeof (struct btrfs_header)
+	       + desc->data[desc->depth - 1].iter * sizeof (leaf),
+	       sizeof (leaf));
   *outsize = grub_le_to_cpu32 (leaf.size);
   *outaddr = desc->data[desc->depth - 1].addr + sizeof (struct btrfs_header)
     + grub_le_to_cpu32 (leaf.offset);
@@ -394,14 +491,15 @@ lower_bound (struct grub_btrfs_data *data,
     {
       grub_err_t err;
       struct btrfs_header head;
+      const grub_uint8_t *nodebuf;
 
     reiter:
       depth++;
-      /* FIXME: preread few nodes into buffer. */
-      err = grub_btrfs_read_logical (data, addr, &head, sizeof (head),
-				     recursion_depth + 1);
+      err = read_node (data, addr, recursion_depth + 1, &nodebuf);
       if (err)
 	return err;
+      grub_memcpy (&head, nodebuf, sizeof (head));
+      nodebuf += sizeof (head);
       addr += sizeof (head);
       if (head.level)
 	{
@@ -411,11 +509,7 @@ lower_bound (struct grub_btrfs_data *data,
 	  grub_memset (&node_last, 0, sizeof (node_last));
 	  for (i = 0; i < grub_le_to_cpu32 (head.nitems); i++)
 	    {
-	      err = grub_btrfs_read_logical (data, addr + i * sizeof (node),
-					     &node, sizeof (node),
-					     recursion_depth + 1);
-	      if (err)
-		return err;
+	      grub_memcpy (&node, nodebuf + i * sizeof (node), sizeof (node));
 
 	      grub_dprintf ("btrfs",
 			    "internal node (depth %d) %" PRIxGRUB_UINT64_T
@@ -464,11 +558,7 @@ lower_bound (struct grub_btrfs_data *data,
 	int have_last = 0;
 	for (i = 0; i < grub_le_to_cpu32 (head.nitems); i++)
 	  {
-	    err = grub_btrfs_read_logical (data, addr + i * sizeof (leaf),
-					   &leaf, sizeof (leaf),
-					   recursion_depth + 1);
-	    if (err)
-	      return err;
+	    grub_memcpy (&leaf, nodebuf + i * sizeof (leaf), sizeof (leaf));
 
 	    grub_dprintf ("btrfs",
 			  "leaf (depth %d) %" PRIxGRUB_UINT64_T
@@ -606,6 +696,189 @@ find_device (struct grub_btrfs_data *data, grub_uint64_t id, int do_rescan)
   return ctx.dev_found;
 }
 
+/* Find the looked up chunk containing ADDR.  */
+static struct grub_btrfs_chunk_map *
+find_chunk (struct grub_btrfs_data *data, grub_disk_addr_t addr)
+{
+  unsigned lo = 0, hi = data->n_chunks;
+
+  while (lo < hi)
+    {
+      unsigned mid = lo + (hi - lo) / 2;
+      struct grub_btrfs_chunk_map *map = &data->chunks[mid];
+
+      if (addr < grub_le_to_cpu64 (map->key.offset))
+	hi = mid;
+      else if (addr - grub_le_to_cpu64 (map->key.offset)
+	       >= grub_le_to_cpu64 (map->chunk->size))
+	lo = mid + 1;
+      else
+	return map;
+    }
+  return NULL;
+}
+
+/* Remember CHUNK found at KEY.  Return 1 if it was taken over.  */
+static int
+add_chunk (struct grub_btrfs_data *data, const struct grub_btrfs_key *key,
+	   struct grub_btrfs_chunk_item *chunk)
+{
+  grub_uint64_t start = grub_le_to_cpu64 (key->offset);
+  unsigned i;
+
+  if (data->n_chunks == data->n_chunks_allocated)
+    {
+      struct grub_btrfs_chunk_map *chunks;
+      unsigned n = 2 * data->n_chunks_allocated + 8;
+
+      chunks = grub_realloc (data->chunks, n * sizeof (chunks[0]));
+      if (!chunks)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  return 0;
+	}
+      data->chunks = chunks;
+      data->n_chunks_allocated = n;
+    }
+
+  for (i = data->n_chunks;
+       i > 0 && grub_le_to_cpu64 (data->chunks[i - 1].key.offset) > start; i--)
+    data->chunks[i] = data->chunks[i - 1];
+  data->chunks[i].key = *key;
+  data->chunks[i].chunk = chunk;
+  data->n_chunks++;
+  return 1;
+}
+
+/* Copy whatever of ADDR can be had from a node in memory.  */
+static grub_size_t
+read_cached_node (struct grub_btrfs_data *data, grub_disk_addr_t addr,
+		  void *buf, grub_size_t size)
+{
+  unsigned i;
+
+  for (i = 0; i < data->n_nodes; i++)
+    if (addr >= data->nodes[i].addr
+	&& addr - data->nodes[i].addr < data->nodesize)
+      {
+	grub_size_t off = addr - data->nodes[i].addr;
+
+	if (size > data->nodesize - off)
+	  size = data->nodesize - off;
+	grub_memcpy (buf, data->nodes[i].buf + off, size);
+	return size;
+      }
+  return 0;
+}
+
+/* Read LEN bytes at offset OFF of a RAID0 or RAID10 chunk into BUF.  The
+   chunk is striped over NDATA stripes, each mirrored NSUB times.  Stripe
+   elements of consecutive rows are contiguous on their device, so every
+   stripe is read with a single request and scattered into BUF.  */
+static grub_err_t
+read_striped (struct grub_btrfs_data *data,
+	      struct grub_btrfs_chunk_item *chunk, grub_uint64_t off,
+	      grub_uint64_t stripe_length, unsigned ndata, unsigned nsub,
+	      grub_uint8_t *buf, grub_size_t len)
+{
+  struct grub_btrfs_chunk_stripe *stripes;
+  grub_uint64_t first, last, rem, nrows;
+  grub_uint8_t *tmp;
+  grub_err_t err = GRUB_ERR_NONE;
+  unsigned col, firstcol, lastcol;
+
+  stripes = (struct grub_btrfs_chunk_stripe *) (chunk + 1);
+  first = grub_divmod64 (off, stripe_length, NULL);
+  last = grub_divmod64 (off + len - 1, stripe_length, NULL);
+  grub_divmod64 (first, ndata, &rem);
+  firstcol = rem;
+  grub_divmod64 (last, ndata, &rem);
+  lastcol = rem;
+  nrows = grub_divmod64 (last - first, ndata, NULL) + 1;
+
+  tmp = grub_malloc (nrows * stripe_length);
+  if (!tmp)
+    return grub_errno;
+
+  for (col = 0; col < ndata && !err; col++)
+    {
+      grub_uint64_t u, ufirst, ulast, row, start, end;
+      unsigned mirror, i, j;
+
+      /* The first and last elements of the read in this stripe.  */
+      ufirst = first + (col + ndata - firstcol) % ndata;
+      if (ufirst > last)
+	continue;
+      ulast = last - (lastcol + ndata - col) % ndata;
+      row = grub_divmod64 (ufirst, ndata, NULL);
+
+      start = row * stripe_length;
+      if (ufirst == first)
+	start += off - first * stripe_length;
+      end = grub_divmod64 (ulast, ndata, NULL) * stripe_length;
+      if (ulast == last)
+	end += off + len - last * stripe_length;
+      else
+	end += stripe_length;
+
+      /* Spread the stripes over the mirrors.  */
+      mirror = ((unsigned) row + col) % nsub;
+      for (j = 0; j < 2; j++)
+	{
+	  for (i = 0; i < nsub; i++)
+	    {
+	      struct grub_btrfs_chunk_stripe *stripe;
+	      grub_disk_addr_t paddr;
+	      grub_device_t dev;
+
+	      stripe = &stripes[col * nsub + (i + mirror) % nsub];
+	      paddr = grub_le_to_cpu64 (stripe->offset) + start;
+
+	      grub_dprintf ("btrfs", "reading 0x%" PRIxGRUB_UINT64_T
+			    " bytes of stripe %u at paddr 0x%"
+			    PRIxGRUB_UINT64_T "\n", end - start, col, paddr);
+
+	      dev = find_device (data, stripe->device_id, j);
+	      if (!dev)
+		{
+		  err = grub_errno;
+		  grub_errno = GRUB_ERR_NONE;
+		  continue;
+		}
+
+	      err = grub_disk_read (dev->disk, paddr >> GRUB_DISK_SECTOR_BITS,
+				    paddr & (GRUB_DISK_SECTOR_SIZE - 1),
+				    end - start, tmp);
+	      if (!err)
+		break;
+	      grub_errno = GRUB_ERR_NONE;
+	    }
+	  if (i != nsub)
+	    break;
+	}
+      if (err)
+	break;
+
+      for (u = ufirst; u <= ulast; u += ndata)
+	{
+	  grub_uint64_t from = u * stripe_length;
+	  grub_uint64_t to = from + stripe_length;
+	  grub_uint64_t phys;
+
+	  if (from < off)
+	    from = off;
+	  if (to > off + len)
+	    to = off + len;
+	  phys = grub_divmod64 (u, ndata, NULL) * stripe_length
+	    + (from - u * stripe_length);
+	  grub_memcpy (buf + (from - off), tmp + (phys - start), to - from);
+	}
+    }
+
+  grub_free (tmp);
+  return err;
+}
+
 static grub_err_t
 grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 			 void *buf, grub_size_t size, int recursion_depth)
@@ -623,9 +896,28 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
       struct grub_btrfs_key key_in;
       grub_size_t chsize;
       grub_disk_addr_t chaddr;
+      struct grub_btrfs_chunk_map *map;
+
+      /* Items of tree nodes are mostly read right after their node.  */
+      csize = read_cached_node (data, addr, buf, size);
+      if (csize)
+	{
+	  size -= csize;
+	  buf = (grub_uint8_t *) buf + csize;
+	  addr += csize;
+	  continue;
+	}
 
       grub_dprintf ("btrfs", "searching for laddr %" PRIxGRUB_UINT64_T "\n",
 		    addr);
+      map = find_chunk (data, addr);
+      if (map)
+	{
+	  key = &map->key;
+	  chunk = map->chunk;
+	  goto chunk_found;
+	}
+
       for (ptr = data->sblock.bootstrap_mapping;
 	   ptr < data->sblock.bootstrap_mapping
 	   + sizeof (data->sblock.bootstrap_mapping)
@@ -674,6 +966,8 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 	  grub_free (chunk);
 	  return err;
 	}
+      if (add_chunk (data, key, chunk))
+	challoc = 0;
 
     chunk_found:
       {
@@ -683,6 +977,9 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 	grub_uint64_t chunk_stripe_length;
 	grub_uint16_t nstripes;
 	unsigned redundancy = 1;
+	/* Striped chunks: number of data stripes.  */
+	unsigned ndata = 0;
+	unsigned mirror = 0;
 	unsigned i, j;
 
 	if (grub_le_to_cpu64 (chunk->size) <= off)
@@ -728,6 +1025,11 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 	      stripe_offset = off;
 	      csize = grub_le_to_cpu64 (chunk->size) - off;
 	      redundancy = 2;
+	      /* Alternate between the mirrors of RAID1, region by region.  */
+	      if ((grub_le_to_cpu64 (chunk->type)
+		   & ~GRUB_BTRFS_CHUNK_TYPE_BITS_DONTCARE)
+		  == GRUB_BTRFS_CHUNK_TYPE_RAID1)
+		mirror = grub_divmod64 (off, chunk_stripe_length, NULL) & 1;
 	      break;
 	    }
 	  case GRUB_BTRFS_CHUNK_TYPE_RAID0:
@@ -744,6 +1046,7 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 	      stripe_offset =
 		low + chunk_stripe_length * high;
 	      csize = chunk_stripe_length - low;
+	      ndata = nstripes;
 	      break;
 	    }
 	  case GRUB_BTRFS_CHUNK_TYPE_RAID10:
@@ -761,9 +1064,11 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 				    &stripen);
 	      stripen *= nsubstripes;
 	      redundancy = nsubstripes;
+	      mirror = (unsigned) high % nsubstripes;
 	      stripe_offset = low + chunk_stripe_length
 		* high;
 	      csize = chunk_stripe_length - low;
+	      ndata = nstripes / nsubstripes ? : 1;
 	      break;
 	    }
 	  default:
@@ -778,6 +1083,20 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 	if (csize > (grub_uint64_t) size)
 	  csize = size;
 
+	/* Reads going past one stripe element take one request per
+	   stripe.  */
+	if (ndata > 1 && csize < size)
+	  {
+	    csize = grub_le_to_cpu64 (chunk->size) - off;
+	    if (csize > (grub_uint64_t) size)
+	      csize = size;
+	    if (csize > GRUB_BTRFS_MAX_STRIPED_READ)
+	      csize = GRUB_BTRFS_MAX_STRIPED_READ;
+	    err = read_striped (data, chunk, off, chunk_stripe_length, ndata,
+				redundancy, buf, csize);
+	    goto read_done;
+	  }
+
 	for (j = 0; j < 2; j++)
 	  {
 	    for (i = 0; i < redundancy; i++)
@@ -788,7 +1107,7 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 		stripe = (struct grub_btrfs_chunk_stripe *) (chunk + 1);
 		/* Right now the redundancy handling is easy.
 		   With RAID5-like it will be more difficult.  */
-		stripe += stripen + i;
+		stripe += stripen + (i + mirror) % redundancy;
 
 		paddr = grub_le_to_cpu64 (stripe->offset) + stripe_offset;
 
@@ -825,6 +1144,7 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 	    if (i != redundancy)
 	      break;
 	  }
+      read_done:
 	if (err)
 	  return grub_errno = err;
       }
@@ -872,6 +1192,25 @@ grub_btrfs_mount (grub_device_t dev)
   data->devices_attached[0].dev = dev;
   data->devices_attached[0].id = data->sblock.this_device.device_id;
 
+  data->nodesize = grub_le_to_cpu32 (data->sblock.nodesize);
+  if (data->nodesize < 4096 || data->nodesize > 65536
+      || (data->nodesize & (data->nodesize - 1)))
+    {
+      grub_error (GRUB_ERR_BAD_FS, "invalid btrfs node size");
+      grub_free (data->devices_attached);
+      grub_free (data);
+      return NULL;
+    }
+  data->n_nodes_allocated = GRUB_BTRFS_NODE_CACHE_BYTES / data->nodesize;
+  data->nodes = grub_malloc (data->n_nodes_allocated
+			     * sizeof (data->nodes[0]));
+  if (!data->nodes)
+    {
+      grub_free (data->devices_attached);
+      grub_free (data);
+      return NULL;
+    }
+
   return data;
 }
 
@@ -882,7 +1221,13 @@ grub_btrfs_unmount (struct grub_btrfs_data *data)
   /* The device 0 is closed one layer upper.  */
   for (i = 1; i < data->n_devices_attached; i++)
     grub_device_close (data->devices_attached[i].dev);
+  for (i = 0; i < data->n_chunks; i++)
+    grub_free (data->chunks[i].chunk);
+  for (i = 0; i < data->n_nodes; i++)
+    grub_free (data->nodes[i].buf);
   grub_free (data->devices_attached);
+  grub_free (data->chunks);
+  grub_free (data->nodes);
   grub_free (data->extent);
   grub_free (data);
 }
@@ -1232,6 +1577,15 @@ get_root (struct grub_btrfs_data *data, struct grub_btrfs_key *key,
   return GRUB_ERR_NONE;
 }
 
+static struct grub_fs grub_btrfs_fs;
+
+/* Directory entry cache key of a directory.  */
+struct grub_btrfs_dcache_dir
+{
+  grub_uint64_t tree;
+  grub_uint64_t object_id;
+};
+
 static grub_err_t
 find_path (struct grub_btrfs_data *data,
 	   const char *path, struct grub_btrfs_key *key,
@@ -1243,6 +1597,10 @@ find_path (struct grub_btrfs_data *data,
   grub_size_t elemsize;
   grub_size_t allocated = 0;
   struct grub_btrfs_dir_item *direl = NULL;
+  struct grub_btrfs_dir_item *cdirel;
+  struct grub_btrfs_dir_item cached_direl;
+  struct grub_btrfs_dcache_dir dcache_dir;
+  grub_disk_t disk = data->devices_attached[0].dev->disk;
   struct grub_btrfs_key key_out;
   const char *ctoken;
   grub_size_t ctokenlen;
@@ -1315,6 +1673,26 @@ find_path (struct grub_btrfs_data *data,
 	  continue;
 	}
 
+      dcache_dir.tree = *tree;
+      dcache_dir.object_id = key->object_id;
+      switch (grub_fshelp_dcache_lookup (disk, &grub_btrfs_fs,
+					 &dcache_dir, sizeof (dcache_dir),
+					 ctoken, ctokenlen, &cached_direl,
+					 sizeof (cached_direl)))
+	{
+	case GRUB_FSHELP_DCACHE_FOUND:
+	  cdirel = &cached_direl;
+	  goto found;
+	case GRUB_FSHELP_DCACHE_ABSENT:
+	  grub_free (direl);
+	  grub_free (path_alloc);
+	  err = grub_error (GRUB_ERR_FILE_NOT_FOUND, N_("file `%s' not found"), origpath);
+	  grub_free (origpath);
+	  return err;
+	case GRUB_FSHELP_DCACHE_MISS:
+	  break;
+	}
+
       key->type = GRUB_BTRFS_ITEM_TYPE_DIR_ITEM;
       key->offset = grub_cpu_to_le64 (~grub_getcrc32c (1, ctoken, ctokenlen));
 
@@ -1329,6 +1707,9 @@ find_path (struct grub_btrfs_data *data,
 	}
       if (key_cmp (key, &key_out) != 0)
 	{
+	  grub_fshelp_dcache_insert (disk, &grub_btrfs_fs,
+				     &dcache_dir, sizeof (dcache_dir),
+				     ctoken, ctokenlen, NULL, 0);
 	  grub_free (direl);
 	  grub_free (path_alloc);
 	  err = grub_error (GRUB_ERR_FILE_NOT_FOUND, N_("file `%s' not found"), origpath);
@@ -1336,7 +1717,6 @@ find_path (struct grub_btrfs_data *data,
 	  return err;
 	}
 
-      struct grub_btrfs_dir_item *cdirel;
       if (elemsize > allocated)
 	{
 	  allocated = 2 * elemsize;
@@ -1373,13 +1753,20 @@ find_path (struct grub_btrfs_data *data,
       if ((grub_uint8_t *) cdirel - (grub_uint8_t *) direl
 	  >= (grub_ssize_t) elemsize)
 	{
+	  grub_fshelp_dcache_insert (disk, &grub_btrfs_fs,
+				     &dcache_dir, sizeof (dcache_dir),
+				     ctoken, ctokenlen, NULL, 0);
 	  grub_free (direl);
 	  grub_free (path_alloc);
 	  err = grub_error (GRUB_ERR_FILE_NOT_FOUND, N_("file `%s' not found"), origpath);
 	  grub_free (origpath);
 	  return err;
 	}
+      grub_fshelp_dcache_insert (disk, &grub_btrfs_fs,
+				 &dcache_dir, sizeof (dcache_dir),
+				 ctoken, ctokenlen, cdirel, sizeof (*cdirel));
 
+    found:
       path = slash;
       if (cdirel->type == GRUB_BTRFS_DIR_ITEM_TYPE_SYMLINK)
 	{
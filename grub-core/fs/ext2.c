@@ -140,6 +140,22 @@ GRUB_MOD_LICENSE ("GPLv3+");
 
 #define EXT4_EXTENTS_FLAG		0x80000
 
+/* Inode flags of directories.  */
+#define EXT4_ENCRYPT_FLAG		0x800
+#define EXT2_INDEX_FLAG			0x1000
+#define EXT4_CASEFOLD_FLAG		0x40000000
+
+/* Superblock flags.  */
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002
+
+/* Hash functions of the directory index.  */
+#define EXT2_DX_HASH_LEGACY		0
+#define EXT2_DX_HASH_HALF_MD4		1
+#define EXT2_DX_HASH_TEA		2
+
+/* Depth of the directory index, counting the root.  */
+#define EXT2_DX_MAX_LEVELS		3
+
 /* The ext2 superblock.  */
 struct grub_ext2_sblock
 {
@@ -193,6 +209,12 @@ struct grub_ext2_sblock
   grub_uint32_t first_meta_bg;
   grub_uint32_t mkfs_time;
   grub_uint32_t jnl_blocks[17];
+  grub_uint32_t total_blocks_hi;
+  grub_uint32_t reserved_blocks_hi;
+  grub_uint32_t free_blocks_hi;
+  grub_uint16_t min_extra_isize;
+  grub_uint16_t want_extra_isize;
+  grub_uint32_t flags;
 };
 
 /* The ext2 blockgroup.  */
@@ -259,6 +281,35 @@ struct ext2_dirent
   grub_uint8_t filetype;
 };
 
+/* Directory index (htree).  The first block of an indexed directory holds
+   the `.' and `..' entries, then the root info and the top level of index
+   entries; lower index levels fill blocks behind an empty entry.  In the
+   first index entry of a block, the hash is replaced by the number of
+   entries and their limit.  */
+struct ext2_dx_root_info
+{
+  grub_uint32_t reserved_zero;
+  grub_uint8_t hash_version;
+  grub_uint8_t info_length;
+  grub_uint8_t indirect_levels;
+  grub_uint8_t unused_flags;
+};
+
+struct ext2_dx_countlimit
+{
+  grub_uint16_t limit;
+  grub_uint16_t count;
+};
+
+struct ext2_dx_entry
+{
+  grub_uint32_t hash;
+  grub_uint32_t block;
+};
+
+/* Offset of the root info in the first block.  */
+#define EXT2_DX_ROOT_INFO_OFFSET	24
+
 struct grub_ext3_journal_header
 {
   grub_uint32_t magic;
@@ -324,6 +375,17 @@ struct grub_fshelp_node
   int inode_read;
 };
 
+/* An extent decoded from a leaf of the extent tree.  */
+struct grub_ext2_cached_extent
+{
+  grub_uint32_t block;
+  grub_uint32_t len;
+  grub_disk_addr_t start;
+};
+
+/* Upper bound on the decoded extents kept for one file.  */
+#define EXT2_EXTENT_CACHE_MAX	4096
+
 /* Information about a "mounted" ext2 filesystem.  */
 struct grub_ext2_data
 {
@@ -332,6 +394,17 @@ struct grub_ext2_data
   grub_disk_t disk;
   struct grub_ext2_inode *inode;
   struct grub_fshelp_node diropen;
+
+  /* Mapping caches for the opened file, only set up by grub_ext2_open.
+     EXTENTS is sorted by file block; EXTENT_LAST is the last hit.  */
+  int cache_mapping;
+  struct grub_ext2_cached_extent *extents;
+  grub_size_t extent_count;
+  grub_size_t extent_last;
+  /* Last indirect block of pointers to data blocks read, and its
+     contents.  */
+  grub_disk_addr_t indir_window_block;
+  grub_uint32_t *indir_window;
 };
 
 static grub_dl_t my_mod;
@@ -451,8 +524,103 @@ grub_ext4_find_leaf (struct grub_ext2_data *data,
   return 0;
 }
 
+/* Find the cached extent containing FILEBLOCK.  */
+static struct grub_ext2_cached_extent *
+grub_ext2_extent_cache_find (struct grub_ext2_data *data,
+			     grub_uint32_t fileblock)
+{
+  struct grub_ext2_cached_extent *ext;
+  grub_size_t lo = 0, hi = data->extent_count;
+
+  if (data->extent_last < data->extent_count)
+    {
+      ext = &data->extents[data->extent_last];
+      if (fileblock - ext->block < ext->len)
+	return ext;
+      /* Sequential reads move on to the next extent.  */
+      if (data->extent_last + 1 < data->extent_count
+	  && fileblock - ext[1].block < ext[1].len)
+	{
+	  data->extent_last++;
+	  return ext + 1;
+	}
+    }
+
+  /* Find the last extent starting at or before FILEBLOCK.  */
+  while (lo < hi)
+    {
+      grub_size_t mid = lo + (hi - lo) / 2;
+      if (data->extents[mid].block <= fileblock)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  if (lo == 0)
+    return 0;
+  ext = &data->extents[lo - 1];
+  if (fileblock - ext->block >= ext->len)
+    return 0;
+  data->extent_last = lo - 1;
+  return ext;
+}
+
+/* Add the extents of LEAF to the cache.  Errors only cost the caching.  */
+static void
+grub_ext2_extent_cache_add (struct grub_ext2_data *data,
+			    struct grub_ext4_extent_header *leaf)
+{
+  struct grub_ext4_extent *ext = (struct grub_ext4_extent *) (leaf + 1);
+  grub_size_t n = grub_le_to_cpu16 (leaf->entries);
+  grub_size_t i;
+
+  if (data->extent_count + n > EXT2_EXTENT_CACHE_MAX)
+    data->extent_count = data->extent_last = 0;
+
+  if (!data->extents)
+    {
+      data->extents = grub_malloc (EXT2_EXTENT_CACHE_MAX
+				   * sizeof (data->extents[0]));
+      if (!data->extents)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  data->cache_mapping = 0;
+	  return;
+	}
+    }
+
+  for (i = 0; i < n && data->extent_count < EXT2_EXTENT_CACHE_MAX; i++)
+    {
+      struct grub_ext2_cached_extent *c;
+      grub_uint32_t block = grub_le_to_cpu32 (ext[i].block);
+      grub_size_t lo = 0, hi = data->extent_count;
+
+      while (lo < hi)
+	{
+	  grub_size_t mid = lo + (hi - lo) / 2;
+	  if (data->extents[mid].block < block)
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
+      if (lo < data->extent_count && data->extents[lo].block == block)
+	continue;
+
+      c = &data->extents[lo];
+      grub_memmove (c + 1, c,
+		    (data->extent_count - lo) * sizeof (*c));
+      data->extent_count++;
+      c->block = block;
+      c->len = grub_le_to_cpu16 (ext[i].len);
+      c->start = grub_le_to_cpu16 (ext[i].start_hi);
+      c->start = (c->start << 32) + grub_le_to_cpu32 (ext[i].start);
+    }
+}
+
+/* Map FILEBLOCK to a disk block and set *COUNT to the number of blocks,
+   at most *COUNT, that continue the run on disk.  */
 static grub_disk_addr_t
-grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
+grub_ext2_read_extent (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+		       grub_disk_addr_t *count)
 {
   struct grub_ext2_data *data = node->data;
   struct grub_ext2_inode *inode = &node->inode;
@@ -462,13 +630,29 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
   int log_perblock = log2_blksz + 9 - 2;
   grub_uint32_t indir;
   int shift;
+  grub_disk_addr_t max = *count;
 
   if (inode->flags & grub_cpu_to_le32_compile_time (EXT4_EXTENTS_FLAG))
     {
       struct grub_ext4_extent_header *leaf;
       struct grub_ext4_extent *ext;
       int i;
-      grub_disk_addr_t ret;
+      grub_disk_addr_t ret, left = 1;
+      int cache = data->cache_mapping && node == &data->diropen;
+
+      if (cache)
+	{
+	  struct grub_ext2_cached_extent *c;
+
+	  c = grub_ext2_extent_cache_find (data, fileblock);
+	  if (c)
+	    {
+	      left = c->len - (fileblock - c->block);
+	      if (left < *count)
+		*count = left;
+	      return c->start + (fileblock - c->block);
+	    }
+	}
 
       leaf = grub_ext4_find_leaf (data, (struct grub_ext4_extent_header *) inode->blocks.dir_blocks, fileblock);
       if (! leaf)
@@ -477,6 +661,9 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
           return -1;
         }
 
+      if (cache)
+	grub_ext2_extent_cache_add (data, leaf);
+
       ext = (struct grub_ext4_extent *) (leaf + 1);
       for (i = 0; i < grub_le_to_cpu16 (leaf->entries); i++)
         {
@@ -488,7 +675,15 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
         {
           fileblock -= grub_le_to_cpu32 (ext[i].block);
           if (fileblock >= grub_le_to_cpu16 (ext[i].len))
-	    ret = 0;
+	    {
+	      ret = 0;
+	      /* The hole lasts until the next extent in this leaf.  */
+	      if (i + 1 < grub_le_to_cpu16 (leaf->entries))
+		left = grub_le_to_cpu32 (ext[i + 1].block)
+		  - grub_le_to_cpu32 (ext[i].block) - fileblock;
+	      else
+		left = 1;
+	    }
           else
             {
               grub_disk_addr_t start;
@@ -497,13 +692,22 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
               start = (start << 32) + grub_le_to_cpu32 (ext[i].start);
 
               ret = fileblock + start;
+	      left = grub_le_to_cpu16 (ext[i].len) - fileblock;
             }
         }
+      else if (grub_le_to_cpu16 (leaf->entries))
+	{
+	  /* Hole before the first extent.  */
+	  ret = 0;
+	  left = grub_le_to_cpu32 (ext[0].block) - fileblock;
+	}
       else
         {
           grub_error (GRUB_ERR_BAD_FS, "something wrong with extent");
 	  ret = -1;
         }
+      if (left < *count)
+	*count = left;
 
       if (leaf != (struct grub_ext4_extent_header *) inode->blocks.dir_blocks)
 	grub_free (leaf);
@@ -513,7 +717,18 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
 
   /* Direct blocks.  */
   if (fileblock < INDIRECT_BLOCKS)
-    return grub_le_to_cpu32 (inode->blocks.dir_blocks[fileblock]);
+    {
+      grub_disk_addr_t ret, n;
+
+      ret = grub_le_to_cpu32 (inode->blocks.dir_blocks[fileblock]);
+      for (n = 1; n < *count && fileblock + n < INDIRECT_BLOCKS; n++)
+	if (grub_le_to_cpu32 (inode->blocks.dir_blocks[fileblock + n])
+	    != (ret ? ret + n : 0))
+	  break;
+      *count = n;
+      return ret;
+    }
+  *count = 1;
   fileblock -= INDIRECT_BLOCKS;
   /* Indirect.  */
   if (fileblock < blksz_quarter)
@@ -543,20 +758,63 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
   return -1;
 
 indirect:
-  do {
-    /* If the indirect block is zero, all child blocks are absent
-       (i.e. filled with zeros.) */
-    if (indir == 0)
-      return 0;
-    if (grub_disk_read (data->disk,
-			((grub_disk_addr_t) grub_le_to_cpu32 (indir))
-			<< log2_blksz,
-			((fileblock >> (log_perblock * shift))
-			 & ((1 << log_perblock) - 1))
-			* sizeof (indir),
-			sizeof (indir), &indir))
-      return -1;
-  } while (shift--);
+  for (; shift > 0; shift--)
+    {
+      /* If the indirect block is zero, all child blocks are absent
+	 (i.e. filled with zeros.) */
+      if (indir == 0)
+	return 0;
+      if (grub_disk_read (data->disk,
+			  ((grub_disk_addr_t) grub_le_to_cpu32 (indir))
+			  << log2_blksz,
+			  ((fileblock >> (log_perblock * shift))
+			   & ((1 << log_perblock) - 1))
+			  * sizeof (indir),
+			  sizeof (indir), &indir))
+	return -1;
+    }
+
+  if (indir == 0)
+    return 0;
+
+  if (data->cache_mapping && node == &data->diropen)
+    {
+      grub_disk_addr_t ret, n;
+      unsigned idx = fileblock & ((1 << log_perblock) - 1);
+
+      if (!data->indir_window)
+	{
+	  data->indir_window = grub_malloc (blksz);
+	  if (!data->indir_window)
+	    return -1;
+	  data->indir_window_block = 0;
+	}
+      if (data->indir_window_block != grub_le_to_cpu32 (indir))
+	{
+	  data->indir_window_block = 0;
+	  if (grub_disk_read (data->disk,
+			      ((grub_disk_addr_t) grub_le_to_cpu32 (indir))
+			      << log2_blksz, 0, blksz, data->indir_window))
+	    return -1;
+	  data->indir_window_block = grub_le_to_cpu32 (indir);
+	}
+
+      /* Report how far the pointers in this block stay contiguous.  */
+      ret = grub_le_to_cpu32 (data->indir_window[idx]);
+      for (n = 1; n < max && idx + n < blksz_quarter; n++)
+	if (grub_le_to_cpu32 (data->indir_window[idx + n])
+	    != (ret ? ret + n : 0))
+	  break;
+      *count = n;
+      return ret;
+    }
+
+  if (grub_disk_read (data->disk,
+		      ((grub_disk_addr_t) grub_le_to_cpu32 (indir))
+		      << log2_blksz,
+		      (fileblock & ((1 << log_perblock) - 1)) * sizeof (indir),
+		      sizeof (indir), &indir))
+    return -1;
 
   return grub_le_to_cpu32 (indir);
 }
@@ -568,12 +826,12 @@ grub_ext2_read_file (grub_fshelp_node_t node,
 		     grub_disk_read_hook_t read_hook, void *read_hook_data,
 		     grub_off_t pos, grub_size_t len, char *buf)
 {
-  return grub_fshelp_read_file (node->data->disk, node,
-				read_hook, read_hook_data,
-				pos, len, buf, grub_ext2_read_block,
-				grub_cpu_to_le32 (node->inode.size)
-				| (((grub_off_t) grub_cpu_to_le32 (node->inode.size_high)) << 32),
-				LOG2_EXT2_BLOCK_SIZE (node->data), 0);
+  return grub_fshelp_read_file_extents (node->data->disk, node,
+					read_hook, read_hook_data,
+					pos, len, buf, grub_ext2_read_extent,
+					grub_cpu_to_le32 (node->inode.size)
+					| (((grub_off_t) grub_cpu_to_le32 (node->inode.size_high)) << 32),
+					LOG2_EXT2_BLOCK_SIZE (node->data), 0);
 
 }
 
@@ -679,6 +937,13 @@ grub_ext2_mount (grub_disk_t disk)
   data->diropen.ino = 2;
   data->diropen.inode_read = 1;
 
+  data->cache_mapping = 0;
+  data->extents = 0;
+  data->extent_count = 0;
+  data->extent_last = 0;
+  data->indir_window = 0;
+  data->indir_window_block = 0;
+
   data->inode = &data->diropen.inode;
 
   grub_ext2_read_inode (data, 2, data->inode);
@@ -735,6 +1000,64 @@ grub_ext2_read_symlink (grub_fshelp_node_t node)
   return symlink;
 }
 
+/* Make a node for the directory entry DIRENT in DIRO and work out its
+   type, from the entry if it says, else from the inode.  */
+static struct grub_fshelp_node *
+grub_ext2_dirent_node (struct grub_fshelp_node *diro,
+		       const struct ext2_dirent *dirent,
+		       enum grub_fshelp_filetype *type)
+{
+  struct grub_fshelp_node *fdiro;
+
+  *type = GRUB_FSHELP_UNKNOWN;
+
+  fdiro = grub_malloc (sizeof (struct grub_fshelp_node));
+  if (! fdiro)
+    return 0;
+
+  fdiro->data = diro->data;
+  fdiro->ino = grub_le_to_cpu32 (dirent->inode);
+
+  if (dirent->filetype != FILETYPE_UNKNOWN)
+    {
+      fdiro->inode_read = 0;
+
+      if (dirent->filetype == FILETYPE_DIRECTORY)
+	*type = GRUB_FSHELP_DIR;
+      else if (dirent->filetype == FILETYPE_SYMLINK)
+	*type = GRUB_FSHELP_SYMLINK;
+      else if (dirent->filetype == FILETYPE_REG)
+	*type = GRUB_FSHELP_REG;
+    }
+  else
+    {
+      /* The filetype can not be read from the dirent, read
+	 the inode to get more information.  */
+      grub_ext2_read_inode (diro->data,
+			    grub_le_to_cpu32 (dirent->inode),
+			    &fdiro->inode);
+      if (grub_errno)
+	{
+	  grub_free (fdiro);
+	  return 0;
+	}
+
+      fdiro->inode_read = 1;
+
+      if ((grub_le_to_cpu16 (fdiro->inode.mode)
+	   & FILETYPE_INO_MASK) == FILETYPE_INO_DIRECTORY)
+	*type = GRUB_FSHELP_DIR;
+      else if ((grub_le_to_cpu16 (fdiro->inode.mode)
+		& FILETYPE_INO_MASK) == FILETYPE_INO_SYMLINK)
+	*type = GRUB_FSHELP_SYMLINK;
+      else if ((grub_le_to_cpu16 (fdiro->inode.mode)
+		& FILETYPE_INO_MASK) == FILETYPE_INO_REG)
+	*type = GRUB_FSHELP_REG;
+    }
+
+  return fdiro;
+}
+
 static int
 grub_ext2_iterate_dir (grub_fshelp_node_t dir,
 		       grub_fshelp_iterate_dir_hook_t hook, void *hook_data)
@@ -766,58 +1089,18 @@ grub_ext2_iterate_dir (grub_fshelp_node_t dir,
 	{
 	  char filename[MAX_NAMELEN + 1];
 	  struct grub_fshelp_node *fdiro;
-	  enum grub_fshelp_filetype type = GRUB_FSHELP_UNKNOWN;
+	  enum grub_fshelp_filetype type;
 
 	  grub_ext2_read_file (diro, 0, 0, fpos + sizeof (struct ext2_dirent),
 			       dirent.namelen, filename);
 	  if (grub_errno)
 	    return 0;
 
-	  fdiro = grub_malloc (sizeof (struct grub_fshelp_node));
-	  if (! fdiro)
-	    return 0;
-
-	  fdiro->data = diro->data;
-	  fdiro->ino = grub_le_to_cpu32 (dirent.inode);
-
 	  filename[dirent.namelen] = '\0';
 
-	  if (dirent.filetype != FILETYPE_UNKNOWN)
-	    {
-	      fdiro->inode_read = 0;
-
-	      if (dirent.filetype == FILETYPE_DIRECTORY)
-		type = GRUB_FSHELP_DIR;
-	      else if (dirent.filetype == FILETYPE_SYMLINK)
-		type = GRUB_FSHELP_SYMLINK;
-	      else if (dirent.filetype == FILETYPE_REG)
-		type = GRUB_FSHELP_REG;
-	    }
-	  else
-	    {
-	      /* The filetype can not be read from the dirent, read
-		 the inode to get more information.  */
-	      grub_ext2_read_inode (diro->data,
-                                    grub_le_to_cpu32 (dirent.inode),
-				    &fdiro->inode);
-	      if (grub_errno)
-		{
-		  grub_free (fdiro);
-		  return 0;
-		}
-
-	      fdiro->inode_read = 1;
-
-	      if ((grub_le_to_cpu16 (fdiro->inode.mode)
-		   & FILETYPE_INO_MASK) == FILETYPE_INO_DIRECTORY)
-		type = GRUB_FSHELP_DIR;
-	      else if ((grub_le_to_cpu16 (fdiro->inode.mode)
-			& FILETYPE_INO_MASK) == FILETYPE_INO_SYMLINK)
-		type = GRUB_FSHELP_SYMLINK;
-	      else if ((grub_le_to_cpu16 (fdiro->inode.mode)
-			& FILETYPE_INO_MASK) == FILETYPE_INO_REG)
-		type = GRUB_FSHELP_REG;
-	    }
+	  fdiro = grub_ext2_dirent_node (diro, &dirent, &type);
+	  if (! fdiro)
+	    return 0;
 
 	  if (hook (filename, type, fdiro, hook_data))
 	    return 1;
@@ -829,6 +1112,389 @@ grub_ext2_iterate_dir (grub_fshelp_node_t dir,
   return 0;
 }
 
+#define EXT2_ROL32(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+/* The original directory index hash.  */
+static grub_uint32_t
+grub_ext2_dx_hack_hash (const char *name, int len, int unsigned_chars)
+{
+  grub_uint32_t hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+
+  while (len--)
+    {
+      int c = unsigned_chars ? (grub_uint8_t) *name : (grub_int8_t) *name;
+
+      name++;
+      hash = hash1 + (hash0 ^ (grub_uint32_t) (c * 7152373));
+      if (hash & 0x80000000)
+	hash -= 0x7fffffff;
+      hash1 = hash0;
+      hash0 = hash;
+    }
+  return hash0 << 1;
+}
+
+/* Pack up to NUM * 4 characters of MSG into BUF, padding with the
+   length.  */
+static void
+grub_ext2_dx_str2hashbuf (const char *msg, int len, grub_uint32_t *buf,
+			  int num, int unsigned_chars)
+{
+  grub_uint32_t pad, val;
+  int i;
+
+  pad = (grub_uint32_t) len | ((grub_uint32_t) len << 8);
+  pad |= pad << 16;
+
+  val = pad;
+  if (len > num * 4)
+    len = num * 4;
+  for (i = 0; i < len; i++)
+    {
+      int c = unsigned_chars ? (grub_uint8_t) msg[i] : (grub_int8_t) msg[i];
+
+      val = c + (val << 8);
+      if ((i % 4) == 3)
+	{
+	  *buf++ = val;
+	  val = pad;
+	  num--;
+	}
+    }
+  if (--num >= 0)
+    *buf++ = val;
+  while (--num >= 0)
+    *buf++ = pad;
+}
+
+static void
+grub_ext2_dx_tea_transform (grub_uint32_t buf[4], const grub_uint32_t in[4])
+{
+  grub_uint32_t sum = 0;
+  grub_uint32_t b0 = buf[0], b1 = buf[1];
+  grub_uint32_t a = in[0], b = in[1], c = in[2], d = in[3];
+  int n = 16;
+
+  do
+    {
+      sum += 0x9e3779b9;
+      b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+      b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+    }
+  while (--n);
+
+  buf[0] += b0;
+  buf[1] += b1;
+}
+
+#define EXT2_MD4_F(x, y, z)	((z) ^ ((x) & ((y) ^ (z))))
+#define EXT2_MD4_G(x, y, z)	(((x) & (y)) + (((x) ^ (y)) & (z)))
+#define EXT2_MD4_H(x, y, z)	((x) ^ (y) ^ (z))
+#define EXT2_MD4_ROUND(f, a, b, c, d, x, s)	\
+  (a += f (b, c, d) + (x), a = EXT2_ROL32 (a, s))
+#define EXT2_MD4_K2	013240474631U
+#define EXT2_MD4_K3	015666365641U
+
+static void
+grub_ext2_dx_half_md4_transform (grub_uint32_t buf[4],
+				 const grub_uint32_t in[8])
+{
+  grub_uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+  EXT2_MD4_ROUND (EXT2_MD4_F, a, b, c, d, in[0], 3);
+  EXT2_MD4_ROUND (EXT2_MD4_F, d, a, b, c, in[1], 7);
+  EXT2_MD4_ROUND (EXT2_MD4_F, c, d, a, b, in[2], 11);
+  EXT2_MD4_ROUND (EXT2_MD4_F, b, c, d, a, in[3], 19);
+  EXT2_MD4_ROUND (EXT2_MD4_F, a, b, c, d, in[4], 3);
+  EXT2_MD4_ROUND (EXT2_MD4_F, d, a, b, c, in[5], 7);
+  EXT2_MD4_ROUND (EXT2_MD4_F, c, d, a, b, in[6], 11);
+  EXT2_MD4_ROUND (EXT2_MD4_F, b, c, d, a, in[7], 19);
+
+  EXT2_MD4_ROUND (EXT2_MD4_G, a, b, c, d, in[1] + EXT2_MD4_K2, 3);
+  EXT2_MD4_ROUND (EXT2_MD4_G, d, a, b, c, in[3] + EXT2_MD4_K2, 5);
+  EXT2_MD4_ROUND (EXT2_MD4_G, c, d, a, b, in[5] + EXT2_MD4_K2, 9);
+  EXT2_MD4_ROUND (EXT2_MD4_G, b, c, d, a, in[7] + EXT2_MD4_K2, 13);
+  EXT2_MD4_ROUND (EXT2_MD4_G, a, b, c, d, in[0] + EXT2_MD4_K2, 3);
+  EXT2_MD4_ROUND (EXT2_MD4_G, d, a, b, c, in[2] + EXT2_MD4_K2, 5);
+  EXT2_MD4_ROUND (EXT2_MD4_G, c, d, a, b, in[4] + EXT2_MD4_K2, 9);
+  EXT2_MD4_ROUND (EXT2_MD4_G, b, c, d, a, in[6] + EXT2_MD4_K2, 13);
+
+  EXT2_MD4_ROUND (EXT2_MD4_H, a, b, c, d, in[3] + EXT2_MD4_K3, 3);
+  EXT2_MD4_ROUND (EXT2_MD4_H, d, a, b, c, in[7] + EXT2_MD4_K3, 9);
+  EXT2_MD4_ROUND (EXT2_MD4_H, c, d, a, b, in[2] + EXT2_MD4_K3, 11);
+  EXT2_MD4_ROUND (EXT2_MD4_H, b, c, d, a, in[6] + EXT2_MD4_K3, 15);
+  EXT2_MD4_ROUND (EXT2_MD4_H, a, b, c, d, in[1] + EXT2_MD4_K3, 3);
+  EXT2_MD4_ROUND (EXT2_MD4_H, d, a, b, c, in[5] + EXT2_MD4_K3, 9);
+  EXT2_MD4_ROUND (EXT2_MD4_H, c, d, a, b, in[0] + EXT2_MD4_K3, 11);
+  EXT2_MD4_ROUND (EXT2_MD4_H, b, c, d, a, in[4] + EXT2_MD4_K3, 15);
+
+  buf[0] += a;
+  buf[1] += b;
+  buf[2] += c;
+  buf[3] += d;
+}
+
+/* Hash NAME the way the directory index of DATA does with hash function
+   VERSION.  */
+static grub_uint32_t
+grub_ext2_dx_hash (struct grub_ext2_data *data, const char *name, int len,
+		   int version)
+{
+  grub_uint32_t buf[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+  grub_uint32_t in[8];
+  grub_uint32_t hash;
+  int unsigned_chars = 0;
+  int i;
+
+  for (i = 0; i < 4; i++)
+    if (data->sblock.hash_seed[i])
+      break;
+  if (i < 4)
+    for (i = 0; i < 4; i++)
+      buf[i] = grub_le_to_cpu32 (data->sblock.hash_seed[i]);
+
+  if (data->sblock.flags
+      & grub_cpu_to_le32_compile_time (EXT2_FLAGS_UNSIGNED_HASH))
+    unsigned_chars = 1;
+
+  switch (version)
+    {
+    case EXT2_DX_HASH_LEGACY:
+      hash = grub_ext2_dx_hack_hash (name, len, unsigned_chars);
+      break;
+    case EXT2_DX_HASH_HALF_MD4:
+      for (; len > 0; len -= 32, name += 32)
+	{
+	  grub_ext2_dx_str2hashbuf (name, len, in, 8, unsigned_chars);
+	  grub_ext2_dx_half_md4_transform (buf, in);
+	}
+      hash = buf[1];
+      break;
+    case EXT2_DX_HASH_TEA:
+      for (; len > 0; len -= 16, name += 16)
+	{
+	  grub_ext2_dx_str2hashbuf (name, len, in, 4, unsigned_chars);
+	  grub_ext2_dx_tea_transform (buf, in);
+	}
+      hash = buf[0];
+      break;
+    default:
+      return 0;
+    }
+
+  hash &= ~1;
+  /* This value marks the end of a directory.  */
+  if (hash == (0x7fffffffU << 1))
+    hash = (0x7fffffffU - 1) << 1;
+  return hash;
+}
+
+/* One level of the directory index being walked.  */
+struct grub_ext2_dx_frame
+{
+  char *block;
+  struct ext2_dx_entry *entries;
+  unsigned count;
+  unsigned at;
+};
+
+/* The directory block FRAME points to.  */
+static grub_uint32_t
+grub_ext2_dx_block (struct grub_ext2_dx_frame *frame)
+{
+  /* The top bits are reserved.  */
+  return grub_le_to_cpu32 (frame->entries[frame->at].block) & 0x0fffffff;
+}
+
+/* Read directory block BLOCK of DIRO holding index entries at OFFSET into
+   FRAME and find the entry covering HASH.  Return 0 if the block doesn't
+   look like an index block.  */
+static int
+grub_ext2_dx_read_frame (struct grub_fshelp_node *diro, grub_uint32_t block,
+			 grub_size_t offset, grub_uint32_t hash,
+			 struct grub_ext2_dx_frame *frame)
+{
+  grub_size_t blocksize = EXT2_BLOCK_SIZE (diro->data);
+  struct ext2_dx_countlimit *cl;
+  unsigned limit, lo, hi;
+
+  if (grub_ext2_read_file (diro, 0, 0, (grub_off_t) block * blocksize,
+			   blocksize, frame->block) != (grub_ssize_t) blocksize)
+    return 0;
+
+  cl = (struct ext2_dx_countlimit *) (frame->block + offset);
+  frame->entries = (struct ext2_dx_entry *) cl;
+  limit = grub_le_to_cpu16 (cl->limit);
+  frame->count = grub_le_to_cpu16 (cl->count);
+  if (frame->count == 0 || frame->count > limit
+      || offset + limit * sizeof (struct ext2_dx_entry) > blocksize)
+    return 0;
+
+  /* The first entry covers all hashes below the second one.  */
+  lo = 1;
+  hi = frame->count;
+  while (lo < hi)
+    {
+      unsigned mid = lo + (hi - lo) / 2;
+
+      if (grub_le_to_cpu32 (frame->entries[mid].hash) > hash)
+	hi = mid;
+      else
+	lo = mid + 1;
+    }
+  frame->at = lo - 1;
+  return 1;
+}
+
+/* Find NAME through the directory index of DIR, if it has one.  */
+static int
+grub_ext2_lookup_name (grub_fshelp_node_t dir, const char *name,
+		       grub_fshelp_node_t *foundnode,
+		       enum grub_fshelp_filetype *foundtype)
+{
+  struct grub_ext2_data *data = dir->data;
+  grub_size_t blocksize = EXT2_BLOCK_SIZE (data);
+  struct grub_ext2_dx_frame frames[EXT2_DX_MAX_LEVELS];
+  struct ext2_dx_root_info *info;
+  grub_size_t len = grub_strlen (name);
+  grub_uint32_t hash;
+  char *buf, *leaf;
+  int version, levels, level;
+  int ret = 0;
+
+  if (! (data->sblock.feature_compatibility
+	 & grub_cpu_to_le32_compile_time (EXT2_FEATURE_COMPAT_DIR_INDEX))
+      || len > MAX_NAMELEN)
+    return 0;
+
+  if (! dir->inode_read)
+    {
+      if (grub_ext2_read_inode (data, dir->ino, &dir->inode))
+	return 0;
+      dir->inode_read = 1;
+    }
+
+  /* Hashes of encrypted or case-folded names aren't of NAME itself.  */
+  if ((dir->inode.flags
+       & grub_cpu_to_le32_compile_time (EXT2_INDEX_FLAG
+					| EXT4_ENCRYPT_FLAG
+					| EXT4_CASEFOLD_FLAG))
+      != grub_cpu_to_le32_compile_time (EXT2_INDEX_FLAG))
+    return 0;
+
+  buf = grub_malloc ((EXT2_DX_MAX_LEVELS + 1) * blocksize);
+  if (! buf)
+    return 0;
+  for (level = 0; level < EXT2_DX_MAX_LEVELS; level++)
+    frames[level].block = buf + level * blocksize;
+  leaf = buf + EXT2_DX_MAX_LEVELS * blocksize;
+
+  /* Read the root only for its info; the frame is filled in below.  */
+  if (grub_ext2_read_file (dir, 0, 0, 0, blocksize, frames[0].block)
+      != (grub_ssize_t) blocksize)
+    goto out;
+  info = (struct ext2_dx_root_info *) (frames[0].block
+				       + EXT2_DX_ROOT_INFO_OFFSET);
+  version = info->hash_version;
+  levels = info->indirect_levels + 1;
+  if (info->reserved_zero != 0 || info->info_length < sizeof (*info)
+      || version > EXT2_DX_HASH_TEA || levels > EXT2_DX_MAX_LEVELS)
+    goto out;
+  hash = grub_ext2_dx_hash (data, name, len, version);
+
+  if (! grub_ext2_dx_read_frame (dir, 0, EXT2_DX_ROOT_INFO_OFFSET
+				 + info->info_length, hash, &frames[0]))
+    goto out;
+  for (level = 1; level < levels; level++)
+    if (! grub_ext2_dx_read_frame (dir, grub_ext2_dx_block (&frames[level - 1]),
+				   sizeof (struct ext2_dirent), hash,
+				   &frames[level]))
+      goto out;
+
+  while (1)
+    {
+      grub_off_t leafpos;
+      grub_size_t pos = 0;
+
+      leafpos = (grub_off_t) grub_ext2_dx_block (&frames[levels - 1]) * blocksize;
+      if (grub_ext2_read_file (dir, 0, 0, leafpos, blocksize, leaf)
+	  != (grub_ssize_t) blocksize)
+	goto out;
+
+      while (pos + sizeof (struct ext2_dirent) <= blocksize)
+	{
+	  struct ext2_dirent *dirent = (struct ext2_dirent *) (leaf + pos);
+	  grub_size_t direntlen = grub_le_to_cpu16 (dirent->direntlen);
+
+	  if (direntlen < sizeof (struct ext2_dirent)
+	      || pos + direntlen > blocksize)
+	    goto out;
+
+	  if (dirent->inode != 0 && dirent->namelen == len
+	      && sizeof (struct ext2_dirent) + len <= direntlen
+	      && grub_memcmp (dirent + 1, name, len) == 0)
+	    {
+	      *foundnode = grub_ext2_dirent_node (dir, dirent, foundtype);
+	      ret = 1;
+	      goto out;
+	    }
+	  pos += direntlen;
+	}
+
+      /* Names with the same hash may spill over into the following
+	 blocks, whose first hash then has the low bit set.  */
+      for (level = levels - 1; level >= 0; level--)
+	if (frames[level].at + 1 < frames[level].count)
+	  break;
+      if (level < 0)
+	break;
+      frames[level].at++;
+      if ((grub_le_to_cpu32 (frames[level].entries[frames[level].at].hash)
+	   & ~1) != hash)
+	break;
+      for (level++; level < levels; level++)
+	if (! grub_ext2_dx_read_frame (dir,
+				       grub_ext2_dx_block (&frames[level - 1]),
+				       sizeof (struct ext2_dirent), 0,
+				       &frames[level]))
+	  goto out;
+    }
+
+  /* The index says there is no such name.  */
+  *foundnode = 0;
+  ret = 1;
+
+ out:
+  grub_free (buf);
+  return ret;
+}
+
+static grub_uint64_t
+grub_ext2_node_key (grub_fshelp_node_t node)
+{
+  return node->ino;
+}
+
+static grub_fshelp_node_t
+grub_ext2_node_from_key (grub_fshelp_node_t dir, grub_uint64_t key)
+{
+  struct grub_fshelp_node *node;
+
+  node = grub_malloc (sizeof (*node));
+  if (! node)
+    return 0;
+  node->data = dir->data;
+  node->ino = key;
+  node->inode_read = 0;
+  return node;
+}
+
+static const struct grub_fshelp_dcache_ops grub_ext2_dcache_ops =
+  {
+    .node_key = grub_ext2_node_key,
+    .node_from_key = grub_ext2_node_from_key
+  };
+
 /* Open a file named NAME and initialize FILE.  */
 static grub_err_t
 grub_ext2_open (struct grub_file *file, const char *name)
@@ -846,9 +1512,11 @@ grub_ext2_open (struct grub_file *file, const char *name)
       goto fail;
     }
 
-  err = grub_fshelp_find_file (name, &data->diropen, &fdiro,
-			       grub_ext2_iterate_dir,
-			       grub_ext2_read_symlink, GRUB_FSHELP_REG);
+  err = grub_fshelp_find_file_index (name, &data->diropen, &fdiro,
+				     grub_ext2_iterate_dir,
+				     grub_ext2_lookup_name,
+				     grub_ext2_read_symlink, GRUB_FSHELP_REG,
+				     data->disk, &grub_ext2_dcache_ops);
   if (err)
     goto fail;
 
@@ -861,6 +1529,8 @@ grub_ext2_open (struct grub_file *file, const char *name)
 
   grub_memcpy (data->inode, &fdiro->inode, sizeof (struct grub_ext2_inode));
   grub_free (fdiro);
+  /* DIROPEN now describes the file; remember its mapping from here on.  */
+  data->cache_mapping = 1;
 
   file->size = grub_le_to_cpu32 (data->inode->size);
   file->size |= ((grub_off_t) grub_le_to_cpu32 (data->inode->size_high)) << 32;
@@ -882,7 +1552,11 @@ grub_ext2_open (struct grub_file *file, const char *name)
 static grub_err_t
 grub_ext2_close (grub_file_t file)
 {
-  grub_free (file->data);
+  struct grub_ext2_data *data = file->data;
+
+  grub_free (data->extents);
+  grub_free (data->indir_window);
+  grub_free (data);
 
   grub_dl_unref (my_mod);
 
@@ -952,9 +1626,10 @@ grub_ext2_dir (grub_device_t device, const char *path, grub_fs_dir_hook_t hook,
   if (! ctx.data)
     goto fail;
 
-  grub_fshelp_find_file (path, &ctx.data->diropen, &fdiro,
-			 grub_ext2_iterate_dir, grub_ext2_read_symlink,
-			 GRUB_FSHELP_DIR);
+  grub_fshelp_find_file_index (path, &ctx.data->diropen, &fdiro,
+			       grub_ext2_iterate_dir, grub_ext2_lookup_name,
+			       grub_ext2_read_symlink, GRUB_FSHELP_DIR,
+			       ctx.data->disk, &grub_ext2_dcache_ops);
   if (grub_errno)
     goto fail;
 
@@ -184,6 +184,24 @@ struct grub_fat_data
   grub_uint32_t uuid;
 };
 
+/* A run of clusters contiguous on disk.  It covers the logical clusters
+   from LOGICAL up to the next run's LOGICAL (or the map's MAPPED).  */
+struct grub_fat_run
+{
+  grub_uint32_t logical;
+  grub_uint32_t cluster;
+};
+
+/* The part of a file's cluster chain walked so far.  */
+struct grub_fat_cluster_map
+{
+  struct grub_fat_run *runs;
+  grub_uint32_t n_runs;
+  grub_uint32_t n_runs_allocated;
+  grub_uint32_t mapped;
+  int complete;
+};
+
 struct grub_fshelp_node {
   grub_disk_t disk;
   struct grub_fat_data *data;
@@ -197,6 +215,8 @@ struct grub_fshelp_node {
   grub_uint32_t file_cluster;
   grub_uint32_t cur_cluster_num;
   grub_uint32_t cur_cluster;
+  /* Only set for opened files.  */
+  struct grub_fat_cluster_map *map;
 
 #ifdef MODE_EXFAT
   int is_contiguous;
@@ -448,6 +468,185 @@ grub_fat_mount (grub_disk_t disk)
   return 0;
 }
 
+/* Look up the cluster following CLUSTER in the FAT.  Returns a value at
+   or above DATA->cluster_eof_mark at the end of the chain.  */
+static grub_err_t
+grub_fat_next_cluster (grub_disk_t disk, struct grub_fat_data *data,
+		       grub_uint32_t cluster, grub_uint32_t *next)
+{
+  grub_uint32_t next_cluster = 0;
+  grub_uint32_t fat_offset;
+
+  switch (data->fat_size)
+    {
+    case 32:
+      fat_offset = cluster << 2;
+      break;
+    case 16:
+      fat_offset = cluster << 1;
+      break;
+    default:
+      /* case 12: */
+      fat_offset = cluster + (cluster >> 1);
+      break;
+    }
+
+  /* Read the FAT.  */
+  if (grub_disk_read (disk, data->fat_sector, fat_offset,
+		      (data->fat_size + 7) >> 3,
+		      (char *) &next_cluster))
+    return grub_errno;
+
+  next_cluster = grub_le_to_cpu32 (next_cluster);
+  switch (data->fat_size)
+    {
+    case 16:
+      next_cluster &= 0xFFFF;
+      break;
+    case 12:
+      if (cluster & 1)
+	next_cluster >>= 4;
+
+      next_cluster &= 0x0FFF;
+      break;
+    }
+
+  grub_dprintf ("fat", "fat_size=%d, next_cluster=%u\n",
+		data->fat_size, next_cluster);
+
+  if (next_cluster < data->cluster_eof_mark
+      && (next_cluster < 2 || next_cluster >= data->num_clusters))
+    return grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u",
+		       next_cluster);
+
+  *next = next_cluster;
+  return GRUB_ERR_NONE;
+}
+
+/* Walk the cluster chain of NODE until logical cluster LAST is mapped or
+   the chain ends.  */
+static grub_err_t
+grub_fat_map_extend (grub_disk_t disk, grub_fshelp_node_t node,
+		     grub_uint32_t last)
+{
+  struct grub_fat_cluster_map *map = node->map;
+
+  while (!map->complete && (map->n_runs == 0 || map->mapped <= last))
+    {
+      struct grub_fat_run *run;
+      grub_uint32_t cluster, next_cluster;
+
+      if (map->n_runs == 0)
+	{
+	  next_cluster = node->file_cluster;
+	  if (next_cluster < 2 || next_cluster >= node->data->num_clusters)
+	    {
+	      map->complete = 1;
+	      break;
+	    }
+	}
+      else
+	{
+	  run = &map->runs[map->n_runs - 1];
+	  cluster = run->cluster + (map->mapped - 1 - run->logical);
+	  if (grub_fat_next_cluster (disk, node->data, cluster, &next_cluster))
+	    return grub_errno;
+	  if (next_cluster >= node->data->cluster_eof_mark)
+	    {
+	      map->complete = 1;
+	      break;
+	    }
+	  if (next_cluster == cluster + 1)
+	    {
+	      map->mapped++;
+	      continue;
+	    }
+	}
+
+      if (map->n_runs == map->n_runs_allocated)
+	{
+	  grub_uint32_t n = map->n_runs_allocated ? map->n_runs_allocated * 2
+	    : 16;
+	  struct grub_fat_run *runs;
+
+	  runs = grub_realloc (map->runs, n * sizeof (runs[0]));
+	  if (!runs)
+	    return grub_errno;
+	  map->runs = runs;
+	  map->n_runs_allocated = n;
+	}
+      map->runs[map->n_runs].logical = map->mapped;
+      map->runs[map->n_runs].cluster = next_cluster;
+      map->n_runs++;
+      map->mapped++;
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+/* Read through the cluster map of NODE, one disk request per run.  */
+static grub_ssize_t
+grub_fat_read_mapped (grub_disk_t disk, grub_fshelp_node_t node,
+		      grub_disk_read_hook_t read_hook, void *read_hook_data,
+		      grub_uint32_t logical_cluster, grub_off_t offset,
+		      grub_size_t len, char *buf)
+{
+  struct grub_fat_cluster_map *map = node->map;
+  unsigned logical_cluster_bits = (node->data->cluster_bits
+				   + GRUB_DISK_SECTOR_BITS);
+  grub_uint32_t last;
+  grub_ssize_t ret = 0;
+
+  if (!len)
+    return 0;
+
+  last = logical_cluster + ((offset + len - 1) >> logical_cluster_bits);
+  if (grub_fat_map_extend (disk, node, last))
+    return -1;
+
+  while (len && logical_cluster < map->mapped)
+    {
+      grub_uint32_t lo = 0, hi = map->n_runs - 1, end;
+      grub_disk_addr_t sector;
+      grub_uint64_t size;
+
+      /* Find the last run starting at or before LOGICAL_CLUSTER.  */
+      while (lo < hi)
+	{
+	  grub_uint32_t mid = lo + (hi - lo + 1) / 2;
+	  if (map->runs[mid].logical <= logical_cluster)
+	    lo = mid;
+	  else
+	    hi = mid - 1;
+	}
+      end = lo + 1 < map->n_runs ? map->runs[lo + 1].logical : map->mapped;
+
+      sector = (node->data->cluster_sector
+		+ ((grub_disk_addr_t) (map->runs[lo].cluster - 2
+				       + logical_cluster - map->runs[lo].logical)
+		   << node->data->cluster_bits));
+      size = ((grub_uint64_t) (end - logical_cluster) << logical_cluster_bits)
+	- offset;
+      if (size > len)
+	size = len;
+
+      disk->read_hook = read_hook;
+      disk->read_hook_data = read_hook_data;
+      grub_disk_read (disk, sector, offset, size, buf);
+      disk->read_hook = 0;
+      if (grub_errno)
+	return -1;
+
+      len -= size;
+      buf += size;
+      ret += size;
+      logical_cluster = end;
+      offset = 0;
+    }
+
+  return ret;
+}
+
 static grub_ssize_t
 grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
 		    grub_disk_read_hook_t read_hook, void *read_hook_data,
@@ -501,6 +700,10 @@ grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
   logical_cluster = offset >> logical_cluster_bits;
   offset &= (1ULL << logical_cluster_bits) - 1;
 
+  if (node->map)
+    return grub_fat_read_mapped (disk, node, read_hook, read_hook_data,
+				 logical_cluster, offset, len, buf);
+
   if (logical_cluster < node->cur_cluster_num)
     {
       node->cur_cluster_num = 0;
@@ -509,60 +712,19 @@ grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
 
   while (len)
     {
+      grub_uint32_t next_cluster;
+      grub_size_t cluster_size = 1 << logical_cluster_bits;
+
       while (logical_cluster > node->cur_cluster_num)
 	{
-	  /* Find next cluster.  */
-	  grub_uint32_t next_cluster;
-	  grub_uint32_t fat_offset;
-
-	  switch (node->data->fat_size)
-	    {
-	    case 32:
-	      fat_offset = node->cur_cluster << 2;
-	      break;
-	    case 16:
-	      fat_offset = node->cur_cluster << 1;
-	      break;
-	    default:
-	      /* case 12: */
-	      fat_offset = node->cur_cluster + (node->cur_cluster >> 1);
-	      break;
-	    }
-
-	  /* Read the FAT.  */
-	  if (grub_disk_read (disk, node->data->fat_sector, fat_offset,
-			      (node->data->fat_size + 7) >> 3,
-			      (char *) &next_cluster))
+	  if (grub_fat_next_cluster (disk, node->data, node->cur_cluster,
+				     &next_cluster))
 	    return -1;
 
-	  next_cluster = grub_le_to_cpu32 (next_cluster);
-	  switch (node->data->fat_size)
-	    {
-	    case 16:
-	      next_cluster &= 0xFFFF;
-	      break;
-	    case 12:
-	      if (node->cur_cluster & 1)
-		next_cluster >>= 4;
-
-	      next_cluster &= 0x0FFF;
-	      break;
-	    }
-
-	  grub_dprintf ("fat", "fat_size=%d, next_cluster=%u\n",
-			node->data->fat_size, next_cluster);
-
 	  /* Check the end.  */
 	  if (next_cluster >= node->data->cluster_eof_mark)
 	    return ret;
 
-	  if (next_cluster < 2 || next_cluster >= node->data->num_clusters)
-	    {
-	      grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u",
-			  next_cluster);
-	      return -1;
-	    }
-
 	  node->cur_cluster = next_cluster;
 	  node->cur_cluster_num++;
 	}
@@ -571,7 +733,23 @@ grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
       sector = (node->data->cluster_sector
 		+ ((node->cur_cluster - 2)
 		   << node->data->cluster_bits));
-      size = (1 << logical_cluster_bits) - offset;
+      size = cluster_size - offset;
+
+      /* Fold the following clusters into the same read while they are
+	 contiguous on disk.  */
+      while (size < len)
+	{
+	  if (grub_fat_next_cluster (disk, node->data, node->cur_cluster,
+				     &next_cluster))
+	    return -1;
+	  if (next_cluster != node->cur_cluster + 1)
+	    break;
+	  node->cur_cluster = next_cluster;
+	  node->cur_cluster_num++;
+	  logical_cluster++;
+	  size += cluster_size;
+	}
+
       if (size > len)
 	size = len;
 
@@ -900,6 +1078,7 @@ static grub_err_t lookup_file (grub_fshelp_node_t node,
 	    (*foundnode)->file_cluster = node->data->root_cluster;
 #endif
 	  (*foundnode)->cur_cluster_num = ~0U;
+	  (*foundnode)->map = 0;
 	  (*foundnode)->data = node->data;
 	  (*foundnode)->disk = node->disk;
 
@@ -942,6 +1121,7 @@ grub_fat_dir (grub_device_t device, const char *path, grub_fs_dir_hook_t hook,
     .file_cluster = data->root_cluster,
     .cur_cluster_num = ~0U,
     .cur_cluster = 0,
+    .map = 0,
 #ifdef MODE_EXFAT
     .is_contiguous = 0,
 #endif
@@ -1010,6 +1190,7 @@ grub_fat_open (grub_file_t file, const char *name)
     .file_cluster = data->root_cluster,
     .cur_cluster_num = ~0U,
     .cur_cluster = 0,
+    .map = 0,
 #ifdef MODE_EXFAT
     .is_contiguous = 0,
 #endif
@@ -1019,6 +1200,13 @@ grub_fat_open (grub_file_t file, const char *name)
   if (err)
     goto fail;
 
+  if (found != &root)
+    {
+      found->map = grub_zalloc (sizeof (*found->map));
+      if (!found->map)
+	goto fail;
+    }
+
   file->data = found;
   file->size = found->file_size;
 
@@ -1049,6 +1237,9 @@ grub_fat_close (grub_file_t file)
 {
   grub_fshelp_node_t node = file->data;
 
+  if (node->map)
+    grub_free (node->map->runs);
+  grub_free (node->map);
   grub_free (node->data);
   grub_free (node);
 
@@ -1070,6 +1261,7 @@ grub_fat_label (grub_device_t device, char **label)
     .file_size = 0,
     .cur_cluster_num = ~0U,
     .cur_cluster = 0,
+    .map = 0,
     .is_contiguous = 0,
   };
 
@@ -1135,6 +1327,7 @@ grub_fat_label (grub_device_t device, char **label)
     .file_size = 0,
     .cur_cluster_num = ~0U,
     .cur_cluster = 0,
+    .map = 0,
   };
 
   *label = 0;
@@ -21,6 +21,7 @@
 #include <grub/mm.h>
 #include <grub/misc.h>
 #include <grub/disk.h>
+#include <grub/partition.h>
 #include <grub/fshelp.h>
 #include <grub/dl.h>
 #include <grub/i18n.h>
@@ -36,6 +37,247 @@ typedef grub_err_t (*lookup_file_func) (grub_fshelp_node_t dir,
 					enum grub_fshelp_filetype *foundtype);
 typedef char *(*read_symlink_func) (grub_fshelp_node_t node);
 
+/* Directory entry cache.  */
+#define DCACHE_SIZE		512
+#define DCACHE_HASH_SIZE	256
+#define DCACHE_MAX_NAMELEN	255
+
+struct dcache_entry
+{
+  /* Next entry in the same hash bucket.  */
+  struct dcache_entry *next;
+  /* Neighbours in the LRU list, most recently used first.  */
+  struct dcache_entry *lru_prev;
+  struct dcache_entry *lru_next;
+  grub_uint32_t hash;
+
+  enum grub_disk_dev_id dev_id;
+  unsigned long disk_id;
+  grub_disk_addr_t part_start;
+  const void *fs;
+  grub_uint8_t dir[GRUB_FSHELP_DCACHE_KEY_MAX];
+  grub_size_t dir_size;
+  /* CHILD_SIZE is 0 for a name known not to exist.  */
+  grub_uint8_t child[GRUB_FSHELP_DCACHE_KEY_MAX];
+  grub_size_t child_size;
+  grub_size_t name_len;
+  char name[0];
+};
+
+static struct dcache_entry *dcache_hash[DCACHE_HASH_SIZE];
+static struct dcache_entry *dcache_lru_head;
+static struct dcache_entry *dcache_lru_tail;
+static unsigned dcache_count;
+static unsigned long dcache_generation;
+
+static grub_uint32_t
+dcache_hash_bytes (grub_uint32_t hash, const void *buf, grub_size_t size)
+{
+  const grub_uint8_t *p = buf;
+
+  /* FNV-1a.  */
+  while (size--)
+    hash = (hash ^ *p++) * 16777619;
+  return hash;
+}
+
+static void
+dcache_unlink (struct dcache_entry *e)
+{
+  struct dcache_entry **p;
+
+  for (p = &dcache_hash[e->hash % DCACHE_HASH_SIZE]; *p; p = &(*p)->next)
+    if (*p == e)
+      {
+	*p = e->next;
+	break;
+      }
+
+  if (e->lru_prev)
+    e->lru_prev->lru_next = e->lru_next;
+  else
+    dcache_lru_head = e->lru_next;
+  if (e->lru_next)
+    e->lru_next->lru_prev = e->lru_prev;
+  else
+    dcache_lru_tail = e->lru_prev;
+  dcache_count--;
+}
+
+static void
+dcache_lru_push (struct dcache_entry *e)
+{
+  e->lru_prev = 0;
+  e->lru_next = dcache_lru_head;
+  if (dcache_lru_head)
+    dcache_lru_head->lru_prev = e;
+  else
+    dcache_lru_tail = e;
+  dcache_lru_head = e;
+}
+
+/* Drop everything if the disk contents may have changed since the
+   entries were made.  */
+static void
+dcache_validate (void)
+{
+  struct dcache_entry *e, *next;
+
+  if (dcache_generation == grub_disk_generation)
+    return;
+
+  for (e = dcache_lru_head; e; e = next)
+    {
+      next = e->lru_next;
+      grub_free (e);
+    }
+  grub_memset (dcache_hash, 0, sizeof (dcache_hash));
+  dcache_lru_head = dcache_lru_tail = 0;
+  dcache_count = 0;
+  dcache_generation = grub_disk_generation;
+}
+
+static grub_uint32_t
+dcache_key_hash (grub_disk_t disk, const void *fs, const void *dir,
+		 grub_size_t dir_size, const char *name, grub_size_t name_len,
+		 grub_disk_addr_t *part_start)
+{
+  grub_uint32_t hash = 2166136261U;
+
+  *part_start = grub_partition_get_start (disk->partition);
+  hash = dcache_hash_bytes (hash, &disk->dev->id, sizeof (disk->dev->id));
+  hash = dcache_hash_bytes (hash, &disk->id, sizeof (disk->id));
+  hash = dcache_hash_bytes (hash, part_start, sizeof (*part_start));
+  hash = dcache_hash_bytes (hash, &fs, sizeof (fs));
+  hash = dcache_hash_bytes (hash, dir, dir_size);
+  return dcache_hash_bytes (hash, name, name_len);
+}
+
+static struct dcache_entry *
+dcache_find (grub_disk_t disk, const void *fs,
+	     const void *dir, grub_size_t dir_size,
+	     const char *name, grub_size_t name_len,
+	     grub_uint32_t *hash_out, grub_disk_addr_t *part_start)
+{
+  struct dcache_entry *e;
+  grub_uint32_t hash;
+
+  hash = dcache_key_hash (disk, fs, dir, dir_size, name, name_len,
+			  part_start);
+  *hash_out = hash;
+
+  for (e = dcache_hash[hash % DCACHE_HASH_SIZE]; e; e = e->next)
+    if (e->hash == hash
+	&& e->dev_id == disk->dev->id && e->disk_id == disk->id
+	&& e->part_start == *part_start && e->fs == fs
+	&& e->dir_size == dir_size && e->name_len == name_len
+	&& grub_memcmp (e->dir, dir, dir_size) == 0
+	&& grub_memcmp (e->name, name, name_len) == 0)
+      return e;
+  return 0;
+}
+
+enum grub_fshelp_dcache_result
+grub_fshelp_dcache_lookup (grub_disk_t disk, const void *fs,
+			   const void *dir, grub_size_t dir_size,
+			   const char *name, grub_size_t name_len,
+			   void *child, grub_size_t child_size)
+{
+  struct dcache_entry *e;
+  grub_uint32_t hash;
+  grub_disk_addr_t part_start;
+
+  if (!disk || dir_size > GRUB_FSHELP_DCACHE_KEY_MAX)
+    return GRUB_FSHELP_DCACHE_MISS;
+
+  dcache_validate ();
+
+  e = dcache_find (disk, fs, dir, dir_size, name, name_len,
+		   &hash, &part_start);
+  if (!e)
+    return GRUB_FSHELP_DCACHE_MISS;
+
+  if (e->child_size && e->child_size != child_size)
+    return GRUB_FSHELP_DCACHE_MISS;
+
+  if (e != dcache_lru_head)
+    {
+      e->lru_prev->lru_next = e->lru_next;
+      if (e->lru_next)
+	e->lru_next->lru_prev = e->lru_prev;
+      else
+	dcache_lru_tail = e->lru_prev;
+      dcache_lru_push (e);
+    }
+
+  if (!e->child_size)
+    return GRUB_FSHELP_DCACHE_ABSENT;
+
+  grub_memcpy (child, e->child, child_size);
+  return GRUB_FSHELP_DCACHE_FOUND;
+}
+
+void
+grub_fshelp_dcache_insert (grub_disk_t disk, const void *fs,
+			   const void *dir, grub_size_t dir_size,
+			   const char *name, grub_size_t name_len,
+			   const void *child, grub_size_t child_size)
+{
+  struct dcache_entry *e;
+  grub_uint32_t hash;
+  grub_disk_addr_t part_start;
+
+  if (!disk || dir_size > GRUB_FSHELP_DCACHE_KEY_MAX
+      || child_size > GRUB_FSHELP_DCACHE_KEY_MAX
+      || name_len > DCACHE_MAX_NAMELEN)
+    return;
+
+  dcache_validate ();
+
+  e = dcache_find (disk, fs, dir, dir_size, name, name_len,
+		   &hash, &part_start);
+  if (e)
+    dcache_unlink (e);
+  else if (dcache_count >= DCACHE_SIZE)
+    {
+      e = dcache_lru_tail;
+      dcache_unlink (e);
+      grub_free (e);
+      e = 0;
+    }
+
+  if (!e)
+    {
+      /* Callers may be about to report an error of their own.  */
+      grub_err_t saved_errno = grub_errno;
+
+      e = grub_malloc (sizeof (*e) + name_len);
+      if (!e)
+	{
+	  grub_errno = saved_errno;
+	  return;
+	}
+    }
+
+  e->hash = hash;
+  e->dev_id = disk->dev->id;
+  e->disk_id = disk->id;
+  e->part_start = part_start;
+  e->fs = fs;
+  grub_memcpy (e->dir, dir, dir_size);
+  e->dir_size = dir_size;
+  e->child_size = child ? child_size : 0;
+  if (child)
+    grub_memcpy (e->child, child, child_size);
+  e->name_len = name_len;
+  grub_memcpy (e->name, name, name_len);
+
+  e->next = dcache_hash[hash % DCACHE_HASH_SIZE];
+  dcache_hash[hash % DCACHE_HASH_SIZE] = e;
+  dcache_lru_push (e);
+  dcache_count++;
+}
+
 struct stack_element {
   struct stack_element *parent;
   grub_fshelp_node_t node;
@@ -49,6 +291,13 @@ struct grub_fshelp_find_file_ctx
   const char *path;
   grub_fshelp_node_t rootnode;
 
+  /* Directory entry cache, if the filesystem uses it.  */
+  grub_disk_t disk;
+  const struct grub_fshelp_dcache_ops *dcache;
+
+  /* Indexed directory lookup, if the filesystem has one.  */
+  grub_fshelp_lookup_name_t lookup_name;
+
   /* Global options. */
   int symlinknest;
 
@@ -115,8 +364,25 @@ struct grub_fshelp_find_file_iter_ctx
   const char *name;
   grub_fshelp_node_t *foundnode;
   enum grub_fshelp_filetype *foundtype;
+
+  /* Directory entry cache to fill with the entries seen, or NULL.  */
+  struct grub_fshelp_find_file_ctx *find_ctx;
+  grub_uint64_t dirkey;
+  unsigned filled;
 };
 
+/* What a name resolves to in the directory entry cache.  */
+struct dcache_child
+{
+  grub_uint64_t key;
+  grub_uint32_t type;
+};
+
+/* At most this many entries are added to the directory entry cache while
+   scanning one directory, so that a huge directory doesn't push out the
+   entries for the path leading to it.  */
+#define DCACHE_MAX_FILL		(DCACHE_SIZE / 2)
+
 /* Helper for grub_fshelp_find_file.  */
 static int
 find_file_iter (const char *filename, enum grub_fshelp_filetype filetype,
@@ -124,7 +390,25 @@ find_file_iter (const char *filename, enum grub_fshelp_filetype filetype,
 {
   struct grub_fshelp_find_file_iter_ctx *ctx = data;
 
-  if (filetype == GRUB_FSHELP_UNKNOWN ||
+  /* Every entry has to be looked at anyway, so remember them all: the
+     next files opened are likely to be in the same directory.  */
+  if (ctx->find_ctx && filetype != GRUB_FSHELP_UNKNOWN
+      && ctx->filled < DCACHE_MAX_FILL)
+    {
+      struct grub_fshelp_find_file_ctx *find_ctx = ctx->find_ctx;
+      struct dcache_child child = {
+	.key = find_ctx->dcache->node_key (node),
+	.type = filetype
+      };
+
+      grub_fshelp_dcache_insert (find_ctx->disk, find_ctx->dcache,
+				 &ctx->dirkey, sizeof (ctx->dirkey),
+				 filename, grub_strlen (filename),
+				 &child, sizeof (child));
+      ctx->filled++;
+    }
+
+  if (filetype == GRUB_FSHELP_UNKNOWN || *ctx->foundnode ||
       ((filetype & GRUB_FSHELP_CASE_INSENSITIVE)
        ? grub_strcasecmp (ctx->name, filename)
        : grub_strcmp (ctx->name, filename)))
@@ -133,31 +417,101 @@ find_file_iter (const char *filename, enum grub_fshelp_filetype filetype,
       return 0;
     }
 
-  /* The node is found, stop iterating over the nodes.  */
+  /* The node is found, stop iterating over the nodes unless the rest of
+     the directory still has to go into the cache.  */
   *ctx->foundnode = node;
   *ctx->foundtype = filetype;
-  return 1;
+  return !ctx->find_ctx || ctx->filled >= DCACHE_MAX_FILL;
 }
 
 static grub_err_t
 directory_find_file (grub_fshelp_node_t node, const char *name, grub_fshelp_node_t *foundnode,
-		     enum grub_fshelp_filetype *foundtype, iterate_dir_func iterate_dir)
+		     enum grub_fshelp_filetype *foundtype, iterate_dir_func iterate_dir,
+		     struct grub_fshelp_find_file_ctx *find_ctx, grub_uint64_t dirkey)
 {
   int found;
   struct grub_fshelp_find_file_iter_ctx ctx = {
     .foundnode = foundnode,
     .foundtype = foundtype,
-    .name = name
+    .name = name,
+    .find_ctx = find_ctx->dcache ? find_ctx : NULL,
+    .dirkey = dirkey,
+    .filled = 0
   };
   found = iterate_dir (node, find_file_iter, &ctx);
   if (! found)
     {
+      /* An error past the entry looked for doesn't matter.  */
+      if (*foundnode)
+	grub_errno = GRUB_ERR_NONE;
       if (grub_errno)
 	return grub_errno;
     }
   return GRUB_ERR_NONE;
 }
 
+/* Look NAME up in the current directory, going through the directory
+   entry cache and the directory index if CTX has them.  */
+static grub_err_t
+find_name (const char *name, grub_fshelp_node_t *foundnode,
+	   enum grub_fshelp_filetype *foundtype,
+	   iterate_dir_func iterate_dir, lookup_file_func lookup_file,
+	   struct grub_fshelp_find_file_ctx *ctx)
+{
+  grub_fshelp_node_t dir = ctx->currnode->node;
+  struct dcache_child child;
+  grub_uint64_t dirkey = 0;
+  grub_err_t err;
+
+  if (ctx->dcache)
+    {
+      dirkey = ctx->dcache->node_key (dir);
+      switch (grub_fshelp_dcache_lookup (ctx->disk, ctx->dcache,
+					 &dirkey, sizeof (dirkey),
+					 name, grub_strlen (name),
+					 &child, sizeof (child)))
+	{
+	case GRUB_FSHELP_DCACHE_FOUND:
+	  *foundnode = ctx->dcache->node_from_key (dir, child.key);
+	  if (!*foundnode)
+	    return grub_errno;
+	  *foundtype = child.type;
+	  return GRUB_ERR_NONE;
+	case GRUB_FSHELP_DCACHE_ABSENT:
+	  return GRUB_ERR_NONE;
+	case GRUB_FSHELP_DCACHE_MISS:
+	  break;
+	}
+    }
+
+  if (lookup_file)
+    err = lookup_file (dir, name, foundnode, foundtype);
+  else if (ctx->lookup_name
+	   && ctx->lookup_name (dir, name, foundnode, foundtype))
+    err = grub_errno;
+  else
+    {
+      /* The index couldn't be used; whatever went wrong with it, the
+	 directory itself may still be fine.  */
+      grub_errno = GRUB_ERR_NONE;
+      err = directory_find_file (dir, name, foundnode, foundtype,
+				 iterate_dir, ctx, dirkey);
+    }
+
+  if (err || !ctx->dcache)
+    return err;
+
+  if (*foundnode)
+    {
+      child.key = ctx->dcache->node_key (*foundnode);
+      child.type = *foundtype;
+    }
+  grub_fshelp_dcache_insert (ctx->disk, ctx->dcache, &dirkey, sizeof (dirkey),
+			     name, grub_strlen (name),
+			     *foundnode ? &child : NULL, sizeof (child));
+  return GRUB_ERR_NONE;
+}
+
 static grub_err_t
 find_file (char *currpath,
 	   iterate_dir_func iterate_dir, lookup_file_func lookup_file,
@@ -202,10 +556,8 @@ find_file (char *currpath,
       /* Iterate over the directory.  */
       c = *next;
       *next = '\0';
-      if (lookup_file)
-	err = lookup_file (ctx->currnode->node, name, &foundnode, &foundtype);
-      else
-	err = directory_find_file (ctx->currnode->node, name, &foundnode, &foundtype, iterate_dir);
+      err = find_name (name, &foundnode, &foundtype,
+		       iterate_dir, lookup_file, ctx);
       *next = c;
 
       if (err)
@@ -264,11 +616,17 @@ grub_fshelp_find_file_real (const char *path, grub_fshelp_node_t rootnode,
 			    iterate_dir_func iterate_dir,
 			    lookup_file_func lookup_file,
 			    read_symlink_func read_symlink,
-			    enum grub_fshelp_filetype expecttype)
+			    enum grub_fshelp_filetype expecttype,
+			    grub_fshelp_lookup_name_t lookup_name,
+			    grub_disk_t disk,
+			    const struct grub_fshelp_dcache_ops *dcache)
 {
   struct grub_fshelp_find_file_ctx ctx = {
     .path = path,
     .rootnode = rootnode,
+    .disk = disk,
+    .dcache = dcache,
+    .lookup_name = lookup_name,
     .symlinknest = 0,
     .currnode = 0
   };
@@ -327,7 +685,7 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
 {
   return grub_fshelp_find_file_real (path, rootnode, foundnode,
 				     iterate_dir, NULL, 
-				     read_symlink, expecttype);
+				     read_symlink, expecttype, NULL, NULL, NULL);
 
 }
 
@@ -340,27 +698,81 @@ grub_fshelp_find_file_lookup (const char *path, grub_fshelp_node_t rootnode,
 {
   return grub_fshelp_find_file_real (path, rootnode, foundnode,
 				     NULL, lookup_file, 
-				     read_symlink, expecttype);
+				     read_symlink, expecttype, NULL, NULL, NULL);
 
 }
 
-/* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
-   beginning with the block POS.  READ_HOOK should be set before
-   reading a block from the file.  READ_HOOK_DATA is passed through as
-   the DATA argument to READ_HOOK.  GET_BLOCK is used to translate
-   file blocks to disk blocks.  The file is FILESIZE bytes big and the
-   blocks have a size of LOG2BLOCKSIZE (in log2).  */
-grub_ssize_t
-grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
-		       grub_disk_read_hook_t read_hook, void *read_hook_data,
-		       grub_off_t pos, grub_size_t len, char *buf,
-		       grub_disk_addr_t (*get_block) (grub_fshelp_node_t node,
-                                                      grub_disk_addr_t block),
-		       grub_off_t filesize, int log2blocksize,
-		       grub_disk_addr_t blocks_start)
+grub_err_t
+grub_fshelp_find_file_dcache (const char *path, grub_fshelp_node_t rootnode,
+			      grub_fshelp_node_t *foundnode,
+			      iterate_dir_func iterate_dir,
+			      read_symlink_func read_symlink,
+			      enum grub_fshelp_filetype expecttype,
+			      grub_disk_t disk,
+			      const struct grub_fshelp_dcache_ops *ops)
+{
+  return grub_fshelp_find_file_real (path, rootnode, foundnode,
+				     iterate_dir, NULL,
+				     read_symlink, expecttype, NULL, disk, ops);
+}
+
+grub_err_t
+grub_fshelp_find_file_index (const char *path, grub_fshelp_node_t rootnode,
+			     grub_fshelp_node_t *foundnode,
+			     iterate_dir_func iterate_dir,
+			     grub_fshelp_lookup_name_t lookup_name,
+			     read_symlink_func read_symlink,
+			     enum grub_fshelp_filetype expecttype,
+			     grub_disk_t disk,
+			     const struct grub_fshelp_dcache_ops *ops)
+{
+  return grub_fshelp_find_file_real (path, rootnode, foundnode,
+				     iterate_dir, NULL, read_symlink,
+				     expecttype, lookup_name, disk, ops);
+}
+
+/* Read BYTES bytes starting SKIP bytes into disk block START, or zero
+   them if START is 0.  */
+static grub_err_t
+read_run (grub_disk_t disk, grub_disk_read_hook_t read_hook,
+	  void *read_hook_data, grub_disk_addr_t start, int log2blocksize,
+	  grub_disk_addr_t blocks_start, grub_size_t skip, grub_size_t bytes,
+	  char *buf)
+{
+  if (!start)
+    {
+      grub_memset (buf, 0, bytes);
+      return GRUB_ERR_NONE;
+    }
+
+  disk->read_hook = read_hook;
+  disk->read_hook_data = read_hook_data;
+  grub_disk_read (disk, (start << log2blocksize) + blocks_start,
+		  skip, bytes, buf);
+  disk->read_hook = 0;
+  return grub_errno;
+}
+
+/* Read LEN bytes at byte offset POS from the file NODE on disk DISK into
+   BUF.  File blocks are mapped to disk blocks either one at a time by
+   GET_BLOCK or in runs by GET_EXTENT; either way, blocks that turn out to
+   be contiguous on disk are fetched with a single disk read.  */
+static grub_ssize_t
+read_file_real (grub_disk_t disk, grub_fshelp_node_t node,
+		grub_disk_read_hook_t read_hook, void *read_hook_data,
+		grub_off_t pos, grub_size_t len, char *buf,
+		grub_disk_addr_t (*get_block) (grub_fshelp_node_t node,
+					       grub_disk_addr_t block),
+		grub_fshelp_get_extent_t get_extent,
+		grub_off_t filesize, int log2blocksize,
+		grub_disk_addr_t blocks_start)
 {
   grub_disk_addr_t i, blockcnt;
-  int blocksize = 1 << (log2blocksize + GRUB_DISK_SECTOR_BITS);
+  int log2bytes = log2blocksize + GRUB_DISK_SECTOR_BITS;
+  grub_size_t blocksize = (grub_size_t) 1 << log2bytes;
+  /* Run of disk blocks not read yet.  RUN_START of 0 means a hole.  */
+  grub_disk_addr_t run_start = 0, run_len = 0;
+  grub_size_t run_skip = 0, run_bytes = 0;
 
   if (pos > filesize)
     {
@@ -373,57 +785,104 @@ grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
   if (pos + len > filesize)
     len = filesize - pos;
 
-  blockcnt = ((len + pos) + blocksize - 1) >> (log2blocksize + GRUB_DISK_SECTOR_BITS);
+  blockcnt = ((len + pos) + blocksize - 1) >> log2bytes;
 
-  for (i = pos >> (log2blocksize + GRUB_DISK_SECTOR_BITS); i < blockcnt; i++)
+  for (i = pos >> log2bytes; i < blockcnt; )
     {
-      grub_disk_addr_t blknr;
-      int blockoff = pos & (blocksize - 1);
-      int blockend = blocksize;
-
-      int skipfirst = 0;
+      grub_disk_addr_t blknr, count = blockcnt - i;
+      grub_size_t skip = 0, bytes;
 
-      blknr = get_block (node, i);
+      if (get_extent)
+	blknr = get_extent (node, i, &count);
+      else
+	{
+	  blknr = get_block (node, i);
+	  count = 1;
+	}
       if (grub_errno)
 	return -1;
 
-      blknr = blknr << log2blocksize;
-
-      /* Last block.  */
-      if (i == blockcnt - 1)
-	{
-	  blockend = (len + pos) & (blocksize - 1);
-
-	  /* The last portion is exactly blocksize.  */
-	  if (! blockend)
-	    blockend = blocksize;
-	}
+      if (count == 0 || count > blockcnt - i)
+	count = blockcnt - i;
 
+      bytes = (grub_size_t) count << log2bytes;
       /* First block.  */
-      if (i == (pos >> (log2blocksize + GRUB_DISK_SECTOR_BITS)))
+      if (i == (pos >> log2bytes))
 	{
-	  skipfirst = blockoff;
-	  blockend -= skipfirst;
+	  skip = pos & (blocksize - 1);
+	  bytes -= skip;
 	}
+      /* Last block.  */
+      if (i + count == blockcnt && ((len + pos) & (blocksize - 1)))
+	bytes -= blocksize - ((len + pos) & (blocksize - 1));
 
-      /* If the block number is 0 this block is not stored on disk but
-	 is zero filled instead.  */
-      if (blknr)
+      /* Extend the pending run if this one follows it on disk.  */
+      if (run_bytes
+	  && ((run_start == 0 && blknr == 0)
+	      || (run_start && blknr == run_start + run_len)))
 	{
-	  disk->read_hook = read_hook;
-	  disk->read_hook_data = read_hook_data;
-
-	  grub_disk_read (disk, blknr + blocks_start, skipfirst,
-			  blockend, buf);
-	  disk->read_hook = 0;
-	  if (grub_errno)
-	    return -1;
+	  run_len += count;
+	  run_bytes += bytes;
 	}
       else
-	grub_memset (buf, 0, blockend);
+	{
+	  if (run_bytes)
+	    {
+	      if (read_run (disk, read_hook, read_hook_data, run_start,
+			    log2blocksize, blocks_start, run_skip, run_bytes,
+			    buf))
+		return -1;
+	      buf += run_bytes;
+	    }
+	  run_start = blknr;
+	  run_len = count;
+	  run_skip = skip;
+	  run_bytes = bytes;
+	}
 
-      buf += blocksize - skipfirst;
+      i += count;
     }
 
+  if (run_bytes
+      && read_run (disk, read_hook, read_hook_data, run_start, log2blocksize,
+		   blocks_start, run_skip, run_bytes, buf))
+    return -1;
+
   return len;
 }
+
+/* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
+   beginning with the block POS.  READ_HOOK should be set before
+   reading a block from the file.  READ_HOOK_DATA is passed through as
+   the DATA argument to READ_HOOK.  GET_BLOCK is used to translate
+   file blocks to disk blocks.  The file is FILESIZE bytes big and the
+   blocks have a size of LOG2BLOCKSIZE (in log2).  */
+grub_ssize_t
+grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
+		       grub_disk_read_hook_t read_hook, void *read_hook_data,
+		       grub_off_t pos, grub_size_t len, char *buf,
+		       grub_disk_addr_t (*get_block) (grub_fshelp_node_t node,
+                                                      grub_disk_addr_t block),
+		       grub_off_t filesize, int log2blocksize,
+		       grub_disk_addr_t blocks_start)
+{
+  return read_file_real (disk, node, read_hook, read_hook_data, pos, len, buf,
+			 get_block, NULL, filesize, log2blocksize,
+			 blocks_start);
+}
+
+/* Like grub_fshelp_read_file, but GET_EXTENT maps a whole run of file
+   blocks at once.  */
+grub_ssize_t
+grub_fshelp_read_file_extents (grub_disk_t disk, grub_fshelp_node_t node,
+			       grub_disk_read_hook_t read_hook,
+			       void *read_hook_data,
+			       grub_off_t pos, grub_size_t len, char *buf,
+			       grub_fshelp_get_extent_t get_extent,
+			       grub_off_t filesize, int log2blocksize,
+			       grub_disk_addr_t blocks_start)
+{
+  return read_file_real (disk, node, read_hook, read_hook_data, pos, len, buf,
+			 NULL, get_extent, filesize, log2blocksize,
+			 blocks_start);
+}
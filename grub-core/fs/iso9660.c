@@ -225,7 +225,7 @@ iso9660_to_unixtime2 (const struct grub_iso9660_date2 *i, grub_int32_t *nix)
 static grub_err_t
 read_node (grub_fshelp_node_t node, grub_off_t off, grub_size_t len, char *buf)
 {
-  grub_size_t i = 0;
+  grub_size_t i = 0, j;
 
   while (len > 0)
     {
@@ -239,7 +239,20 @@ read_node (grub_fshelp_node_t node, grub_off_t off, grub_size_t len, char *buf)
 	}
       if (i == node->have_dirents)
 	return grub_error (GRUB_ERR_OUT_OF_RANGE, "read out of range");
-      toread = grub_le_to_cpu32 (node->dirents[i].size);
+      toread = grub_le_to_cpu32 (node->dirents[i].size) - off;
+      /* Sections of a multi-extent file usually follow each other on
+	 disk; read those in one go.  */
+      for (j = i; toread < len && j + 1 < node->have_dirents; j++)
+	{
+	  grub_uint32_t size = grub_le_to_cpu32 (node->dirents[j].size);
+
+	  if ((size & (GRUB_ISO9660_BLKSZ - 1))
+	      || (grub_le_to_cpu32 (node->dirents[j].first_sector)
+		  + size / GRUB_ISO9660_BLKSZ
+		  != grub_le_to_cpu32 (node->dirents[j + 1].first_sector)))
+	    break;
+	  toread += grub_le_to_cpu32 (node->dirents[j + 1].size);
+	}
       if (toread > len)
 	toread = len;
       err = grub_disk_read (node->data->disk,
@@ -101,13 +101,32 @@ static grub_err_t read_data (struct grub_ntfs_attr *at, grub_uint8_t *pa,
 			     grub_disk_read_hook_t read_hook,
 			     void *read_hook_data);
 
+/* Start walking the attributes of MFT.  The run and compression unit
+   caches of AT are left for free_attr to release: AT must start out
+   zeroed, and clearing runs_type makes the next read drop them.  */
 static void
 init_attr (struct grub_ntfs_attr *at, struct grub_ntfs_file *mft)
 {
   at->mft = mft;
   at->flags = (mft == &mft->data->mmft) ? GRUB_NTFS_AF_MMFT : 0;
   at->attr_nxt = mft->buf + u16at (mft->buf, 0x14);
-  at->attr_end = at->emft_buf = at->edat_buf = at->sbuf = NULL;
+  at->attr_end = at->emft_buf = at->edat_buf = NULL;
+  at->runs_type = 0;
+}
+
+static void
+free_attr_cache (struct grub_ntfs_attr *at)
+{
+  int i;
+
+  grub_free (at->runs);
+  at->runs = NULL;
+  at->n_runs = at->n_runs_allocated = 0;
+  for (i = 0; i < GRUB_NTFS_COMP_UNITS; i++)
+    {
+      grub_free (at->units[i].buf);
+      at->units[i].buf = NULL;
+    }
 }
 
 static void
@@ -115,7 +134,7 @@ free_attr (struct grub_ntfs_attr *at)
 {
   grub_free (at->emft_buf);
   grub_free (at->edat_buf);
-  grub_free (at->sbuf);
+  free_attr_cache (at);
 }
 
 static grub_uint8_t *
@@ -296,8 +315,96 @@ read_run_data (const grub_uint8_t *run, int nn, int sig)
   return grub_le_to_cpu64 (r);
 }
 
-grub_err_t
-grub_ntfs_read_run_list (struct grub_ntfs_rlst * ctx)
+static int
+use_run_cache (struct grub_ntfs_rlst *ctx)
+{
+  return ctx->attr && !(ctx->attr->flags & GRUB_NTFS_AF_GPOS);
+}
+
+/* Return the index of the first cached run of AT that ends after VCN.  */
+static grub_size_t
+search_runs (struct grub_ntfs_attr *at, grub_disk_addr_t vcn)
+{
+  grub_size_t lo = 0, hi = at->n_runs;
+
+  while (lo < hi)
+    {
+      grub_size_t mid = lo + (hi - lo) / 2;
+
+      if (at->runs[mid].vcn + at->runs[mid].len <= vcn)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+static struct grub_ntfs_run *
+find_run (struct grub_ntfs_attr *at, grub_disk_addr_t vcn)
+{
+  grub_size_t i = search_runs (at, vcn);
+
+  if (i < at->n_runs && at->runs[i].vcn <= vcn)
+    return &at->runs[i];
+  return NULL;
+}
+
+/* Remember a decoded run.  The cache is best effort: runs overlapping
+   known ones, or beyond GRUB_NTFS_MAX_RUNS, are not kept.  */
+static void
+add_run (struct grub_ntfs_attr *at, grub_disk_addr_t vcn,
+	 grub_disk_addr_t len, grub_disk_addr_t lcn)
+{
+  grub_size_t i;
+
+  if (len == 0 || at->n_runs >= GRUB_NTFS_MAX_RUNS)
+    return;
+
+  i = search_runs (at, vcn);
+  if (i < at->n_runs && at->runs[i].vcn < vcn + len)
+    return;
+
+  if (at->n_runs == at->n_runs_allocated)
+    {
+      grub_size_t n = at->n_runs_allocated ? at->n_runs_allocated * 2 : 16;
+      struct grub_ntfs_run *runs;
+
+      runs = grub_realloc (at->runs, n * sizeof (runs[0]));
+      if (!runs)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  return;
+	}
+      at->runs = runs;
+      at->n_runs_allocated = n;
+    }
+
+  grub_memmove (&at->runs[i + 1], &at->runs[i],
+		(at->n_runs - i) * sizeof (at->runs[0]));
+  at->runs[i].vcn = vcn;
+  at->runs[i].len = len;
+  at->runs[i].lcn = lcn;
+  at->n_runs++;
+}
+
+static void
+set_run (struct grub_ntfs_rlst *ctx, grub_disk_addr_t vcn,
+	 grub_disk_addr_t len, grub_disk_addr_t lcn)
+{
+  ctx->curr_vcn = vcn;
+  ctx->next_vcn = vcn + len;
+  ctx->curr_lcn = lcn;
+  if (lcn == 0)
+    ctx->flags |= GRUB_NTFS_RF_BLNK;
+  else
+    ctx->flags &= ~GRUB_NTFS_RF_BLNK;
+}
+
+/* Decode the next run of the run list into *VCN, *LEN and *LCN (0 for a
+   sparse run).  */
+static grub_err_t
+decode_run (struct grub_ntfs_rlst *ctx, grub_disk_addr_t *vcn,
+	    grub_disk_addr_t *len, grub_disk_addr_t *lcn)
 {
   grub_uint8_t c1, c2;
   grub_disk_addr_t val;
@@ -325,41 +432,94 @@ retry:
 				   "$DATA should be non-resident");
 
 	      run += u16at (run, 0x20);
-	      ctx->curr_lcn = 0;
+	      ctx->dec_lcn = 0;
 	      goto retry;
 	    }
 	}
       return grub_error (GRUB_ERR_BAD_FS, "run list overflown");
     }
-  ctx->curr_vcn = ctx->next_vcn;
-  ctx->next_vcn += read_run_data (run, c1, 0);	/* length of current VCN */
+  *vcn = ctx->dec_vcn;
+  *len = read_run_data (run, c1, 0);	/* length of current VCN */
   run += c1;
   val = read_run_data (run, c2, 1);	/* offset to previous LCN */
   run += c2;
-  ctx->curr_lcn += val;
-  if (val == 0)
-    ctx->flags |= GRUB_NTFS_RF_BLNK;
-  else
-    ctx->flags &= ~GRUB_NTFS_RF_BLNK;
+  ctx->dec_lcn += val;
+  ctx->dec_vcn += *len;
+  *lcn = val ? ctx->dec_lcn : 0;
   ctx->cur_run = run;
+
+  if (use_run_cache (ctx))
+    add_run (ctx->attr, *vcn, *len, *lcn);
+  return 0;
+}
+
+/* Move CTX to the run following the current one.  */
+grub_err_t
+grub_ntfs_read_run_list (struct grub_ntfs_rlst * ctx)
+{
+  grub_disk_addr_t vcn = 0, len = 0, lcn = 0;
+
+  if (use_run_cache (ctx))
+    {
+      struct grub_ntfs_run *r = find_run (ctx->attr, ctx->next_vcn);
+
+      if (r)
+	{
+	  set_run (ctx, r->vcn, r->len, r->lcn);
+	  return 0;
+	}
+    }
+
+  /* Runs served from the cache leave the decoder behind.  */
+  do
+    if (decode_run (ctx, &vcn, &len, &lcn))
+      return grub_errno;
+  while (vcn + len <= ctx->next_vcn);
+
+  set_run (ctx, vcn, len, lcn);
+  return 0;
+}
+
+/* Move CTX to the run containing VCN, which must not be before the
+   current position unless it is cached.  */
+grub_err_t
+grub_ntfs_seek_run_list (struct grub_ntfs_rlst *ctx, grub_disk_addr_t vcn)
+{
+  if (ctx->curr_vcn <= vcn && vcn < ctx->next_vcn)
+    return 0;
+
+  if (use_run_cache (ctx))
+    {
+      struct grub_ntfs_run *r = find_run (ctx->attr, vcn);
+
+      if (r)
+	{
+	  set_run (ctx, r->vcn, r->len, r->lcn);
+	  return 0;
+	}
+    }
+
+  while (ctx->next_vcn <= vcn)
+    if (grub_ntfs_read_run_list (ctx))
+      return grub_errno;
   return 0;
 }
 
 static grub_disk_addr_t
-grub_ntfs_read_block (grub_fshelp_node_t node, grub_disk_addr_t block)
+grub_ntfs_get_extent (grub_fshelp_node_t node, grub_disk_addr_t block,
+		      grub_disk_addr_t *count)
 {
   struct grub_ntfs_rlst *ctx;
 
   ctx = (struct grub_ntfs_rlst *) node;
-  if (block >= ctx->next_vcn)
-    {
-      if (grub_ntfs_read_run_list (ctx))
-	return -1;
-      return ctx->curr_lcn;
-    }
-  else
-    return (ctx->flags & GRUB_NTFS_RF_BLNK) ? 0 : (block -
-					 ctx->curr_vcn + ctx->curr_lcn);
+  if (grub_ntfs_seek_run_list (ctx, block))
+    return 0;
+
+  if (*count > ctx->next_vcn - block)
+    *count = ctx->next_vcn - block;
+  if (ctx->flags & GRUB_NTFS_RF_BLNK)
+    return 0;
+  return block - ctx->curr_vcn + ctx->curr_lcn;
 }
 
 static grub_err_t
@@ -392,8 +552,17 @@ read_data (struct grub_ntfs_attr *at, grub_uint8_t *pa, grub_uint8_t *dest,
   ctx->cur_run = pa + u16at (pa, 0x20);
 
   ctx->next_vcn = u32at (pa, 0x10);
+  ctx->curr_vcn = ctx->next_vcn;
+  ctx->dec_vcn = ctx->next_vcn;
   ctx->curr_lcn = 0;
 
+  /* The caches of AT belong to the attribute last read through it.  */
+  if (!(at->flags & GRUB_NTFS_AF_GPOS) && at->runs_type != pa[0])
+    {
+      free_attr_cache (at);
+      at->runs_type = pa[0];
+    }
+
   if ((pa[0xC] & GRUB_NTFS_FLAG_COMPRESSED)
       && !(at->flags & GRUB_NTFS_AF_GPOS))
     {
@@ -406,11 +575,8 @@ read_data (struct grub_ntfs_attr *at, grub_uint8_t *pa, grub_uint8_t *dest,
     }
 
   ctx->target_vcn = ofs >> (GRUB_NTFS_BLK_SHR + ctx->comp.log_spc);
-  while (ctx->next_vcn <= ctx->target_vcn)
-    {
-      if (grub_ntfs_read_run_list (ctx))
-	return grub_errno;
-    }
+  if (grub_ntfs_seek_run_list (ctx, ctx->target_vcn))
+    return grub_errno;
 
   if (at->flags & GRUB_NTFS_AF_GPOS)
     {
@@ -434,11 +600,11 @@ read_data (struct grub_ntfs_attr *at, grub_uint8_t *pa, grub_uint8_t *dest,
       return 0;
     }
 
-  grub_fshelp_read_file (ctx->comp.disk, (grub_fshelp_node_t) ctx,
-			 read_hook, read_hook_data, ofs, len,
-			 (char *) dest,
-			 grub_ntfs_read_block, ofs + len,
-			 ctx->comp.log_spc, 0);
+  grub_fshelp_read_file_extents (ctx->comp.disk, (grub_fshelp_node_t) ctx,
+				 read_hook, read_hook_data, ofs, len,
+				 (char *) dest,
+				 grub_ntfs_get_extent, ofs + len,
+				 ctx->comp.log_spc, 0);
   return grub_errno;
 }
 
@@ -753,6 +919,7 @@ grub_ntfs_iterate_dir (grub_fshelp_node_t dir,
   bmp = NULL;
 
   at = &attr;
+  grub_memset (at, 0, sizeof (*at));
   init_attr (at, mft);
   while (1)
     {
@@ -1094,9 +1261,6 @@ grub_ntfs_read (grub_file_t file, char *buf, grub_size_t len)
   struct grub_ntfs_file *mft;
 
   mft = &((struct grub_ntfs_data *) file->data)->cmft;
-  if (file->read_hook)
-    mft->attr.save_pos = 1;
-
   read_attr (&mft->attr, (grub_uint8_t *) buf, file->offset, len, 1,
 	     file->read_hook, file->read_hook_data);
   return (grub_errno) ? -1 : (grub_ssize_t) len;
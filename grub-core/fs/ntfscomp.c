@@ -304,131 +304,124 @@ read_block (struct grub_ntfs_rlst *ctx, grub_uint8_t *buf, grub_size_t num)
   return 0;
 }
 
-static grub_err_t
-ntfscomp (grub_uint8_t *dest, grub_disk_addr_t ofs,
-	  grub_size_t len, struct grub_ntfs_rlst *ctx)
+/* Return the compression unit starting at VCN decompressed, from the
+   cache of the attribute if possible.  */
+static grub_uint8_t *
+get_unit (struct grub_ntfs_rlst *ctx, grub_disk_addr_t vcn,
+	  grub_size_t unit_size)
 {
-  grub_err_t ret;
-  grub_disk_addr_t vcn;
+  struct grub_ntfs_attr *at = ctx->attr;
+  struct grub_ntfs_comp_unit *u, *victim = NULL;
+  void *file;
+  int i;
 
-  if (ctx->attr->sbuf)
+  for (i = 0; i < GRUB_NTFS_COMP_UNITS; i++)
     {
-      if ((ofs & (~(GRUB_NTFS_COM_LEN - 1))) == ctx->attr->save_pos)
+      u = &at->units[i];
+      if (u->buf && u->vcn == vcn)
 	{
-	  grub_disk_addr_t n;
-
-	  n = GRUB_NTFS_COM_LEN - (ofs - ctx->attr->save_pos);
-	  if (n > len)
-	    n = len;
-
-	  grub_memcpy (dest, ctx->attr->sbuf + ofs - ctx->attr->save_pos, n);
-	  if (grub_file_progress_hook && ctx->file)
-	    grub_file_progress_hook (0, 0, n, ctx->file);
-	  if (n == len)
-	    return 0;
-
-	  dest += n;
-	  len -= n;
-	  ofs += n;
+	  u->used = ++at->units_clock;
+	  return u->buf;
 	}
-    }
-  else
-    {
-      ctx->attr->sbuf = grub_malloc (GRUB_NTFS_COM_LEN);
-      if (ctx->attr->sbuf == NULL)
-	return grub_errno;
-      ctx->attr->save_pos = 1;
+      if (!victim || !u->buf || (victim->buf && u->used < victim->used))
+	victim = u;
     }
 
-  vcn = ctx->target_vcn = (ofs >> GRUB_NTFS_COM_LOG_LEN) * (GRUB_NTFS_COM_SEC >> ctx->comp.log_spc);
-  ctx->target_vcn &= ~0xFULL;
-  while (ctx->next_vcn <= ctx->target_vcn)
+  if (!victim->buf)
     {
-      if (grub_ntfs_read_run_list (ctx))
-	return grub_errno;
+      victim->buf = grub_malloc (unit_size);
+      if (!victim->buf)
+	return NULL;
     }
 
-  ctx->comp.comp_head = ctx->comp.comp_tail = 0;
-  ctx->comp.cbuf = grub_malloc (1 << (ctx->comp.log_spc + GRUB_NTFS_BLK_SHR));
-  if (!ctx->comp.cbuf)
-    return 0;
-
-  ret = 0;
+  if (grub_ntfs_seek_run_list (ctx, vcn))
+    goto fail;
+  ctx->target_vcn = vcn;
 
-  //ctx->comp.disk->read_hook = read_hook;
-  //ctx->comp.disk->read_hook_data = read_hook_data;
-
-  if ((vcn > ctx->target_vcn) &&
-      (read_block
-       (ctx, NULL, (vcn - ctx->target_vcn) >> (GRUB_NTFS_LOG_COM_SEC - ctx->comp.log_spc))))
+  /* The caller accounts for the progress of what it copies.  */
+  file = ctx->file;
+  ctx->file = 0;
+  if (read_block (ctx, victim->buf,
+		  unit_size >> GRUB_NTFS_COM_LOG_LEN))
     {
-      ret = grub_errno;
-      goto quit;
+      ctx->file = file;
+      goto fail;
     }
+  ctx->file = file;
 
-  if (ofs % GRUB_NTFS_COM_LEN)
-    {
-      grub_uint32_t t, n, o;
-      void *file = ctx->file;
+  victim->vcn = vcn;
+  victim->used = ++at->units_clock;
+  return victim->buf;
 
-      ctx->file = 0;
-
-      t = ctx->target_vcn << (ctx->comp.log_spc + GRUB_NTFS_BLK_SHR);
-      if (read_block (ctx, ctx->attr->sbuf, 1))
-	{
-	  ret = grub_errno;
-	  goto quit;
-	}
+ fail:
+  grub_free (victim->buf);
+  victim->buf = NULL;
+  return NULL;
+}
 
-      ctx->file = file;
+static grub_err_t
+ntfscomp (grub_uint8_t *dest, grub_disk_addr_t ofs,
+	  grub_size_t len, struct grub_ntfs_rlst *ctx)
+{
+  grub_err_t ret = 0;
+  int unit_log = ctx->comp.log_spc + GRUB_NTFS_BLK_SHR + 4;
+  grub_size_t unit_size = (grub_size_t) 1 << unit_log;
 
-      ctx->attr->save_pos = t;
-
-      o = ofs % GRUB_NTFS_COM_LEN;
-      n = GRUB_NTFS_COM_LEN - o;
-      if (n > len)
-	n = len;
-      grub_memcpy (dest, &ctx->attr->sbuf[o], n);
-      if (grub_file_progress_hook && ctx->file)
-	grub_file_progress_hook (0, 0, n, ctx->file);
-      if (n == len)
-	goto quit;
-      dest += n;
-      len -= n;
-    }
+  if (ctx->comp.log_spc > GRUB_NTFS_LOG_COM_SEC)
+    return grub_error (GRUB_ERR_BAD_FS,
+		       "compression with clusters larger than 4K");
 
-  if (read_block (ctx, dest, len / GRUB_NTFS_COM_LEN))
-    {
-      ret = grub_errno;
-      goto quit;
-    }
+  ctx->comp.cbuf = grub_malloc (1 << (ctx->comp.log_spc + GRUB_NTFS_BLK_SHR));
+  if (!ctx->comp.cbuf)
+    return grub_errno;
 
-  dest += (len / GRUB_NTFS_COM_LEN) * GRUB_NTFS_COM_LEN;
-  len = len % GRUB_NTFS_COM_LEN;
-  if (len)
+  while (len)
     {
-      grub_uint32_t t;
-      void *file = ctx->file;
+      grub_disk_addr_t vcn = (ofs >> unit_log) << 4;
+      grub_size_t o = ofs & (unit_size - 1), n;
 
-      ctx->file = 0;
-      t = ctx->target_vcn << (ctx->comp.log_spc + GRUB_NTFS_BLK_SHR);
-      if (read_block (ctx, ctx->attr->sbuf, 1))
+      if (o == 0 && len >= unit_size)
 	{
-	  ret = grub_errno;
-	  goto quit;
+	  /* Whole units go straight to the caller's buffer.  */
+	  n = len & ~(unit_size - 1);
+	  if (grub_ntfs_seek_run_list (ctx, vcn))
+	    {
+	      ret = grub_errno;
+	      goto quit;
+	    }
+	  ctx->target_vcn = vcn;
+	  if (read_block (ctx, dest, n >> GRUB_NTFS_COM_LOG_LEN))
+	    {
+	      ret = grub_errno;
+	      goto quit;
+	    }
 	}
+      else
+	{
+	  grub_uint8_t *unit;
 
-      ctx->attr->save_pos = t;
+	  unit = get_unit (ctx, vcn, unit_size);
+	  if (!unit)
+	    {
+	      ret = grub_errno;
+	      goto quit;
+	    }
+	  n = unit_size - o;
+	  if (n > len)
+	    n = len;
+	  grub_memcpy (dest, unit + o, n);
+	  if (grub_file_progress_hook && ctx->file)
+	    grub_file_progress_hook (0, 0, n, ctx->file);
+	}
 
-      grub_memcpy (dest, ctx->attr->sbuf, len);
-      if (grub_file_progress_hook && file)
-	grub_file_progress_hook (0, 0, len, file);
+      dest += n;
+      ofs += n;
+      len -= n;
     }
 
 quit:
-  //ctx->comp.disk->read_hook = 0;
-  if (ctx->comp.cbuf)
-    grub_free (ctx->comp.cbuf);
+  grub_free (ctx->comp.cbuf);
+  ctx->comp.cbuf = NULL;
   return ret;
 }
 
@@ -22,6 +22,7 @@
 #include <grub/mm.h>
 #include <grub/misc.h>
 #include <grub/disk.h>
+#include <grub/partition.h>
 #include <grub/dl.h>
 #include <grub/types.h>
 #include <grub/fshelp.h>
@@ -216,6 +217,136 @@ struct grub_fshelp_node
   } stack[1];
 };
 
+/* Decompressed data, fragment and metadata blocks, keyed by the disk and
+   the on-disk offset of the compressed block.  Shared by all mounts since
+   every open mounts afresh and fragment blocks are shared between files.  */
+#define SQUASH_CACHE_ENTRIES 64
+#define SQUASH_CACHE_BYTES (2 * 1024 * 1024)
+
+struct squash_cached_block
+{
+  unsigned long dev_id;
+  unsigned long disk_id;
+  grub_disk_addr_t part_start;
+  grub_uint64_t offset;
+  grub_uint64_t used;
+  grub_size_t size;
+  grub_size_t alloc;
+  char *buf;
+};
+
+static struct squash_cached_block block_cache[SQUASH_CACHE_ENTRIES];
+static grub_size_t block_cache_bytes;
+static grub_uint64_t block_cache_clock;
+static unsigned long block_cache_generation;
+
+static void
+block_cache_flush (void)
+{
+  unsigned i;
+
+  for (i = 0; i < SQUASH_CACHE_ENTRIES; i++)
+    {
+      grub_free (block_cache[i].buf);
+      block_cache[i].buf = 0;
+    }
+  block_cache_bytes = 0;
+}
+
+/* Return the block of CSIZE bytes at byte OFFSET of the disk, decompressed
+   into at most USIZE bytes.  *OUTSIZE is set to the decompressed size.  The
+   buffer belongs to the cache and is only valid until the next call.  */
+static char *
+read_compressed (struct grub_squash_data *data, grub_uint64_t offset,
+		 grub_size_t csize, grub_size_t usize, grub_size_t *outsize)
+{
+  grub_disk_addr_t part_start = grub_partition_get_start (data->disk->partition);
+  struct squash_cached_block *e, *victim = 0;
+  char *cbuf, *ubuf;
+  grub_ssize_t r;
+  unsigned i;
+
+  if (block_cache_generation != grub_disk_generation)
+    {
+      block_cache_flush ();
+      block_cache_generation = grub_disk_generation;
+    }
+
+  for (i = 0; i < SQUASH_CACHE_ENTRIES; i++)
+    {
+      e = &block_cache[i];
+      if (e->buf && e->offset == offset
+	  && e->dev_id == data->disk->dev->id
+	  && e->disk_id == data->disk->id
+	  && e->part_start == part_start)
+	{
+	  e->used = ++block_cache_clock;
+	  *outsize = e->size;
+	  return e->buf;
+	}
+    }
+
+  cbuf = grub_malloc (csize);
+  if (!cbuf)
+    return 0;
+  if (grub_disk_read (data->disk, offset >> GRUB_DISK_SECTOR_BITS,
+		      offset & (GRUB_DISK_SECTOR_SIZE - 1), csize, cbuf))
+    {
+      grub_free (cbuf);
+      return 0;
+    }
+  ubuf = grub_malloc (usize);
+  if (!ubuf)
+    {
+      grub_free (cbuf);
+      return 0;
+    }
+  r = data->decompress (cbuf, csize, 0, ubuf, usize, data);
+  grub_free (cbuf);
+  if (r < 0)
+    {
+      grub_free (ubuf);
+      return 0;
+    }
+
+  /* Make room: evict least recently used blocks until this one fits the
+     budget, but always keep a slot for it.  */
+  while (1)
+    {
+      struct squash_cached_block *lru = 0;
+
+      victim = 0;
+      for (i = 0; i < SQUASH_CACHE_ENTRIES; i++)
+	{
+	  e = &block_cache[i];
+	  if (!e->buf)
+	    victim = e;
+	  else if (!lru || e->used < lru->used)
+	    lru = e;
+	}
+      if (victim && block_cache_bytes + usize <= SQUASH_CACHE_BYTES)
+	break;
+      if (!lru)
+	break;
+      block_cache_bytes -= lru->alloc;
+      grub_free (lru->buf);
+      lru->buf = 0;
+    }
+
+  victim->dev_id = data->disk->dev->id;
+  victim->disk_id = data->disk->id;
+  victim->part_start = part_start;
+  victim->offset = offset;
+  victim->used = ++block_cache_clock;
+  victim->size = r;
+  victim->alloc = usize;
+  victim->buf = ubuf;
+  block_cache_bytes += usize;
+
+  *outsize = r;
+  return ubuf;
+}
+
 static grub_err_t
 read_chunk (struct grub_squash_data *data, void *buf, grub_size_t len,
 	    grub_uint64_t chunk_start, grub_off_t offset)
@@ -254,29 +385,26 @@ read_chunk (struct grub_squash_data *data, void *buf, grub_size_t len,
 	}
       else
 	{
-	  char *tmp;
-	  grub_size_t bsize = grub_le_to_cpu16 (d) & ~SQUASH_CHUNK_FLAGS; 
-	  grub_disk_addr_t a = chunk_start + 2;
-	  tmp = grub_malloc (bsize);
-	  if (!tmp)
-	    return grub_errno;
-	  /* FIXME: buffer uncompressed data.  */
-	  err = grub_disk_read (data->disk, (a >> GRUB_DISK_SECTOR_BITS),
-				a & (GRUB_DISK_SECTOR_SIZE - 1),
-				bsize, tmp);
-	  if (err)
-	    {
-	      grub_free (tmp);
-	      return err;
-	    }
+	  char *block;
+	  grub_size_t bsize = grub_le_to_cpu16 (d) & ~SQUASH_CHUNK_FLAGS;
+	  grub_size_t usize;
 
-	  if (data->decompress (tmp, bsize, offset,
-				buf, csize, data) < 0)
+	  block = read_compressed (data, chunk_start + 2, bsize,
+				   SQUASH_CHUNK_SIZE, &usize);
+	  if (!block)
+	    return grub_errno;
+	  /* Structures at the end of a table may be read past the end of
+	     the last chunk (e.g. the root inode).  */
+	  if (offset >= usize)
+	    grub_memset (buf, 0, csize);
+	  else if (offset + csize > usize)
 	    {
-	      grub_free (tmp);
-	      return grub_errno;
+	      grub_memcpy (buf, block + offset, usize - offset);
+	      grub_memset ((char *) buf + usize - offset, 0,
+			   offset + csize - usize);
 	    }
-	  grub_free (tmp);
+	  else
+	    grub_memcpy (buf, block + offset, csize);
 	}
       len -= csize;
       offset += csize;
@@ -314,6 +442,10 @@ lzo_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
       grub_free (udata);
       return -1;
     }
+  if (off > usize)
+    len = 0;
+  else if (len > usize - off)
+    len = usize - off;
   grub_memcpy (outbuf, udata + off, len);
   grub_free (udata);
   return len;
@@ -832,31 +964,18 @@ direct_read (struct grub_squash_data *data,
 	    & grub_cpu_to_le32_compile_time (SQUASH_BLOCK_UNCOMPRESSED)))
 	{
 	  char *block;
-	  grub_size_t csize;
+	  grub_size_t csize, usize;
 	  csize = grub_le_to_cpu32 (ino->block_sizes[i]) & ~SQUASH_BLOCK_FLAGS;
-	  block = grub_malloc (csize);
+	  block = read_compressed (data, ino->cumulated_block_sizes[i] + a,
+				   csize, data->blksz, &usize);
 	  if (!block)
 	    return -1;
-	  err = grub_disk_read (data->disk,
-				(ino->cumulated_block_sizes[i] + a)
-				>> GRUB_DISK_SECTOR_BITS,
-				(ino->cumulated_block_sizes[i] + a)
-				& (GRUB_DISK_SECTOR_SIZE - 1),
-				csize, block);
-	  if (err)
-	    {
-	      grub_free (block);
-	      return -1;
-	    }
-	  if (data->decompress (block, csize, boff, buf, curread, data)
-	      != (grub_ssize_t) curread)
+	  if (boff + curread > usize)
 	    {
-	      grub_free (block);
-	      if (!grub_errno)
-		grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
+	      grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
 	      return -1;
 	    }
-	  grub_free (block);
+	  grub_memcpy (buf, block + boff, curread);
 	}
       else
 	err = grub_disk_read (data->disk, 
@@ -935,32 +1054,20 @@ grub_squash_read (grub_file_t file, char *buf, grub_size_t len)
   else
     b = grub_le_to_cpu32 (ino->ino.file.offset) + off;
   
-  /* FIXME: cache uncompressed chunks.  */
   if (compressed)
     {
       char *block;
-      block = grub_malloc (grub_le_to_cpu32 (frag.size));
+      grub_size_t usize;
+      block = read_compressed (data, a, grub_le_to_cpu32 (frag.size),
+			       data->blksz, &usize);
       if (!block)
 	return -1;
-      err = grub_disk_read (data->disk,
-			    a >> GRUB_DISK_SECTOR_BITS,
-			    a & (GRUB_DISK_SECTOR_SIZE - 1),
-			    grub_le_to_cpu32 (frag.size), block);
-      if (err)
-	{
-	  grub_free (block);
-	  return -1;
-	}
-      if (data->decompress (block, grub_le_to_cpu32 (frag.size),
-			    b, buf, len, data)
-	  != (grub_ssize_t) len)
+      if (b > usize || len > usize - b)
 	{
-	  grub_free (block);
-	  if (!grub_errno)
-	    grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
+	  grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
 	  return -1;
 	}
-      grub_free (block);
+      grub_memcpy (buf, block + b, len);
     }
   else
     {
@@ -1015,5 +1122,6 @@ GRUB_MOD_INIT(squash4)
 GRUB_MOD_FINI(squash4)
 {
   grub_fs_unregister (&grub_squash_fs);
+  block_cache_flush ();
 }
 
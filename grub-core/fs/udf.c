@@ -423,13 +423,32 @@ grub_udf_read_icb (struct grub_udf_data *data,
   return 0;
 }
 
+/* Blocks left in an allocation descriptor of ADLEN bytes after the first
+   FILEBYTES of it, capped at MAX.  */
 static grub_disk_addr_t
-grub_udf_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
+grub_udf_ad_blocks (struct grub_udf_data *data, grub_uint32_t adlen,
+		    grub_disk_addr_t filebytes, grub_disk_addr_t max)
+{
+  grub_disk_addr_t left;
+
+  left = (adlen - filebytes + U32 (data->lvd.bsize) - 1)
+    >> (GRUB_DISK_SECTOR_BITS + data->lbshift);
+  return left < max ? left : max;
+}
+
+/* Map FILEBLOCK to a disk block and set *COUNT to the number of blocks,
+   at most *COUNT, that continue the run on disk.  */
+static grub_disk_addr_t
+grub_udf_read_extent (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+		      grub_disk_addr_t *count)
 {
   char *buf = NULL;
   char *ptr;
   grub_ssize_t len;
   grub_disk_addr_t filebytes;
+  grub_disk_addr_t max = *count;
+
+  *count = 1;
 
   switch (U16 (node->block.fe.tag.tag_ident))
     {
@@ -490,6 +509,7 @@ grub_udf_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
 	  if (filebytes < adlen)
 	    {
 	      grub_uint32_t ad_pos = ad->position;
+	      *count = grub_udf_ad_blocks (node->data, adlen, filebytes, max);
 	      grub_free (buf);
 	      return ((U32 (ad_pos) & GRUB_UDF_EXT_MASK) ? 0 :
 		      (grub_udf_get_block (node->data, node->part_ref, ad_pos)
@@ -544,6 +564,7 @@ grub_udf_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
 	    {
 	      grub_uint32_t ad_block_num = ad->block.block_num;
 	      grub_uint32_t ad_part_ref = ad->block.part_ref;
+	      *count = grub_udf_ad_blocks (node->data, adlen, filebytes, max);
 	      grub_free (buf);
 	      return ((U32 (ad_block_num) & GRUB_UDF_EXT_MASK) ?  0 :
 		      (grub_udf_get_block (node->data, ad_part_ref,
@@ -591,11 +612,11 @@ grub_udf_read_file (grub_fshelp_node_t node,
       return 0;
     }
 
-  return grub_fshelp_read_file (node->data->disk, node,
-				read_hook, read_hook_data,
-				pos, len, buf, grub_udf_read_block,
-				U64 (node->block.fe.file_size),
-				node->data->lbshift, 0);
+  return grub_fshelp_read_file_extents (node->data->disk, node,
+					read_hook, read_hook_data,
+					pos, len, buf, grub_udf_read_extent,
+					U64 (node->block.fe.file_size),
+					node->data->lbshift, 0);
 }
 
 static unsigned sblocklist[] = { 256, 512, 0 };
@@ -500,13 +500,19 @@ get_fsb (const void *keys, int idx)
   return grub_be_to_cpu64 (grub_get_unaligned64 (p));
 }
 
+/* Map FILEBLOCK to a disk block and set *COUNT to the number of blocks,
+   at most *COUNT, that continue the run on disk.  */
 static grub_disk_addr_t
-grub_xfs_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
+grub_xfs_read_extent (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+		      grub_disk_addr_t *count)
 {
   struct grub_xfs_btree_node *leaf = 0;
   int ex, nrec;
   struct grub_xfs_extent *exts;
   grub_uint64_t ret = 0;
+  grub_disk_addr_t left = 1, max = *count;
+
+  *count = 1;
 
   if (node->inode.format == XFS_INODE_FORMAT_BTREE)
     {
@@ -591,16 +597,22 @@ grub_xfs_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
 
       /* Sparse block.  */
       if (fileblock < offset)
-        break;
+	{
+	  left = offset - fileblock;
+	  break;
+	}
       else if (fileblock < offset + size)
         {
           ret = (fileblock - offset + start);
+	  left = offset + size - fileblock;
           break;
         }
     }
 
   grub_free (leaf);
 
+  *count = left < max ? left : max;
+
   return GRUB_XFS_FSB_TO_BLOCK(node->data, ret);
 }
 
@@ -612,12 +624,13 @@ grub_xfs_read_file (grub_fshelp_node_t node,
 		    grub_disk_read_hook_t read_hook, void *read_hook_data,
 		    grub_off_t pos, grub_size_t len, char *buf, grub_uint32_t header_size)
 {
-  return grub_fshelp_read_file (node->data->disk, node,
-				read_hook, read_hook_data,
-				pos, len, buf, grub_xfs_read_block,
-				grub_be_to_cpu64 (node->inode.size) + header_size,
-				node->data->sblock.log2_bsize
-				- GRUB_DISK_SECTOR_BITS, 0);
+  return grub_fshelp_read_file_extents (node->data->disk, node,
+					read_hook, read_hook_data,
+					pos, len, buf, grub_xfs_read_extent,
+					grub_be_to_cpu64 (node->inode.size)
+					+ header_size,
+					node->data->sblock.log2_bsize
+					- GRUB_DISK_SECTOR_BITS, 0);
 }
 
 
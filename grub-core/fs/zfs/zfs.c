@@ -55,6 +55,7 @@
 #include <grub/deflate.h>
 #include <grub/crypto.h>
 #include <grub/i18n.h>
+#include <grub/fshelp.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -535,6 +536,27 @@ uberblock_verify (uberblock_phys_t * ub, grub_uint64_t offset,
   return err;
 }
 
+/*
+ * Every mount reads the labels again and checksums 128K of uberblocks and
+ * 112K of vdev config with SHA-256.  Remember the last ring and config
+ * that passed, so that unchanged copies need only a memcmp.
+ */
+static char *verified_ring;
+static grub_disk_addr_t verified_ring_sector;
+static int verified_ring_shift;
+static int verified_ring_best;
+static char *verified_phys;
+static grub_disk_addr_t verified_phys_sector;
+
+static void
+label_memo_flush (void)
+{
+  grub_free (verified_ring);
+  verified_ring = NULL;
+  grub_free (verified_phys);
+  verified_phys = NULL;
+}
+
 /*
  * Find the best uberblock.
  * Return:
@@ -555,6 +577,13 @@ find_bestub (uberblock_phys_t * ub_array,
   if (ub_shift < VDEV_UBERBLOCK_SHIFT)
     ub_shift = VDEV_UBERBLOCK_SHIFT;
 
+  if (verified_ring && verified_ring_sector == desc->vdev_phys_sector
+      && verified_ring_shift == ub_shift
+      && grub_memcmp (verified_ring, ub_array, VDEV_UBERBLOCK_RING) == 0)
+    return (uberblock_phys_t *) ((grub_properly_aligned_t *) ub_array
+				 + ((verified_ring_best << ub_shift)
+				    / sizeof (grub_properly_aligned_t)));
+
   for (i = 0; i < (VDEV_UBERBLOCK_RING >> ub_shift); i++)
     {
       offset = (desc->vdev_phys_sector << SPA_MINBLOCKSHIFT) + VDEV_PHYS_SIZE
@@ -575,7 +604,22 @@ find_bestub (uberblock_phys_t * ub_array,
 	ubbest = ubptr;
     }
   if (!ubbest)
-    grub_errno = err;
+    {
+      grub_errno = err;
+      return NULL;
+    }
+
+  if (!verified_ring)
+    verified_ring = grub_malloc (VDEV_UBERBLOCK_RING);
+  if (verified_ring)
+    {
+      grub_memcpy (verified_ring, ub_array, VDEV_UBERBLOCK_RING);
+      verified_ring_sector = desc->vdev_phys_sector;
+      verified_ring_shift = ub_shift;
+      verified_ring_best = ((char *) ubbest - (char *) ub_array) >> ub_shift;
+    }
+  else
+    grub_errno = GRUB_ERR_NONE;
 
   return ubbest;
 }
@@ -998,11 +1042,25 @@ check_pool_label (struct grub_zfs_data *data,
 			 "bad vdev_phys_t.vp_zbt.zec_magic number");
     }
   /* Now check the integrity of the vdev_phys_t structure though checksum.  */
-  ZIO_SET_CHECKSUM(&emptycksum, diskdesc->vdev_phys_sector << 9, 0, 0, 0);
-  err = zio_checksum_verify (emptycksum, ZIO_CHECKSUM_LABEL, endian,
-			     nvlist, VDEV_PHYS_SIZE);
-  if (err)
-    return err;
+  if (!verified_phys || verified_phys_sector != diskdesc->vdev_phys_sector
+      || grub_memcmp (verified_phys, nvlist, VDEV_PHYS_SIZE) != 0)
+    {
+      ZIO_SET_CHECKSUM(&emptycksum, diskdesc->vdev_phys_sector << 9, 0, 0, 0);
+      err = zio_checksum_verify (emptycksum, ZIO_CHECKSUM_LABEL, endian,
+				 nvlist, VDEV_PHYS_SIZE);
+      if (err)
+	return err;
+
+      if (!verified_phys)
+	verified_phys = grub_malloc (VDEV_PHYS_SIZE);
+      if (verified_phys)
+	{
+	  grub_memcpy (verified_phys, nvlist, VDEV_PHYS_SIZE);
+	  verified_phys_sector = diskdesc->vdev_phys_sector;
+	}
+      else
+	grub_errno = GRUB_ERR_NONE;
+    }
 
   grub_dprintf ("zfs", "check 2 passed\n");
 
@@ -1995,6 +2053,165 @@ zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
   return GRUB_ERR_NONE;
 }
 
+/*
+ * Cache of verified and decompressed metadata blocks: object sets, indirect
+ * blocks, dnodes and ZAPs.  ZFS never overwrites a block in place, so the
+ * pool, the DVAs, the birth txg and the checksum of a block pointer identify
+ * the contents for good.  The cache is shared by all mounts, since every
+ * open mounts the pool afresh and resolves the same path again.
+ */
+#define ZFS_CACHE_ENTRIES 64
+#define ZFS_CACHE_BYTES (4 * 1024 * 1024)
+
+struct zfs_block_key
+{
+  grub_uint64_t guid;
+  dva_t dva[SPA_DVAS_PER_BP];
+  grub_uint64_t prop;
+  grub_uint64_t birth;
+  zio_cksum_t cksum;
+};
+
+struct zfs_cached_block
+{
+  struct zfs_block_key key;
+  grub_uint64_t used;
+  grub_size_t size;
+  void *buf;
+};
+
+static struct zfs_cached_block block_cache[ZFS_CACHE_ENTRIES];
+static grub_size_t block_cache_bytes;
+static grub_uint64_t block_cache_clock;
+
+static void
+block_cache_flush (void)
+{
+  unsigned i;
+
+  for (i = 0; i < ZFS_CACHE_ENTRIES; i++)
+    {
+      grub_free (block_cache[i].buf);
+      block_cache[i].buf = 0;
+    }
+  block_cache_bytes = 0;
+}
+
+/* Return whether the block BP points to may be kept in the block cache.
+   Embedded blocks cost nothing to decode and decrypted data must not
+   outlive the mount that had the key.  */
+static int
+block_cacheable (blkptr_t *bp, grub_zfs_endian_t endian)
+{
+  grub_uint64_t prop = grub_zfs_to_cpu64 (bp->blk_prop, endian);
+
+  if (BP_IS_EMBEDDED (bp) || BP_IS_HOLE (bp) || ((prop >> 60) & 3))
+    return 0;
+  return (((prop & 0xffff) + 1) << SPA_MINBLOCKSHIFT) <= ZFS_CACHE_BYTES / 8;
+}
+
+/*
+ * Like zio_read, but look the block up in the block cache first and keep
+ * it there.  BP must be cacheable.  *BUF belongs to the cache and is only
+ * valid until the next call.
+ */
+static grub_err_t
+zio_read_cached (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
+		 grub_size_t *size_out, struct grub_zfs_data *data)
+{
+  struct zfs_block_key key;
+  struct zfs_cached_block *e, *victim;
+  grub_size_t size;
+  void *b;
+  grub_err_t err;
+  unsigned i;
+
+  grub_memset (&key, 0, sizeof (key));
+  key.guid = data->guid;
+  grub_memcpy (key.dva, bp->blk_dva, sizeof (key.dva));
+  key.prop = bp->blk_prop;
+  key.birth = bp->blk_birth;
+  key.cksum = bp->blk_cksum;
+
+  for (i = 0; i < ZFS_CACHE_ENTRIES; i++)
+    {
+      e = &block_cache[i];
+      if (e->buf && grub_memcmp (&e->key, &key, sizeof (key)) == 0)
+	{
+	  e->used = ++block_cache_clock;
+	  *buf = e->buf;
+	  *size_out = e->size;
+	  return GRUB_ERR_NONE;
+	}
+    }
+
+  err = zio_read (bp, endian, &b, &size, data);
+  if (err)
+    return err;
+
+  /* Make room: evict least recently used blocks until this one fits the
+     budget, but always keep a slot for it.  */
+  while (1)
+    {
+      struct zfs_cached_block *lru = 0;
+
+      victim = 0;
+      for (i = 0; i < ZFS_CACHE_ENTRIES; i++)
+	{
+	  e = &block_cache[i];
+	  if (!e->buf)
+	    victim = e;
+	  else if (!lru || e->used < lru->used)
+	    lru = e;
+	}
+      if (victim && block_cache_bytes + size <= ZFS_CACHE_BYTES)
+	break;
+      if (!lru)
+	break;
+      block_cache_bytes -= lru->size;
+      grub_free (lru->buf);
+      lru->buf = 0;
+    }
+
+  victim->key = key;
+  victim->used = ++block_cache_clock;
+  victim->size = size;
+  victim->buf = b;
+  block_cache_bytes += size;
+
+  *buf = b;
+  *size_out = size;
+  return GRUB_ERR_NONE;
+}
+
+/*
+ * Read a metadata block like zio_read, going through the block cache when
+ * possible.  The caller owns *BUF.
+ */
+static grub_err_t
+zio_read_meta (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
+	       grub_size_t *size, struct grub_zfs_data *data)
+{
+  grub_size_t lsize;
+  void *cached;
+  grub_err_t err;
+
+  if (!block_cacheable (bp, endian))
+    return zio_read (bp, endian, buf, size, data);
+
+  *buf = NULL;
+  err = zio_read_cached (bp, endian, &cached, &lsize, data);
+  if (err)
+    return err;
+  *buf = grub_malloc (lsize);
+  if (!*buf)
+    return grub_errno;
+  grub_memcpy (*buf, cached, lsize);
+  if (size)
+    *size = lsize;
+  return GRUB_ERR_NONE;
+}
+
 /*
  * Get the block from a block id.
  * push the block onto the stack.
@@ -2023,11 +2240,9 @@ dmu_read (dnode_end_t * dn, grub_uint64_t blkid, void **buf,
       grub_dprintf ("zfs", "endian = %d\n", endian);
       idx = (blkid >> (epbs * level)) & ((1 << epbs) - 1);
       *bp = bp_array[idx];
-      if (bp_array != dn->dn.dn_blkptr)
-	{
-	  grub_free (bp_array);
-	  bp_array = 0;
-	}
+      /* Indirect blocks from the cache are not ours to free.  */
+      grub_free (tmpbuf);
+      tmpbuf = 0;
 
       if (BP_IS_HOLE (bp))
 	{
@@ -2047,19 +2262,31 @@ dmu_read (dnode_end_t * dn, grub_uint64_t blkid, void **buf,
       if (level == 0)
 	{
 	  grub_dprintf ("zfs", "endian = %d\n", endian);
-	  err = zio_read (bp, endian, buf, 0, data);
+	  /* File contents are kept in data->file_buf instead.  */
+	  if (dn->dn.dn_type == DMU_OT_PLAIN_FILE_CONTENTS)
+	    err = zio_read (bp, endian, buf, 0, data);
+	  else
+	    err = zio_read_meta (bp, endian, buf, 0, data);
 	  endian = (grub_zfs_to_cpu64 (bp->blk_prop, endian) >> 63) & 1;
 	  break;
 	}
       grub_dprintf ("zfs", "endian = %d\n", endian);
-      err = zio_read (bp, endian, &tmpbuf, 0, data);
+      if (block_cacheable (bp, endian))
+	{
+	  grub_size_t size;
+
+	  err = zio_read_cached (bp, endian, (void **) &bp_array, &size, data);
+	}
+      else
+	{
+	  err = zio_read (bp, endian, &tmpbuf, 0, data);
+	  bp_array = tmpbuf;
+	}
       endian = (grub_zfs_to_cpu64 (bp->blk_prop, endian) >> 63) & 1;
       if (err)
 	break;
-      bp_array = tmpbuf;
     }
-  if (bp_array != dn->dn.dn_blkptr)
-    grub_free (bp_array);
+  grub_free (tmpbuf);
   if (endian_out)
     *endian_out = endian;
 
@@ -2711,6 +2938,15 @@ dnode_get (dnode_end_t * mdn, grub_uint64_t objnum, grub_uint8_t type,
 
 #pragma GCC diagnostic ignored "-Wstrict-aliasing"
 
+static struct grub_fs grub_zfs_fs;
+
+/* Directory entry cache key of a directory.  */
+struct zfs_dcache_dir
+{
+  grub_uint64_t subvol;
+  grub_uint64_t objnum;
+};
+
 /*
  * Get the file dnode for a given file name where mdn is the meta dnode
  * for this ZFS object set. When found, place the file dnode in dn.
@@ -2729,8 +2965,12 @@ dnode_get_path (struct subvolume *subvol, const char *path_in, dnode_end_t *dn,
   {
     struct dnode_chain *next;
     dnode_end_t dn; 
+    grub_uint64_t objnum;
   };
   struct dnode_chain *dnode_path = 0, *dn_new, *root;
+  struct zfs_dcache_dir dcache_dir;
+  grub_disk_t disk = (data->device_original
+		      ? data->device_original->dev->disk : NULL);
 
   dn_new = grub_malloc (sizeof (*dn_new));
   if (! dn_new)
@@ -2782,6 +3022,7 @@ dnode_get_path (struct subvolume *subvol, const char *path_in, dnode_end_t *dn,
       grub_free (dn_new);
       return err;
     }
+  dnode_path->objnum = objnum;
 
   path = path_buf = grub_strdup (path_in);
   if (!path_buf)
@@ -2830,8 +3071,29 @@ dnode_get_path (struct subvolume *subvol, const char *path_in, dnode_end_t *dn,
 	  grub_free (path_buf);
 	  return grub_error (GRUB_ERR_BAD_FILE_TYPE, N_("not a directory"));
 	}
-      err = zap_lookup (&(dnode_path->dn), cname, &objnum,
-			data, subvol->case_insensitive);
+      dcache_dir.subvol = subvol->obj;
+      dcache_dir.objnum = dnode_path->objnum;
+      switch (grub_fshelp_dcache_lookup (disk, &grub_zfs_fs,
+					 &dcache_dir, sizeof (dcache_dir),
+					 cname, path - cname,
+					 &objnum, sizeof (objnum)))
+	{
+	case GRUB_FSHELP_DCACHE_FOUND:
+	  break;
+	case GRUB_FSHELP_DCACHE_ABSENT:
+	  err = grub_error (GRUB_ERR_FILE_NOT_FOUND, N_("file `%s' not found"),
+			    cname);
+	  break;
+	case GRUB_FSHELP_DCACHE_MISS:
+	  err = zap_lookup (&(dnode_path->dn), cname, &objnum,
+			    data, subvol->case_insensitive);
+	  if (err == GRUB_ERR_NONE || err == GRUB_ERR_FILE_NOT_FOUND)
+	    grub_fshelp_dcache_insert (disk, &grub_zfs_fs,
+				       &dcache_dir, sizeof (dcache_dir),
+				       cname, path - cname,
+				       err ? NULL : &objnum, sizeof (objnum));
+	  break;
+	}
       if (err)
 	break;
 
@@ -2848,6 +3110,7 @@ dnode_get_path (struct subvolume *subvol, const char *path_in, dnode_end_t *dn,
       err = dnode_get (&subvol->mdn, objnum, 0, &(dnode_path->dn), data);
       if (err)
 	break;
+      dnode_path->objnum = objnum;
 
       *path = ch;
       if (dnode_path->dn.dn.dn_bonustype == DMU_OT_ZNODE
@@ -3138,7 +3401,7 @@ make_mdn (dnode_end_t * mdn, struct grub_zfs_data *data)
   grub_dprintf ("zfs", "endian = %d\n", mdn->endian);
 
   bp = &(((dsl_dataset_phys_t *) DN_BONUS (&mdn->dn))->ds_bp);
-  err = zio_read (bp, mdn->endian, &osp, &ospsize, data);
+  err = zio_read_meta (bp, mdn->endian, &osp, &ospsize, data);
   if (err)
     return err;
   if (ospsize < OBJSET_PHYS_SIZE_V14)
@@ -3650,8 +3913,8 @@ zfs_mount (grub_device_t dev)
 				  GRUB_ZFS_LITTLE_ENDIAN) == UBERBLOCK_MAGIC 
 	       ? GRUB_ZFS_LITTLE_ENDIAN : GRUB_ZFS_BIG_ENDIAN);
 
-  err = zio_read (&ub->ub_rootbp, ub_endian,
-		  &osp, &ospsize, data);
+  err = zio_read_meta (&ub->ub_rootbp, ub_endian,
+		       &osp, &ospsize, data);
   if (err)
     {
       zfs_unmount (data);
@@ -4375,4 +4638,6 @@ GRUB_MOD_INIT (zfs)
 GRUB_MOD_FINI (zfs)
 {
   grub_fs_unregister (&grub_zfs_fs);
+  block_cache_flush ();
+  label_memo_flush ();
 }
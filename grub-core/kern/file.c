@@ -30,6 +30,7 @@ void (*EXPORT_VAR (grub_grubnet_fini)) (void);
 
 grub_file_filter_t grub_file_filters_all[GRUB_FILE_FILTER_MAX];
 grub_file_filter_t grub_file_filters_enabled[GRUB_FILE_FILTER_MAX];
+int grub_file_pubkey_deferred;
 
 /* Get the device part of the filename NAME. It is enclosed by parentheses.  */
 char *
@@ -126,6 +127,7 @@ grub_file_open (const char *name)
     
   grub_memcpy (grub_file_filters_enabled, grub_file_filters_all,
 	       sizeof (grub_file_filters_enabled));
+  grub_file_pubkey_deferred = 0;
 
   return file;
 
@@ -139,6 +141,7 @@ grub_file_open (const char *name)
 
   grub_memcpy (grub_file_filters_enabled, grub_file_filters_all,
 	       sizeof (grub_file_filters_enabled));
+  grub_file_pubkey_deferred = 0;
 
   return 0;
 }
@@ -284,6 +284,23 @@ grub_crypto_cbc_decrypt (grub_crypto_cipher_handle_t cipher,
     return GPG_ERR_INV_ARG;
   if (blocksize > GRUB_CRYPTO_MAX_CIPHER_BLOCKSIZE)
     return GPG_ERR_INV_ARG;
+  if (in == out && size)
+    {
+      /* In place, walk backwards: every block is then chained with a
+	 predecessor that is still ciphertext, and only the last one has to
+	 be saved as the next IV.  */
+      grub_memcpy (ivt, (grub_uint8_t *) out + size - blocksize, blocksize);
+      for (outptr = (grub_uint8_t *) out + size - blocksize;
+	   outptr != (grub_uint8_t *) out; outptr -= blocksize)
+	{
+	  cipher->cipher->decrypt (cipher->ctx, outptr, outptr);
+	  grub_crypto_xor (outptr, outptr, outptr - blocksize, blocksize);
+	}
+      cipher->cipher->decrypt (cipher->ctx, outptr, outptr);
+      grub_crypto_xor (outptr, outptr, iv, blocksize);
+      grub_memcpy (iv, ivt, blocksize);
+      return GPG_ERR_NO_ERROR;
+    }
   end = (const grub_uint8_t *) in + size;
   for (inptr = in, outptr = out; inptr < end;
        inptr += blocksize, outptr += blocksize)
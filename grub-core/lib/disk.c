@@ -60,6 +60,8 @@ grub_disk_write (grub_disk_t disk, grub_disk_addr_t sector,
 
   grub_dprintf ("disk", "Writing `%s'...\n", disk->name);
 
+  grub_disk_generation++;
+
   if (grub_disk_adjust_range (disk, &sector, &offset, size) != GRUB_ERR_NONE)
     return -1;
 
@@ -22,15 +22,16 @@
 
 
 /****************
- * Rotate the 32 bit unsigned integer X by N bits left/right
+ * Rotate the 32 bit unsigned integer X by N bits left/right.  Constant
+ * counts are encoded as immediates instead of being loaded into %cl.
  */
 #if defined(__GNUC__) && defined(__i386__)
 static inline u32
 rol( u32 x, int n)
 {
-	__asm__("roll %%cl,%0"
+	__asm__("roll %b2,%0"
 		:"=r" (x)
-		:"0" (x),"c" (n));
+		:"0" (x),"cI" (n));
 	return x;
 }
 #else
@@ -41,9 +42,9 @@ rol( u32 x, int n)
 static inline u32
 ror(u32 x, int n)
 {
-	__asm__("rorl %%cl,%0"
+	__asm__("rorl %b2,%0"
 		:"=r" (x)
-		:"0" (x),"c" (n));
+		:"0" (x),"cI" (n));
 	return x;
 }
 #else
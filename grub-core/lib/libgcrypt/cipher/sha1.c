@@ -114,23 +114,13 @@ transform (SHA1_CONTEXT *hd, const unsigned char *data, size_t nblocks)
   /* Loop over all blocks.  */
   for ( ;nblocks; nblocks--)
     {
-#ifdef WORDS_BIGENDIAN
-      memcpy (x, data, 64);
-      data += 64;
-#else
       {
         int i;
-        unsigned char *p;
-
-        for(i=0, p=(unsigned char*)x; i < 16; i++, p += 4 )
-          {
-            p[3] = *data++;
-            p[2] = *data++;
-            p[1] = *data++;
-            p[0] = *data++;
-          }
+
+        for (i = 0; i < 16; i++, data += 4)
+          x[i] = ((u32) data[0] << 24) | ((u32) data[1] << 16)
+                 | ((u32) data[2] << 8) | data[3];
       }
-#endif
       /* Get the values of the chaining variables. */
       a = hd->h0;
       b = hd->h1;
@@ -252,8 +242,14 @@ sha1_write( void *context, const void *inbuf_arg, size_t inlen)
 
   if (hd->count)
     {
-      for (; inlen && hd->count < 64; inlen--)
-        hd->buf[hd->count++] = *inbuf++;
+      size_t n = 64 - hd->count;
+
+      if (n > inlen)
+        n = inlen;
+      memcpy (hd->buf + hd->count, inbuf, n);
+      hd->count += n;
+      inbuf += n;
+      inlen -= n;
       sha1_write (hd, NULL, 0);
       if (!inlen)
         return;
@@ -271,8 +267,8 @@ sha1_write( void *context, const void *inbuf_arg, size_t inlen)
   _gcry_burn_stack (88+4*sizeof(void*));
 
   /* Save remaining bytes.  */
-  for (; inlen && hd->count < 64; inlen--)
-    hd->buf[hd->count++] = *inbuf++;
+  memcpy (hd->buf + hd->count, inbuf, inlen);
+  hd->count += inlen;
 }
 
 
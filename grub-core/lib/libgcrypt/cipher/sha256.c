@@ -92,22 +92,42 @@ sha224_init (void *context)
 
 
 /*
-  Transform the message X which consists of 16 32-bit-words. See FIPS
-  180-2 for details.  */
+  Transform NBLOCKS messages of 16 32-bit-words each at DATA.  See
+  FIPS 180-2 for details.  */
 #define S0(x) (ror ((x), 7) ^ ror ((x), 18) ^ ((x) >> 3))       /* (4.6) */
 #define S1(x) (ror ((x), 17) ^ ror ((x), 19) ^ ((x) >> 10))     /* (4.7) */
 #define R(a,b,c,d,e,f,g,h,k,w) do                                 \
           {                                                       \
             t1 = (h) + Sum1((e)) + Cho((e),(f),(g)) + (k) + (w);  \
             t2 = Sum0((a)) + Maj((a),(b),(c));                    \
-            h = g;                                                \
-            g = f;                                                \
-            f = e;                                                \
-            e = d + t1;                                           \
-            d = c;                                                \
-            c = b;                                                \
-            b = a;                                                \
-            a = t1 + t2;                                          \
+            d += t1;                                              \
+            h = t1 + t2;                                          \
+          } while (0)
+
+/* The message schedule only ever looks 16 words back, so keep it in a
+   ring of 16 words instead of expanding all 64 up front.  */
+#define W(i) (w[(i) & 0x0f] = S1 (w[((i) - 2) & 0x0f])             \
+                              + w[((i) - 7) & 0x0f]                 \
+                              + S0 (w[((i) - 15) & 0x0f])           \
+                              + w[(i) & 0x0f])
+#define R16(i) do                                                 \
+          {                                                       \
+            R(a, b, c, d, e, f, g, h, K[(i) + 0], W((i) + 0));    \
+            R(h, a, b, c, d, e, f, g, K[(i) + 1], W((i) + 1));    \
+            R(g, h, a, b, c, d, e, f, K[(i) + 2], W((i) + 2));    \
+            R(f, g, h, a, b, c, d, e, K[(i) + 3], W((i) + 3));    \
+            R(e, f, g, h, a, b, c, d, K[(i) + 4], W((i) + 4));    \
+            R(d, e, f, g, h, a, b, c, K[(i) + 5], W((i) + 5));    \
+            R(c, d, e, f, g, h, a, b, K[(i) + 6], W((i) + 6));    \
+            R(b, c, d, e, f, g, h, a, K[(i) + 7], W((i) + 7));    \
+            R(a, b, c, d, e, f, g, h, K[(i) + 8], W((i) + 8));    \
+            R(h, a, b, c, d, e, f, g, K[(i) + 9], W((i) + 9));    \
+            R(g, h, a, b, c, d, e, f, K[(i) + 10], W((i) + 10));  \
+            R(f, g, h, a, b, c, d, e, K[(i) + 11], W((i) + 11));  \
+            R(e, f, g, h, a, b, c, d, K[(i) + 12], W((i) + 12));  \
+            R(d, e, f, g, h, a, b, c, K[(i) + 13], W((i) + 13));  \
+            R(c, d, e, f, g, h, a, b, K[(i) + 14], W((i) + 14));  \
+            R(b, c, d, e, f, g, h, a, K[(i) + 15], W((i) + 15));  \
           } while (0)
 
 /* (4.2) same as SHA-1's F1.  */
@@ -140,7 +160,7 @@ Sum1 (u32 x)
 
 
 static void
-transform (SHA256_CONTEXT *hd, const unsigned char *data)
+transform (SHA256_CONTEXT *hd, const unsigned char *data, size_t nblocks)
 {
   static const u32 K[64] = {
     0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
@@ -162,102 +182,60 @@ transform (SHA256_CONTEXT *hd, const unsigned char *data)
   };
 
   u32 a,b,c,d,e,f,g,h,t1,t2;
-  u32 x[16];
-  u32 w[64];
+  u32 w[16];
   int i;
 
-  a = hd->h0;
-  b = hd->h1;
-  c = hd->h2;
-  d = hd->h3;
-  e = hd->h4;
-  f = hd->h5;
-  g = hd->h6;
-  h = hd->h7;
-
-#ifdef WORDS_BIGENDIAN
-  memcpy (x, data, 64);
-#else
-  {
-    byte *p2;
-
-    for (i=0, p2=(byte*)x; i < 16; i++, p2 += 4 )
-      {
-        p2[3] = *data++;
-        p2[2] = *data++;
-        p2[1] = *data++;
-        p2[0] = *data++;
-      }
-  }
-#endif
-
-  for (i=0; i < 16; i++)
-    w[i] = x[i];
-  for (; i < 64; i++)
-    w[i] = S1(w[i-2]) + w[i-7] + S0(w[i-15]) + w[i-16];
-
-  for (i=0; i < 64;)
+  for (; nblocks; nblocks--, data += 64)
     {
-#if 0
-      R(a,b,c,d,e,f,g,h,K[i],w[i]);
-      i++;
-#else
-      t1 = h + Sum1 (e) + Cho (e, f, g) + K[i] + w[i];
-      t2 = Sum0 (a) + Maj (a, b, c);
-      d += t1;
-      h  = t1 + t2;
-
-      t1 = g + Sum1 (d) + Cho (d, e, f) + K[i+1] + w[i+1];
-      t2 = Sum0 (h) + Maj (h, a, b);
-      c += t1;
-      g  = t1 + t2;
-
-      t1 = f + Sum1 (c) + Cho (c, d, e) + K[i+2] + w[i+2];
-      t2 = Sum0 (g) + Maj (g, h, a);
-      b += t1;
-      f  = t1 + t2;
-
-      t1 = e + Sum1 (b) + Cho (b, c, d) + K[i+3] + w[i+3];
-      t2 = Sum0 (f) + Maj (f, g, h);
-      a += t1;
-      e  = t1 + t2;
-
-      t1 = d + Sum1 (a) + Cho (a, b, c) + K[i+4] + w[i+4];
-      t2 = Sum0 (e) + Maj (e, f, g);
-      h += t1;
-      d  = t1 + t2;
-
-      t1 = c + Sum1 (h) + Cho (h, a, b) + K[i+5] + w[i+5];
-      t2 = Sum0 (d) + Maj (d, e, f);
-      g += t1;
-      c  = t1 + t2;
-
-      t1 = b + Sum1 (g) + Cho (g, h, a) + K[i+6] + w[i+6];
-      t2 = Sum0 (c) + Maj (c, d, e);
-      f += t1;
-      b  = t1 + t2;
-
-      t1 = a + Sum1 (f) + Cho (f, g, h) + K[i+7] + w[i+7];
-      t2 = Sum0 (b) + Maj (b, c, d);
-      e += t1;
-      a  = t1 + t2;
-
-      i += 8;
-#endif
+      a = hd->h0;
+      b = hd->h1;
+      c = hd->h2;
+      d = hd->h3;
+      e = hd->h4;
+      f = hd->h5;
+      g = hd->h6;
+      h = hd->h7;
+
+      for (i = 0; i < 16; i++)
+        w[i] = ((u32) data[4 * i] << 24) | ((u32) data[4 * i + 1] << 16)
+               | ((u32) data[4 * i + 2] << 8) | data[4 * i + 3];
+
+      R(a, b, c, d, e, f, g, h, K[0], w[0]);
+      R(h, a, b, c, d, e, f, g, K[1], w[1]);
+      R(g, h, a, b, c, d, e, f, K[2], w[2]);
+      R(f, g, h, a, b, c, d, e, K[3], w[3]);
+      R(e, f, g, h, a, b, c, d, K[4], w[4]);
+      R(d, e, f, g, h, a, b, c, K[5], w[5]);
+      R(c, d, e, f, g, h, a, b, K[6], w[6]);
+      R(b, c, d, e, f, g, h, a, K[7], w[7]);
+      R(a, b, c, d, e, f, g, h, K[8], w[8]);
+      R(h, a, b, c, d, e, f, g, K[9], w[9]);
+      R(g, h, a, b, c, d, e, f, K[10], w[10]);
+      R(f, g, h, a, b, c, d, e, K[11], w[11]);
+      R(e, f, g, h, a, b, c, d, K[12], w[12]);
+      R(d, e, f, g, h, a, b, c, K[13], w[13]);
+      R(c, d, e, f, g, h, a, b, K[14], w[14]);
+      R(b, c, d, e, f, g, h, a, K[15], w[15]);
+
+      R16(16);
+      R16(32);
+      R16(48);
+
+      hd->h0 += a;
+      hd->h1 += b;
+      hd->h2 += c;
+      hd->h3 += d;
+      hd->h4 += e;
+      hd->h5 += f;
+      hd->h6 += g;
+      hd->h7 += h;
     }
-
-  hd->h0 += a;
-  hd->h1 += b;
-  hd->h2 += c;
-  hd->h3 += d;
-  hd->h4 += e;
-  hd->h5 += f;
-  hd->h6 += g;
-  hd->h7 += h;
 }
 #undef S0
 #undef S1
 #undef R
+#undef W
+#undef R16
 
 
 /* Update the message digest with the contents of INBUF with length
@@ -268,10 +246,12 @@ sha256_write (void *context, const void *inbuf_arg, size_t inlen)
   const unsigned char *inbuf = inbuf_arg;
   SHA256_CONTEXT *hd = context;
 
+  size_t nblocks;
+
   if (hd->count == 64)
     { /* flush the buffer */
-      transform (hd, hd->buf);
-      _gcry_burn_stack (74*4+32);
+      transform (hd, hd->buf, 1);
+      _gcry_burn_stack (26*4+32);
       hd->count = 0;
       hd->nblocks++;
     }
@@ -279,24 +259,31 @@ sha256_write (void *context, const void *inbuf_arg, size_t inlen)
     return;
   if (hd->count)
     {
-      for (; inlen && hd->count < 64; inlen--)
-        hd->buf[hd->count++] = *inbuf++;
+      size_t n = 64 - hd->count;
+
+      if (n > inlen)
+        n = inlen;
+      memcpy (hd->buf + hd->count, inbuf, n);
+      hd->count += n;
+      inbuf += n;
+      inlen -= n;
       sha256_write (hd, NULL, 0);
       if (!inlen)
         return;
     }
 
-  while (inlen >= 64)
+  nblocks = inlen / 64;
+  if (nblocks)
     {
-      transform (hd, inbuf);
+      transform (hd, inbuf, nblocks);
       hd->count = 0;
-      hd->nblocks++;
-      inlen -= 64;
-      inbuf += 64;
+      hd->nblocks += nblocks;
+      inlen -= nblocks * 64;
+      inbuf += nblocks * 64;
     }
-  _gcry_burn_stack (74*4+32);
-  for (; inlen && hd->count < 64; inlen--)
-    hd->buf[hd->count++] = *inbuf++;
+  _gcry_burn_stack (26*4+32);
+  memcpy (hd->buf + hd->count, inbuf, inlen);
+  hd->count += inlen;
 }
 
 
@@ -351,8 +338,8 @@ sha256_final(void *context)
   hd->buf[61] = lsb >> 16;
   hd->buf[62] = lsb >>  8;
   hd->buf[63] = lsb;
-  transform (hd, hd->buf);
-  _gcry_burn_stack (74*4+32);
+  transform (hd, hd->buf, 1);
+  _gcry_burn_stack (26*4+32);
 
   p = hd->buf;
 #ifdef WORDS_BIGENDIAN
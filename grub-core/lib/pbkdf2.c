@@ -32,6 +32,25 @@ GRUB_MOD_LICENSE ("GPLv2+");
    must have room for at least DKLEN octets.  The output buffer will
    be filled with the derived data.  */
 
+/* Compute HMAC of DATA from the hash states INNER and OUTER, which have
+   already absorbed the padded key, into OUT.  CTX is scratch space.  */
+static void
+hmac_from_pads (const struct gcry_md_spec *md, const void *inner,
+		const void *outer, void *ctx,
+		const grub_uint8_t *data, grub_size_t datalen,
+		grub_uint8_t *out)
+{
+  grub_memcpy (ctx, inner, md->contextsize);
+  md->write (ctx, data, datalen);
+  md->final (ctx);
+  grub_memcpy (out, md->read (ctx), md->mdlen);
+
+  grub_memcpy (ctx, outer, md->contextsize);
+  md->write (ctx, out, md->mdlen);
+  md->final (ctx);
+  grub_memcpy (out, md->read (ctx), md->mdlen);
+}
+
 gcry_err_code_t
 grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
 		    const grub_uint8_t *P, grub_size_t Plen,
@@ -42,18 +61,22 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
   unsigned int hLen = md->mdlen;
   grub_uint8_t U[GRUB_CRYPTO_MAX_MDLEN];
   grub_uint8_t T[GRUB_CRYPTO_MAX_MDLEN];
+  grub_uint8_t key[GRUB_CRYPTO_MAX_MDLEN];
   unsigned int u;
   unsigned int l;
   unsigned int r;
   unsigned int i;
   unsigned int k;
-  gcry_err_code_t rc;
-  grub_uint8_t *tmp;
+  grub_uint8_t *tmp, *pad;
+  grub_uint8_t *inner, *outer, *ctx;
   grub_size_t tmplen = Slen + 4;
 
   if (md->mdlen > GRUB_CRYPTO_MAX_MDLEN || md->mdlen == 0)
     return GPG_ERR_INV_ARG;
 
+  if (md->mdlen > md->blocksize)
+    return GPG_ERR_INV_ARG;
+
   if (c == 0)
     return GPG_ERR_INV_ARG;
 
@@ -70,32 +93,52 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
   if (tmp == NULL)
     return GPG_ERR_OUT_OF_MEMORY;
 
+  /* The HMAC key is the same for every iteration, so hash the inner and
+     outer pads once and restart each HMAC from copies of those states.  */
+  inner = grub_malloc (3 * md->contextsize + md->blocksize);
+  if (inner == NULL)
+    {
+      grub_free (tmp);
+      return GPG_ERR_OUT_OF_MEMORY;
+    }
+  outer = inner + md->contextsize;
+  ctx = outer + md->contextsize;
+  pad = ctx + md->contextsize;
+
+  if (Plen > md->blocksize)
+    {
+      grub_crypto_hash (md, key, P, Plen);
+      P = key;
+      Plen = hLen;
+    }
+
+  grub_memset (pad, 0x36, md->blocksize);
+  for (k = 0; k < Plen; k++)
+    pad[k] ^= P[k];
+  md->init (inner);
+  md->write (inner, pad, md->blocksize);
+
+  grub_memset (pad, 0x5c, md->blocksize);
+  for (k = 0; k < Plen; k++)
+    pad[k] ^= P[k];
+  md->init (outer);
+  md->write (outer, pad, md->blocksize);
+
   grub_memcpy (tmp, S, Slen);
 
   for (i = 1; i - 1 < l; i++)
     {
-      grub_memset (T, 0, hLen);
+      tmp[Slen + 0] = (i & 0xff000000) >> 24;
+      tmp[Slen + 1] = (i & 0x00ff0000) >> 16;
+      tmp[Slen + 2] = (i & 0x0000ff00) >> 8;
+      tmp[Slen + 3] = (i & 0x000000ff) >> 0;
 
-      for (u = 0; u < c; u++)
-	{
-	  if (u == 0)
-	    {
-	      tmp[Slen + 0] = (i & 0xff000000) >> 24;
-	      tmp[Slen + 1] = (i & 0x00ff0000) >> 16;
-	      tmp[Slen + 2] = (i & 0x0000ff00) >> 8;
-	      tmp[Slen + 3] = (i & 0x000000ff) >> 0;
-
-	      rc = grub_crypto_hmac_buffer (md, P, Plen, tmp, tmplen, U);
-	    }
-	  else
-	    rc = grub_crypto_hmac_buffer (md, P, Plen, U, hLen, U);
-
-	  if (rc != GPG_ERR_NO_ERROR)
-	    {
-	      grub_free (tmp);
-	      return rc;
-	    }
+      hmac_from_pads (md, inner, outer, ctx, tmp, tmplen, U);
+      grub_memcpy (T, U, hLen);
 
+      for (u = 1; u < c; u++)
+	{
+	  hmac_from_pads (md, inner, outer, ctx, U, hLen, U);
 	  for (k = 0; k < hLen; k++)
 	    T[k] ^= U[k];
 	}
@@ -103,6 +146,11 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
       grub_memcpy (DK + (i - 1) * hLen, T, i == l ? r : hLen);
     }
 
+  grub_memset (inner, 0, 3 * md->contextsize + md->blocksize);
+  grub_memset (key, 0, sizeof (key));
+  grub_memset (U, 0, sizeof (U));
+  grub_memset (T, 0, sizeof (T));
+  grub_free (inner);
   grub_free (tmp);
 
   return GPG_ERR_NO_ERROR;
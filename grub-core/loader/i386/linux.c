@@ -695,6 +695,7 @@ grub_cmd_linux (grub_command_t cmd __attribute__ ((unused)),
       goto fail;
     }
 
+  grub_file_filter_defer_pubkey ();
   file = grub_file_open (argv[0]);
   if (! file)
     goto fail;
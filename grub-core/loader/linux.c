@@ -199,6 +199,7 @@ grub_initrd_init (int argc, char *argv[],
 	  newc = 0;
 	}
       grub_file_filter_disable_compression ();
+      grub_file_filter_defer_pubkey ();
       initrd_ctx->components[i].file = grub_file_open (fname);
       if (!initrd_ctx->components[i].file)
 	{
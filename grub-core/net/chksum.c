@@ -0,0 +1,70 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2010,2011  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/types.h>
+#include <grub/net/ip.h>
+
+/* Internet checksum (RFC 1071).
+
+   The one's complement sum does not depend on byte order, so the data is
+   summed as native 32-bit words into a 64-bit accumulator and the 16-bit
+   result is byte swapped only once at the end.  Carries are folded back
+   after the loop since 2^32 additions of 32-bit words cannot overflow.  */
+grub_uint16_t
+grub_net_ip_chksum (void *ipv, grub_size_t len)
+{
+  const grub_uint8_t *ip = ipv;
+  grub_uint64_t sum = 0;
+
+  for (; len >= 32; len -= 32, ip += 32)
+    {
+      sum += grub_get_unaligned32 (ip);
+      sum += grub_get_unaligned32 (ip + 4);
+      sum += grub_get_unaligned32 (ip + 8);
+      sum += grub_get_unaligned32 (ip + 12);
+      sum += grub_get_unaligned32 (ip + 16);
+      sum += grub_get_unaligned32 (ip + 20);
+      sum += grub_get_unaligned32 (ip + 24);
+      sum += grub_get_unaligned32 (ip + 28);
+    }
+  for (; len >= 4; len -= 4, ip += 4)
+    sum += grub_get_unaligned32 (ip);
+  if (len >= 2)
+    {
+      sum += grub_get_unaligned16 (ip);
+      ip += 2;
+      len -= 2;
+    }
+  if (len)
+    {
+      /* Pad the odd byte with zero in memory order.  */
+      grub_uint8_t last[2] = { *ip, 0 };
+      sum += grub_get_unaligned16 (last);
+    }
+
+  sum = (sum & 0xffffffff) + (sum >> 32);
+  sum = (sum & 0xffffffff) + (sum >> 32);
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+
+  /* Never return a zero checksum, it means "no checksum" for UDP.  */
+  if (sum == 0xffff)
+    sum = 0;
+
+  return (grub_uint16_t) ~sum;
+}
@@ -30,55 +30,90 @@ GRUB_MOD_LICENSE ("GPLv3+");
 static grub_efi_guid_t net_io_guid = GRUB_EFI_SIMPLE_NETWORK_GUID;
 static grub_efi_guid_t pxe_io_guid = GRUB_EFI_PXE_GUID;
 
+/* Number of transmit buffers that may be queued in the firmware.  */
+#define GRUB_EFINET_TX_RING_SIZE 8
+/* Number of frames drained from the firmware in one go.  */
+#define GRUB_EFINET_RX_RING_SIZE 32
+
+static inline void *
+tx_ring_slot (struct grub_net_card *dev, unsigned i)
+{
+  return (char *) dev->txbuf
+    + ((dev->tx_head + i) % GRUB_EFINET_TX_RING_SIZE) * dev->txbufsize;
+}
+
+/* Reclaim the transmit buffers which the firmware is done with.
+   Wait only if the whole ring is still in flight.  */
+static grub_err_t
+reclaim_tx_buffers (struct grub_net_card *dev)
+{
+  grub_efi_status_t st;
+  grub_efi_simple_network_t *net = dev->efi_net;
+  grub_uint64_t limit_time = grub_get_time_ms () + 4000;
+  void *txbuf;
+
+  while (dev->txbusy)
+    {
+      txbuf = NULL;
+      st = efi_call_3 (net->get_status, net, 0, &txbuf);
+      if (st != GRUB_EFI_SUCCESS)
+	return grub_error (GRUB_ERR_IO,
+			   N_("couldn't send network packet"));
+      /*
+	 Some buggy firmware could return an arbitrary address instead of the
+	 txbuf address we trasmitted, so just check that txbuf is non NULL
+	 for success.  This is ok because we open the SNP protocol in
+	 exclusive mode so we know we're the only ones transmitting on this
+	 box and the firmware completes our transmits in order, so the
+	 recycled buffer is always the oldest one in flight.
+       */
+      if (txbuf)
+	{
+	  dev->tx_head = (dev->tx_head + 1) % GRUB_EFINET_TX_RING_SIZE;
+	  dev->txbusy--;
+	  continue;
+	}
+      if (dev->txbusy < GRUB_EFINET_TX_RING_SIZE)
+	break;
+      if (limit_time < grub_get_time_ms ())
+	return grub_error (GRUB_ERR_TIMEOUT,
+			   N_("couldn't send network packet"));
+    }
+
+  return GRUB_ERR_NONE;
+}
+
 static grub_err_t
 send_card_buffer (struct grub_net_card *dev,
 		  struct grub_net_buff *pack)
 {
   grub_efi_status_t st;
   grub_efi_simple_network_t *net = dev->efi_net;
-  grub_uint64_t limit_time = grub_get_time_ms () + 4000;
+  grub_err_t err;
   void *txbuf;
 
-  if (dev->txbusy)
-    while (1)
-      {
-	txbuf = NULL;
-	st = efi_call_3 (net->get_status, net, 0, &txbuf);
-	if (st != GRUB_EFI_SUCCESS)
-	  return grub_error (GRUB_ERR_IO,
-			     N_("couldn't send network packet"));
-	/*
-	   Some buggy firmware could return an arbitrary address instead of the
-	   txbuf address we trasmitted, so just check that txbuf is non NULL
-	   for success.  This is ok because we open the SNP protocol in
-	   exclusive mode so we know we're the only ones transmitting on this
-	   box and since we only transmit one packet at a time we know our
-	   transmit was successfull.
-	 */
-	if (txbuf)
-	  {
-	    dev->txbusy = 0;
-	    break;
-	  }
-	if (limit_time < grub_get_time_ms ())
-	  return grub_error (GRUB_ERR_TIMEOUT,
-			     N_("couldn't send network packet"));
-      }
+  err = reclaim_tx_buffers (dev);
+  if (err)
+    return err;
 
   dev->last_pkt_size = (pack->tail - pack->data);
   if (dev->last_pkt_size > dev->mtu)
     dev->last_pkt_size = dev->mtu;
 
-  grub_memcpy (dev->txbuf, pack->data, dev->last_pkt_size);
+  /* The buffer has to stay untouched until the firmware recycles it,
+     so every packet in flight gets its own ring slot.  */
+  txbuf = tx_ring_slot (dev, dev->txbusy);
+  grub_memcpy (txbuf, pack->data, dev->last_pkt_size);
 
   st = efi_call_7 (net->transmit, net, 0, dev->last_pkt_size,
-		   dev->txbuf, NULL, NULL, NULL);
+		   txbuf, NULL, NULL, NULL);
   if (st != GRUB_EFI_SUCCESS)
     return grub_error (GRUB_ERR_IO, N_("couldn't send network packet"));
+  dev->txbusy++;
 
   /*
-     The card may have sent out the packet immediately - set txbusy
-     to 0 in this case.
+     The card may have sent out the packet immediately - reclaim
+     its buffer right away in this case.
      Cases were observed where checking txbuf at the next call
      of send_card_buffer() is too late: 0 is returned in txbuf and
      we run in the GRUB_ERR_TIMEOUT case above.
@@ -86,42 +121,21 @@ send_card_buffer (struct grub_net_card *dev,
    */
   txbuf = NULL;
   st = efi_call_3 (net->get_status, net, 0, &txbuf);
-  dev->txbusy = !(st == GRUB_EFI_SUCCESS && txbuf);
+  if (st == GRUB_EFI_SUCCESS && txbuf)
+    {
+      dev->tx_head = (dev->tx_head + 1) % GRUB_EFINET_TX_RING_SIZE;
+      dev->txbusy--;
+    }
 
   return GRUB_ERR_NONE;
 }
 
 static struct grub_net_buff *
-get_card_packet (struct grub_net_card *dev)
+alloc_rx_buffer (struct grub_net_card *dev)
 {
-  grub_efi_simple_network_t *net = dev->efi_net;
-  grub_err_t err;
-  grub_efi_status_t st;
-  grub_efi_uintn_t bufsize = dev->rcvbufsize;
   struct grub_net_buff *nb;
-  int i;
 
-  for (i = 0; i < 2; i++)
-    {
-      if (!dev->rcvbuf)
-	dev->rcvbuf = grub_malloc (dev->rcvbufsize);
-      if (!dev->rcvbuf)
-	return NULL;
-
-      st = efi_call_7 (net->receive, net, NULL, &bufsize,
-		       dev->rcvbuf, NULL, NULL, NULL);
-      if (st != GRUB_EFI_BUFFER_TOO_SMALL)
-	break;
-      dev->rcvbufsize = 2 * ALIGN_UP (dev->rcvbufsize > bufsize
-				      ? dev->rcvbufsize : bufsize, 64);
-      grub_free (dev->rcvbuf);
-      dev->rcvbuf = 0;
-    }
-
-  if (st != GRUB_EFI_SUCCESS)
-    return NULL;
-
-  nb = grub_netbuff_alloc (bufsize + 2);
+  nb = grub_netbuff_alloc (dev->rcvbufsize + 2);
   if (!nb)
     return NULL;
 
@@ -132,13 +146,76 @@ get_card_packet (struct grub_net_card *dev)
       grub_netbuff_free (nb);
       return NULL;
     }
-  grub_memcpy (nb->data, dev->rcvbuf, bufsize);
-  err = grub_netbuff_put (nb, bufsize);
-  if (err)
+  return nb;
+}
+
+/* Pull every frame the firmware has queued into the receive ring.
+   Frames are received straight into netbuffs which are handed over to
+   the stack as they are, so no copy is needed.  */
+static void
+fill_rx_ring (struct grub_net_card *dev)
+{
+  grub_efi_simple_network_t *net = dev->efi_net;
+  grub_efi_status_t st;
+  grub_efi_uintn_t bufsize;
+  struct grub_net_buff *nb;
+  unsigned slot;
+  int i;
+
+  while (dev->rx_count < GRUB_EFINET_RX_RING_SIZE)
     {
-      grub_netbuff_free (nb);
-      return NULL;
+      slot = (dev->rx_head + dev->rx_count) % GRUB_EFINET_RX_RING_SIZE;
+      st = GRUB_EFI_NOT_READY;
+      for (i = 0; i < 2; i++)
+	{
+	  if (!dev->rx_ring[slot])
+	    dev->rx_ring[slot] = alloc_rx_buffer (dev);
+	  nb = dev->rx_ring[slot];
+	  if (!nb)
+	    return;
+
+	  bufsize = nb->end - nb->data;
+	  st = efi_call_7 (net->receive, net, NULL, &bufsize,
+			   nb->data, NULL, NULL, NULL);
+	  if (st != GRUB_EFI_BUFFER_TOO_SMALL)
+	    break;
+	  dev->rcvbufsize = 2 * ALIGN_UP (dev->rcvbufsize > bufsize
+					  ? dev->rcvbufsize : bufsize, 64);
+	  grub_netbuff_free (nb);
+	  dev->rx_ring[slot] = NULL;
+	}
+
+      if (st != GRUB_EFI_SUCCESS)
+	return;
+
+      if (grub_netbuff_put (nb, bufsize))
+	return;
+      dev->rx_count++;
     }
+}
+
+static struct grub_net_buff *
+get_card_packet (struct grub_net_card *dev)
+{
+  struct grub_net_buff *nb;
+
+  if (!dev->rx_ring)
+    {
+      dev->rx_ring = grub_zalloc (GRUB_EFINET_RX_RING_SIZE
+				  * sizeof (dev->rx_ring[0]));
+      if (!dev->rx_ring)
+	return NULL;
+    }
+
+  if (!dev->rx_count)
+    fill_rx_ring (dev);
+  if (!dev->rx_count)
+    return NULL;
+
+  nb = dev->rx_ring[dev->rx_head];
+  dev->rx_ring[dev->rx_head] = NULL;
+  dev->rx_head = (dev->rx_head + 1) % GRUB_EFINET_RX_RING_SIZE;
+  dev->rx_count--;
 
   return nb;
 }
@@ -205,11 +282,26 @@ open_card (struct grub_net_card *dev)
 static void
 close_card (struct grub_net_card *dev)
 {
+  unsigned i;
+
+  /* Pending frames are dropped along with the spare buffers.  */
+  if (dev->rx_ring)
+    for (i = 0; i < GRUB_EFINET_RX_RING_SIZE; i++)
+      {
+	grub_netbuff_free (dev->rx_ring[i]);
+	dev->rx_ring[i] = NULL;
+      }
+  dev->rx_head = 0;
+  dev->rx_count = 0;
+
   efi_call_1 (dev->efi_net->shutdown, dev->efi_net);
   efi_call_1 (dev->efi_net->stop, dev->efi_net);
   efi_call_4 (grub_efi_system_table->boot_services->close_protocol,
 	      dev->efi_net, &net_io_guid,
 	      grub_efi_image_handle, dev->efi_handle);
+  /* Shutting the card down discards any transmits still in flight.  */
+  dev->tx_head = 0;
+  dev->txbusy = 0;
 }
 
 static struct grub_net_card_driver efidriver =
@@ -297,7 +389,7 @@ grub_efinet_findcards (void)
 
       card->mtu = net->mode->max_packet_size;
       card->txbufsize = ALIGN_UP (card->mtu, 64) + 256;
-      card->txbuf = grub_zalloc (card->txbufsize);
+      card->txbuf = grub_zalloc (card->txbufsize * GRUB_EFINET_TX_RING_SIZE);
       if (!card->txbuf)
 	{
 	  grub_print_error ();
@@ -76,6 +76,8 @@ send_ethernet_packet (struct grub_net_network_level_interface *inf,
 	return err;
       inf->card->opened = 1;
     }
+  grub_net_stats.tx_packets++;
+  grub_net_stats.tx_bytes += nb->tail - nb->data;
   return inf->card->driver->send (inf->card, nb);
 }
 
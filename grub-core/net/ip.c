@@ -92,31 +92,6 @@ struct reassemble
 
 static struct reassemble *reassembles;
 
-grub_uint16_t
-grub_net_ip_chksum (void *ipv, grub_size_t len)
-{
-  grub_uint16_t *ip = (grub_uint16_t *) ipv;
-  grub_uint32_t sum = 0;
-
-  for (; len >= 2; len -= 2)
-    {
-      sum += grub_be_to_cpu16 (grub_get_unaligned16 (ip++));
-      if (sum > 0xFFFF)
-	sum -= 0xFFFF;
-    }
-  if (len)
-    {
-      sum += *((grub_uint8_t *) ip) << 8;
-      if (sum > 0xFFFF)
-	sum -= 0xFFFF;
-    }
-
-  if (sum >= 0xFFFF)
-    sum -= 0xFFFF;
-
-  return grub_cpu_to_be16 ((~sum) & 0x0000FFFF);
-}
-
 static int id = 0x2400;
 
 static grub_err_t
@@ -256,6 +231,7 @@ handle_dgram (struct grub_net_buff *nb,
 			      "Expected %x, got %x\n", 
 			      grub_be_to_cpu16 (expected),
 			      grub_be_to_cpu16 (chk));
+		grub_net_stats.bad_checksums++;
 		grub_netbuff_free (nb);
 		return GRUB_ERR_NONE;
 	      }
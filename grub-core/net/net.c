@@ -40,6 +40,7 @@ char *grub_net_default_server;
 struct grub_net_route *grub_net_routes = NULL;
 struct grub_net_network_level_interface *grub_net_network_level_interfaces = NULL;
 struct grub_net_card *grub_net_cards = NULL;
+struct grub_net_stats grub_net_stats;
 struct grub_net_network_level_protocol *grub_net_network_level_protocols = NULL;
 static struct grub_fs grub_net_fs;
 
@@ -50,20 +51,52 @@ struct grub_net_link_layer_entry {
 };
 
 #define LINK_LAYER_CACHE_SIZE 256
+/* An address lives in one of the slots following its hash.  */
+#define LINK_LAYER_CACHE_PROBES 8
+
+static grub_uint32_t
+net_addr_hash (const grub_net_network_level_address_t *addr)
+{
+  grub_uint32_t h = 0;
+
+  switch (addr->type)
+    {
+    case GRUB_NET_NETWORK_LEVEL_PROTOCOL_IPV4:
+      h = addr->ipv4;
+      break;
+    case GRUB_NET_NETWORK_LEVEL_PROTOCOL_IPV6:
+      {
+	grub_uint64_t t = addr->ipv6[0] ^ addr->ipv6[1];
+	h = t ^ (t >> 32);
+	break;
+      }
+    case GRUB_NET_NETWORK_LEVEL_PROTOCOL_DHCP_RECV:
+      break;
+    }
+  h ^= h >> 16;
+  h *= 0x45d9f3b;
+  h ^= h >> 16;
+  return h;
+}
 
 static struct grub_net_link_layer_entry *
 link_layer_find_entry (const grub_net_network_level_address_t *proto,
 		       const struct grub_net_card *card)
 {
-  unsigned i;
+  struct grub_net_link_layer_entry *entry;
+  unsigned i, h;
+
   if (!card->link_layer_table)
     return NULL;
-  for (i = 0; i < LINK_LAYER_CACHE_SIZE; i++)
+  h = net_addr_hash (proto);
+  for (i = 0; i < LINK_LAYER_CACHE_PROBES; i++)
     {
-      if (card->link_layer_table[i].avail == 1 
-	  && grub_net_addr_cmp (&card->link_layer_table[i].nl_address,
-				proto) == 0)
-	return &card->link_layer_table[i];
+      entry = &card->link_layer_table[(h + i) % LINK_LAYER_CACHE_SIZE];
+      /* Entries are never removed, so there is nothing past a free slot.  */
+      if (entry->avail != 1)
+	return NULL;
+      if (grub_net_addr_cmp (&entry->nl_address, proto) == 0)
+	return entry;
     }
   return NULL;
 }
@@ -75,6 +108,7 @@ grub_net_link_layer_add_address (struct grub_net_card *card,
 				 int override)
 {
   struct grub_net_link_layer_entry *entry;
+  unsigned i, h;
 
   /* Check if the sender is in the cache table.  */
   entry = link_layer_find_entry (nl, card);
@@ -88,13 +122,27 @@ grub_net_link_layer_add_address (struct grub_net_card *card,
   if (card->link_layer_table == NULL)
     card->link_layer_table = grub_zalloc (LINK_LAYER_CACHE_SIZE
 					  * sizeof (card->link_layer_table[0]));
-  entry = &(card->link_layer_table[card->new_ll_entry]);
+  if (card->link_layer_table == NULL)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  /* Take the first free slot, or replace the entries of a full run in
+     turn.  */
+  h = net_addr_hash (nl);
+  for (i = 0; i < LINK_LAYER_CACHE_PROBES; i++)
+    if (card->link_layer_table[(h + i) % LINK_LAYER_CACHE_SIZE].avail != 1)
+      break;
+  if (i == LINK_LAYER_CACHE_PROBES)
+    {
+      i = card->new_ll_entry;
+      card->new_ll_entry = (card->new_ll_entry + 1) % LINK_LAYER_CACHE_PROBES;
+    }
+  entry = &card->link_layer_table[(h + i) % LINK_LAYER_CACHE_SIZE];
   entry->avail = 1;
   grub_memcpy (&entry->ll_address, ll, sizeof (entry->ll_address));
   grub_memcpy (&entry->nl_address, nl, sizeof (entry->nl_address));
-  card->new_ll_entry++;
-  if (card->new_ll_entry == LINK_LAYER_CACHE_SIZE)
-    card->new_ll_entry = 0;
 }
 
 int
@@ -628,10 +676,31 @@ route_cmp (const struct grub_net_route *a, const struct grub_net_route *b)
   return 0;
 }
 
-grub_err_t
-grub_net_route_address (grub_net_network_level_address_t addr,
-			grub_net_network_level_address_t *gateway,
-			struct grub_net_network_level_interface **interf)
+/* Small cache of recent route lookups, indexed by destination hash.  */
+#define ROUTE_CACHE_SIZE 32
+
+struct route_cache_entry
+{
+  int avail;
+  grub_net_network_level_address_t addr;
+  grub_net_network_level_address_t gateway;
+  struct grub_net_network_level_interface *interface;
+};
+
+static struct route_cache_entry route_cache[ROUTE_CACHE_SIZE];
+
+/* Must be called whenever a route or an interface goes away or a route
+   is added.  */
+void
+grub_net_route_cache_flush (void)
+{
+  grub_memset (route_cache, 0, sizeof (route_cache));
+}
+
+static grub_err_t
+route_address_real (grub_net_network_level_address_t addr,
+		    grub_net_network_level_address_t *gateway,
+		    struct grub_net_network_level_interface **interf)
 {
   struct grub_net_route *route;
   unsigned int depth = 0;
@@ -684,6 +753,33 @@ grub_net_route_address (grub_net_network_level_address_t addr,
 		     N_("route loop detected"));
 }
 
+grub_err_t
+grub_net_route_address (grub_net_network_level_address_t addr,
+			grub_net_network_level_address_t *gateway,
+			struct grub_net_network_level_interface **interf)
+{
+  struct route_cache_entry *entry;
+  grub_err_t err;
+
+  entry = &route_cache[net_addr_hash (&addr) % ROUTE_CACHE_SIZE];
+  if (entry->avail && grub_net_addr_cmp (&entry->addr, &addr) == 0)
+    {
+      *gateway = entry->gateway;
+      *interf = entry->interface;
+      return GRUB_ERR_NONE;
+    }
+
+  err = route_address_real (addr, gateway, interf);
+  if (err)
+    return err;
+
+  entry->avail = 1;
+  entry->addr = addr;
+  entry->gateway = *gateway;
+  entry->interface = *interf;
+  return GRUB_ERR_NONE;
+}
+
 static grub_err_t
 grub_cmd_deladdr (struct grub_command *cmd __attribute__ ((unused)),
 		  int argc, char **args)
@@ -1058,6 +1154,7 @@ grub_cmd_delroute (struct grub_command *cmd __attribute__ ((unused)),
 	*prev = route->next;
 	grub_free (route->name);
 	grub_free (route);
+	grub_net_route_cache_flush ();
 	if (!*prev)
 	  break;
       }
@@ -1403,52 +1500,298 @@ grub_net_fs_dir (grub_device_t device, const char *path __attribute__ ((unused))
   return GRUB_ERR_NONE;
 }
 
+/* Network file cache.  Files of known size are kept in memory in chunks,
+   so that re-reads and backward seeks are served locally instead of
+   downloading the data again.  The memory used is bounded by
+   $net_cache_size (in MiB); nothing is cached if it is unset or 0.  */
+#define GRUB_NET_CACHE_CHUNK_SHIFT 16
+#define GRUB_NET_CACHE_CHUNK_SIZE (1 << GRUB_NET_CACHE_CHUNK_SHIFT)
+
+struct grub_net_cache_chunk
+{
+  char *data;
+  grub_uint64_t last_use;
+};
+
+struct grub_net_cache_entry
+{
+  struct grub_net_cache_entry *next;
+  struct grub_net_cache_entry **prev;
+  char *key;
+  grub_off_t size;
+  grub_off_t cached;
+  grub_size_t nchunks;
+  struct grub_net_cache_chunk *chunks;
+  int users;
+};
+
+static struct grub_net_cache_entry *net_cache;
+static grub_size_t net_cache_used;
+static grub_uint64_t net_cache_tick;
+
+static grub_size_t
+net_cache_limit (void)
+{
+  const char *val;
+  unsigned long mb;
+
+  val = grub_env_get ("net_cache_size");
+  if (!val)
+    return 0;
+  mb = grub_strtoul (val, 0, 0);
+  if (grub_errno)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+  if (mb > (GRUB_SIZE_MAX >> 20))
+    mb = GRUB_SIZE_MAX >> 20;
+  return (grub_size_t) mb << 20;
+}
+
+static grub_size_t
+net_cache_chunk_len (const struct grub_net_cache_entry *entry, grub_size_t i)
+{
+  if (i == entry->nchunks - 1)
+    return entry->size - ((grub_off_t) i << GRUB_NET_CACHE_CHUNK_SHIFT);
+  return GRUB_NET_CACHE_CHUNK_SIZE;
+}
+
+static void
+net_cache_drop_chunk (struct grub_net_cache_entry *entry, grub_size_t i)
+{
+  grub_size_t len = net_cache_chunk_len (entry, i);
+
+  grub_free (entry->chunks[i].data);
+  entry->chunks[i].data = NULL;
+  entry->cached -= len;
+  net_cache_used -= len;
+}
+
+static void
+net_cache_free_entry (struct grub_net_cache_entry *entry)
+{
+  grub_size_t i;
+
+  for (i = 0; i < entry->nchunks; i++)
+    if (entry->chunks[i].data)
+      net_cache_drop_chunk (entry, i);
+  grub_list_remove (GRUB_AS_LIST (entry));
+  grub_free (entry->chunks);
+  grub_free (entry->key);
+  grub_free (entry);
+}
+
+static void
+net_cache_flush (void)
+{
+  struct grub_net_cache_entry *entry, *next;
+  grub_size_t i;
+
+  FOR_LIST_ELEMENTS_SAFE (entry, next, net_cache)
+    {
+      if (!entry->users)
+	{
+	  net_cache_free_entry (entry);
+	  continue;
+	}
+      for (i = 0; i < entry->nchunks; i++)
+	if (entry->chunks[i].data)
+	  net_cache_drop_chunk (entry, i);
+    }
+}
+
+/* Free every entry, including those of files still open.  Only for
+   unloading the module, after which nothing reads through them.  */
+static void
+net_cache_free_all (void)
+{
+  struct grub_net_cache_entry *entry, *next;
+
+  FOR_LIST_ELEMENTS_SAFE (entry, next, net_cache)
+    net_cache_free_entry (entry);
+}
+
+/* Evict least recently used chunks until LEN more bytes fit.  */
+static int
+net_cache_make_room (grub_size_t len)
+{
+  grub_size_t limit = net_cache_limit ();
+
+  if (len > limit)
+    return 0;
+  while (net_cache_used + len > limit)
+    {
+      struct grub_net_cache_entry *entry, *victim = NULL;
+      grub_size_t i, victim_chunk = 0;
+
+      FOR_LIST_ELEMENTS (entry, net_cache)
+	for (i = 0; i < entry->nchunks; i++)
+	  if (entry->chunks[i].data
+	      && (!victim || entry->chunks[i].last_use
+		  < victim->chunks[victim_chunk].last_use))
+	    {
+	      victim = entry;
+	      victim_chunk = i;
+	    }
+      if (!victim)
+	return 0;
+      net_cache_drop_chunk (victim, victim_chunk);
+    }
+  return 1;
+}
+
+static struct grub_net_cache_entry *
+net_cache_find (const char *key)
+{
+  struct grub_net_cache_entry *entry;
+
+  FOR_LIST_ELEMENTS (entry, net_cache)
+    if (grub_strcmp (entry->key, key) == 0)
+      return entry;
+  return NULL;
+}
+
+/* Return a referenced cache entry for KEY of SIZE bytes, creating it if
+   needed.  KEY is consumed.  */
+static struct grub_net_cache_entry *
+net_cache_get (char *key, grub_off_t size)
+{
+  struct grub_net_cache_entry *entry;
+
+  entry = net_cache_find (key);
+  if (entry && entry->size != size)
+    {
+      /* The file changed on the server.  */
+      if (entry->users)
+	{
+	  grub_free (key);
+	  return NULL;
+	}
+      net_cache_free_entry (entry);
+      entry = NULL;
+    }
+
+  if (!entry)
+    {
+      entry = grub_zalloc (sizeof (*entry));
+      if (!entry)
+	goto fail;
+      entry->size = size;
+      entry->nchunks = (size + GRUB_NET_CACHE_CHUNK_SIZE - 1)
+	>> GRUB_NET_CACHE_CHUNK_SHIFT;
+      entry->chunks = grub_zalloc (entry->nchunks * sizeof (entry->chunks[0]));
+      if (!entry->chunks)
+	{
+	  grub_free (entry);
+	  goto fail;
+	}
+      entry->key = key;
+      key = NULL;
+      grub_list_push (GRUB_AS_LIST_P (&net_cache), GRUB_AS_LIST (entry));
+    }
+
+  grub_free (key);
+  entry->users++;
+  return entry;
+
+ fail:
+  grub_errno = GRUB_ERR_NONE;
+  grub_free (key);
+  return NULL;
+}
+
+static char *
+net_cache_key (grub_net_t net, const char *name)
+{
+  char *key;
+
+  if (!net_cache_limit ())
+    return NULL;
+  key = grub_xasprintf ("%s,%s,%s", net->protocol->name, net->server, name);
+  if (!key)
+    grub_errno = GRUB_ERR_NONE;
+  return key;
+}
+
+static void
+drop_packets (grub_net_t net)
+{
+  while (net->packs.first)
+    {
+      grub_netbuff_free (net->packs.first->nb);
+      grub_net_remove_packet (net->packs.first);
+    }
+}
+
 static grub_err_t
 grub_net_fs_open (struct grub_file *file_out, const char *name)
 {
   grub_err_t err;
   struct grub_file *file, *bufio;
+  struct grub_net_cache_entry *entry = NULL;
+  grub_net_t net = file_out->device->net;
+  char *key;
 
   file = grub_malloc (sizeof (*file));
   if (!file)
     return grub_errno;
 
   grub_memcpy (file, file_out, sizeof (struct grub_file));
-  file->device->net->packs.first = NULL;
-  file->device->net->packs.last = NULL;
-  file->device->net->name = grub_strdup (name);
-  if (!file->device->net->name)
+  net->packs.first = NULL;
+  net->packs.last = NULL;
+  net->cache = NULL;
+  net->from_cache = 0;
+  net->name = grub_strdup (name);
+  if (!net->name)
     {
       grub_free (file);
       return grub_errno;
     }
 
-  err = file->device->net->protocol->open (file, name);
-  if (err)
+  key = net_cache_key (net, name);
+  if (key)
+    entry = net_cache_find (key);
+
+  if (entry && entry->cached == entry->size)
     {
-      while (file->device->net->packs.first)
+      /* Everything is in memory, don't even talk to the server.  */
+      file->size = entry->size;
+      file->not_easily_seekable = 0;
+      net->from_cache = 1;
+    }
+  else
+    {
+      err = net->protocol->open (file, name);
+      if (err)
 	{
-	  grub_netbuff_free (file->device->net->packs.first->nb);
-	  grub_net_remove_packet (file->device->net->packs.first);
+	  drop_packets (net);
+	  grub_free (key);
+	  grub_free (net->name);
+	  grub_free (file);
+	  return err;
 	}
-      grub_free (file->device->net->name);
-      grub_free (file);
-      return err;
     }
+
   bufio = grub_bufio_open (file, 32768);
   if (! bufio)
     {
-      while (file->device->net->packs.first)
+      if (!net->from_cache)
 	{
-	  grub_netbuff_free (file->device->net->packs.first->nb);
-	  grub_net_remove_packet (file->device->net->packs.first);
+	  drop_packets (net);
+	  net->protocol->close (file);
 	}
-      file->device->net->protocol->close (file);
-      grub_free (file->device->net->name);
+      grub_free (key);
+      grub_free (net->name);
       grub_free (file);
       return grub_errno;
     }
 
+  if (key && file->size != GRUB_FILE_SIZE_UNKNOWN)
+    net->cache = net_cache_get (key, file->size);
+  else
+    grub_free (key);
+
   grub_memcpy (file_out, bufio, sizeof (struct grub_file));
   grub_free (bufio);
   return GRUB_ERR_NONE;
@@ -1457,13 +1800,44 @@ grub_net_fs_open (struct grub_file *file_out, const char *name)
 static grub_err_t
 grub_net_fs_close (grub_file_t file)
 {
-  while (file->device->net->packs.first)
+  grub_net_t net = file->device->net;
+
+  if (!net->from_cache)
+    {
+      drop_packets (net);
+      net->protocol->close (file);
+    }
+  if (net->cache)
     {
-      grub_netbuff_free (file->device->net->packs.first->nb);
-      grub_net_remove_packet (file->device->net->packs.first);
+      if (!--net->cache->users && !net->cache->cached)
+	net_cache_free_entry (net->cache);
+      net->cache = NULL;
     }
-  file->device->net->protocol->close (file);
-  grub_free (file->device->net->name);
+  grub_free (net->name);
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+grub_cmd_net_cache (struct grub_command *cmd __attribute__ ((unused)),
+		    int argc, char **args)
+{
+  struct grub_net_cache_entry *entry;
+
+  if (argc > 0)
+    {
+      if (grub_strcmp (args[0], "flush") != 0)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("invalid argument"));
+      net_cache_flush ();
+      return GRUB_ERR_NONE;
+    }
+
+  FOR_LIST_ELEMENTS (entry, net_cache)
+    grub_printf ("%s %llu/%llu\n", entry->key,
+		 (unsigned long long) entry->cached,
+		 (unsigned long long) entry->size);
+  grub_printf_ (N_("Using %llu KiB of %llu KiB\n"),
+		(unsigned long long) (net_cache_used >> 10),
+		(unsigned long long) (net_cache_limit () >> 10));
   return GRUB_ERR_NONE;
 }
 
@@ -1490,18 +1864,26 @@ receive_packets (struct grub_net_card *card, int *stop_condition)
       /* Maybe should be better have a fixed number of packets for each card
 	 and just mark them as used and not used.  */ 
       struct grub_net_buff *nb;
+      grub_uint64_t start, now;
 
       if (received > 10 && stop_condition && *stop_condition)
 	break;
 
+      start = grub_get_time_ms ();
       nb = card->driver->recv (card);
+      now = grub_get_time_ms ();
       if (!nb)
 	{
-	  card->last_poll = grub_get_time_ms ();
+	  grub_net_stats.idle_ms += now - start;
+	  card->last_poll = now;
 	  break;
 	}
+      grub_net_stats.driver_ms += now - start;
+      grub_net_stats.rx_packets++;
+      grub_net_stats.rx_bytes += nb->tail - nb->data;
       received++;
       grub_net_recv_ethernet_packet (nb, card);
+      grub_net_stats.stack_ms += grub_get_time_ms () - now;
       if (grub_errno)
 	{
 	  grub_dprintf ("net", "error receiving: %d: %s\n", grub_errno,
@@ -1691,7 +2073,7 @@ grub_net_seek_real (struct grub_file *file, grub_off_t offset)
 }
 
 static grub_ssize_t
-grub_net_fs_read (grub_file_t file, char *buf, grub_size_t len)
+grub_net_fs_read_stream (grub_file_t file, char *buf, grub_size_t len)
 {
   if (file->offset != file->device->net->offset)
     {
@@ -1703,6 +2085,115 @@ grub_net_fs_read (grub_file_t file, char *buf, grub_size_t len)
   return grub_net_fs_read_real (file, buf, len);
 }
 
+/* Read LEN bytes at OFFSET from the server, bypassing the cache.  */
+static grub_ssize_t
+net_cache_fetch (grub_file_t file, grub_off_t offset, char *buf,
+		 grub_size_t len)
+{
+  grub_net_t net = file->device->net;
+
+  if (net->from_cache)
+    {
+      /* Chunks were evicted since the file was opened.  */
+      grub_err_t err;
+
+      net->offset = 0;
+      net->eof = 0;
+      net->stall = 0;
+      err = net->protocol->open (file, net->name);
+      if (err)
+	{
+	  drop_packets (net);
+	  return -1;
+	}
+      net->from_cache = 0;
+    }
+  if (offset != net->offset && grub_net_seek_real (file, offset))
+    return -1;
+  return grub_net_fs_read_real (file, buf, len);
+}
+
+static grub_ssize_t
+net_cache_read (grub_file_t file, char *buf, grub_size_t len)
+{
+  struct grub_net_cache_entry *entry = file->device->net->cache;
+  grub_off_t offset = file->offset;
+  grub_size_t total = 0;
+
+  if (offset >= entry->size)
+    return 0;
+  if (len > entry->size - offset)
+    len = entry->size - offset;
+
+  while (len)
+    {
+      grub_size_t i = offset >> GRUB_NET_CACHE_CHUNK_SHIFT;
+      grub_size_t skip = offset & (GRUB_NET_CACHE_CHUNK_SIZE - 1);
+      grub_size_t chunk_len = net_cache_chunk_len (entry, i);
+      grub_size_t amount = chunk_len - skip;
+      struct grub_net_cache_chunk *chunk = &entry->chunks[i];
+      grub_ssize_t r;
+
+      if (amount > len)
+	amount = len;
+
+      if (!chunk->data && net_cache_make_room (chunk_len))
+	{
+	  chunk->data = grub_malloc (chunk_len);
+	  if (!chunk->data)
+	    grub_errno = GRUB_ERR_NONE;
+	  else
+	    {
+	      r = net_cache_fetch (file, (grub_off_t) i
+				   << GRUB_NET_CACHE_CHUNK_SHIFT,
+				   chunk->data, chunk_len);
+	      if (r != (grub_ssize_t) chunk_len)
+		{
+		  grub_free (chunk->data);
+		  chunk->data = NULL;
+		  if (r >= 0)
+		    grub_error (GRUB_ERR_FILE_READ_ERROR,
+				N_("premature end of file %s"),
+				file->device->net->name);
+		  return -1;
+		}
+	      entry->cached += chunk_len;
+	      net_cache_used += chunk_len;
+	    }
+	}
+
+      if (chunk->data)
+	{
+	  chunk->last_use = ++net_cache_tick;
+	  if (buf)
+	    grub_memcpy (buf + total, chunk->data + skip, amount);
+	}
+      else
+	{
+	  /* No room in the cache, read around it.  */
+	  r = net_cache_fetch (file, offset, buf ? buf + total : NULL, amount);
+	  if (r < 0)
+	    return -1;
+	  if (r != (grub_ssize_t) amount)
+	    return total + r;
+	}
+
+      total += amount;
+      offset += amount;
+      len -= amount;
+    }
+
+  return total;
+}
+
+static grub_ssize_t
+grub_net_fs_read (grub_file_t file, char *buf, grub_size_t len)
+{
+  if (file->device->net->cache)
+    return net_cache_read (file, buf, len);
+  return grub_net_fs_read_stream (file, buf, len);
+}
+
 static struct grub_fs grub_net_fs =
   {
     .name = "netfs",
@@ -1739,7 +2230,7 @@ static struct grub_preboot *fini_hnd;
 
 static grub_command_t cmd_addaddr, cmd_deladdr, cmd_addroute, cmd_delroute;
 static grub_command_t cmd_lsroutes, cmd_lscards;
-static grub_command_t cmd_lsaddr, cmd_slaac;
+static grub_command_t cmd_lsaddr, cmd_slaac, cmd_cache;
 
 GRUB_MOD_INIT(net)
 {
@@ -1782,6 +2273,9 @@ GRUB_MOD_INIT(net)
 				       "", N_("list network cards"));
   cmd_lsaddr = grub_register_command ("net_ls_addr", grub_cmd_listaddrs,
 				       "", N_("list network addresses"));
+  cmd_cache = grub_register_command ("net_cache", grub_cmd_net_cache,
+				     "[flush]",
+				     N_("Show or flush the network file cache."));
   grub_bootp_init ();
   grub_dns_init ();
 
@@ -1807,6 +2301,8 @@ GRUB_MOD_FINI(net)
   grub_unregister_command (cmd_lscards);
   grub_unregister_command (cmd_lsaddr);
   grub_unregister_command (cmd_slaac);
+  grub_unregister_command (cmd_cache);
+  net_cache_free_all ();
   grub_fs_unregister (&grub_net_fs);
   grub_net_open = NULL;
   grub_net_fini_hw (0);
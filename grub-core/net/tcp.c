@@ -384,6 +384,7 @@ grub_net_tcp_retransmit (void)
 	  }
 	unack->try_count++;
 	unack->last_try = ctime;
+	grub_net_stats.retransmits++;
 	nbd = unack->nb->data;
 	tcph = (struct tcphdr *) nbd;
 
@@ -810,6 +811,7 @@ grub_net_recv_tcp_packet (struct grub_net_buff *nb,
 			  "Expected %x, got %x\n",
 			  grub_be_to_cpu16 (expected),
 			  grub_be_to_cpu16 (chk));
+	    grub_net_stats.bad_checksums++;
 	    grub_netbuff_free (nb);
 	    return GRUB_ERR_NONE;
 	  }
@@ -855,6 +857,9 @@ grub_net_recv_tcp_packet (struct grub_net_buff *nb,
 
 	    if (seqnr > acked)
 	      break;
+	    /* Karn's rule: a retransmitted segment gives no RTT sample.  */
+	    if (unack->try_count == 1)
+	      grub_net_stats_rtt (grub_get_time_ms () - unack->last_try);
 	    grub_netbuff_free (unack->nb);
 	    grub_free (unack);
 	  }
@@ -865,6 +870,7 @@ grub_net_recv_tcp_packet (struct grub_net_buff *nb,
 
     if (grub_be_to_cpu32 (tcph->seqnr) < sock->their_cur_seq)
       {
+	grub_net_stats.duplicates++;
 	ack (sock);
 	grub_netbuff_free (nb);
 	return GRUB_ERR_NONE;
@@ -901,6 +907,7 @@ grub_net_recv_tcp_packet (struct grub_net_buff *nb,
 	}
       if (grub_be_to_cpu32 (tcph->seqnr) != sock->their_cur_seq)
 	{
+	  grub_net_stats.out_of_order++;
 	  ack (sock);
 	  return GRUB_ERR_NONE;
 	}
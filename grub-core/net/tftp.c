@@ -27,6 +27,7 @@
 #include <grub/file.h>
 #include <grub/priority_queue.h>
 #include <grub/i18n.h>
+#include <grub/time.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -103,6 +104,10 @@ typedef struct tftp_data
   grub_uint64_t block;
   grub_uint32_t block_size;
   grub_uint64_t ack_sent;
+  /* When the last request or ack went out and whether the reply to it may
+     still be timed, for the network statistics.  */
+  grub_uint64_t rtt_start;
+  int rtt_valid;
   int have_oack;
   struct grub_error_saved save_err;
   grub_net_udp_socket_t sock;
@@ -159,6 +164,21 @@ ack (tftp_data_t data, grub_uint64_t block)
   return GRUB_ERR_NONE;
 }
 
+static void
+rtt_sample (tftp_data_t data)
+{
+  if (data->rtt_valid)
+    grub_net_stats_rtt (grub_get_time_ms () - data->rtt_start);
+  data->rtt_valid = 0;
+}
+
+static void
+rtt_start (tftp_data_t data)
+{
+  data->rtt_start = grub_get_time_ms ();
+  data->rtt_valid = 1;
+}
+
 static grub_err_t
 tftp_receive (grub_net_udp_socket_t sock __attribute__ ((unused)),
 	      struct grub_net_buff *nb,
@@ -196,7 +216,10 @@ tftp_receive (grub_net_udp_socket_t sock __attribute__ ((unused)),
 	}
       data->block = 0;
       grub_netbuff_free (nb);
+      rtt_sample (data);
       err = ack (data, 0);
+      if (!err)
+	rtt_start (data);
       grub_error_save (&data->save_err);
       return GRUB_ERR_NONE;
     case TFTP_DATA:
@@ -207,6 +230,17 @@ tftp_receive (grub_net_udp_socket_t sock __attribute__ ((unused)),
 	  return GRUB_ERR_NONE;
 	}
 
+      switch (cmp_block (grub_be_to_cpu16 (tftph->u.data.block),
+			 data->block + 1))
+	{
+	case 0:
+	  rtt_sample (data);
+	  break;
+	case 1:
+	  grub_net_stats.out_of_order++;
+	  break;
+	}
+
       err = grub_priority_queue_push (data->pq, &nb);
       if (err)
 	return err;
@@ -222,6 +256,9 @@ tftp_receive (grub_net_udp_socket_t sock __attribute__ ((unused)),
 	    tftph = (struct tftphdr *) nb_top->data;
 	    if (cmp_block (grub_be_to_cpu16 (tftph->u.data.block), data->block + 1) >= 0)
 	      break;
+	    /* The server resent a block so the next one can't be timed.  */
+	    grub_net_stats.duplicates++;
+	    data->rtt_valid = 0;
 	    ack (data, grub_be_to_cpu16 (tftph->u.data.block));
 	    grub_netbuff_free (nb_top);
 	    grub_priority_queue_pop (data->pq);
@@ -233,7 +270,10 @@ tftp_receive (grub_net_udp_socket_t sock __attribute__ ((unused)),
 	    grub_priority_queue_pop (data->pq);
 
 	    if (file->device->net->packs.count < 50)
-	      err = ack (data, data->block + 1);
+	      {
+		err = ack (data, data->block + 1);
+		rtt_start (data);
+	      }
 	    else
 	      {
 		file->device->net->stall = 1;
@@ -402,6 +442,13 @@ tftp_open (struct grub_file *file, const char *filename)
   for (i = 0; i < GRUB_NET_TRIES; i++)
     {
       nb.data = nbd;
+      if (i == 0)
+	rtt_start (data);
+      else
+	{
+	  grub_net_stats.retransmits++;
+	  data->rtt_valid = 0;
+	}
       err = grub_net_send_udp_packet (data->sock, &nb);
       if (err)
 	{
@@ -482,6 +529,7 @@ tftp_packets_pulled (struct grub_file *file)
     file->device->net->stall = 0;
   if (data->ack_sent >= data->block)
     return 0;
+  rtt_start (data);
   return ack (data, data->block);
 }
 
@@ -182,6 +182,7 @@ grub_net_recv_udp_packet (struct grub_net_buff *nb,
 			      "Expected %x, got %x\n",
 			      grub_be_to_cpu16 (expected),
 			      grub_be_to_cpu16 (chk));
+		grub_net_stats.bad_checksums++;
 		grub_netbuff_free (nb);
 		return GRUB_ERR_NONE;
 	      }
@@ -0,0 +1,117 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2017  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/crypto.h>
+#include <grub/cryptodisk.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define FIRST_SECTOR 7
+#define NSECTORS 3
+
+/* Sector S of the ciphertext holds (I * 7 + S) & 0xff at offset I.  The
+   expected values are SHA-256 digests of the plaintext, as produced by
+   OpenSSL with the key 00 01 02 ... 1f truncated to KEYSIZE.  */
+static struct
+{
+  grub_cryptodisk_mode_t mode;
+  grub_cryptodisk_mode_iv_t mode_iv;
+  grub_size_t keysize;
+  const char *digest;
+} vectors[] = {
+  /* aes-xts-plain64, 2 x 128-bit keys.  */
+  {
+    GRUB_CRYPTODISK_MODE_XTS, GRUB_CRYPTODISK_MODE_IV_PLAIN64, 32,
+    "\x2c\xb7\x73\x68\x10\x19\x2e\x91\xed\x7d\x89\xa7\x08\x19\x25\x46"
+    "\xb8\x84\xc2\xca\xeb\x31\x57\x4a\x32\x9f\x61\x60\x86\x87\x4c\xce"
+  },
+  /* aes-cbc-plain64, 128-bit key.  */
+  {
+    GRUB_CRYPTODISK_MODE_CBC, GRUB_CRYPTODISK_MODE_IV_PLAIN64, 16,
+    "\x82\x15\x30\x41\x05\xf3\x6e\xed\xa2\x18\xe3\xe1\xad\x9c\xb7\x61"
+    "\x48\x73\x32\xf4\x6f\xfc\x21\x30\x0d\x49\x06\x87\x24\xed\x13\x7f"
+  },
+  /* aes-cbc-essiv:sha256, 128-bit key.  */
+  {
+    GRUB_CRYPTODISK_MODE_CBC, GRUB_CRYPTODISK_MODE_IV_ESSIV, 16,
+    "\xab\x3a\xc8\x3c\x8c\x32\x35\xb0\x58\x47\x87\xf3\x71\x32\x3d\x7c"
+    "\x5d\x5b\x0d\xaf\x5f\x74\xd7\x79\x35\xc3\xbd\xa6\x0d\x8c\xd5\xd2"
+  }
+};
+
+static void
+cryptodisk_test (void)
+{
+  const gcry_cipher_spec_t *aes;
+  grub_uint8_t key[32];
+  grub_uint8_t buf[NSECTORS << 9];
+  grub_uint8_t digest[32];
+  grub_size_t i, j;
+
+  aes = grub_crypto_lookup_cipher_by_name ("aes");
+  grub_test_assert (aes != NULL, "aes cipher not found");
+  if (!aes)
+    return;
+
+  for (i = 0; i < sizeof (key); i++)
+    key[i] = i;
+
+  for (i = 0; i < ARRAY_SIZE (vectors); i++)
+    {
+      struct grub_cryptodisk dev;
+      gcry_err_code_t err;
+
+      grub_memset (&dev, 0, sizeof (dev));
+      dev.cipher = grub_crypto_cipher_open (aes);
+      if (vectors[i].mode == GRUB_CRYPTODISK_MODE_XTS)
+	dev.secondary_cipher = grub_crypto_cipher_open (aes);
+      if (vectors[i].mode_iv == GRUB_CRYPTODISK_MODE_IV_ESSIV)
+	{
+	  dev.essiv_cipher = grub_crypto_cipher_open (aes);
+	  dev.essiv_hash = GRUB_MD_SHA256;
+	}
+      dev.mode = vectors[i].mode;
+      dev.mode_iv = vectors[i].mode_iv;
+      dev.log_sector_size = 9;
+
+      err = grub_cryptodisk_setkey (&dev, key, vectors[i].keysize);
+      grub_test_assert (err == 0, "vector %d: setkey error %d", (int) i, err);
+
+      for (j = 0; j < sizeof (buf); j++)
+	buf[j] = ((j & 511) * 7 + FIRST_SECTOR + (j >> 9)) & 0xff;
+      err = grub_cryptodisk_decrypt (&dev, buf, sizeof (buf), FIRST_SECTOR);
+      grub_test_assert (err == 0, "vector %d: decrypt error %d", (int) i, err);
+
+      grub_crypto_hash (GRUB_MD_SHA256, digest, buf, sizeof (buf));
+      grub_test_assert (grub_memcmp (digest, vectors[i].digest,
+				     sizeof (digest)) == 0,
+			"vector %d: plaintext mismatch", (int) i);
+
+      grub_crypto_cipher_close (dev.cipher);
+      if (dev.secondary_cipher)
+	grub_crypto_cipher_close (dev.secondary_cipher);
+      if (dev.essiv_cipher)
+	grub_crypto_cipher_close (dev.essiv_cipher);
+    }
+}
+
+/* Register cryptodisk_test method as a functional test.  */
+GRUB_FUNCTIONAL_TEST (cryptodisk_test, cryptodisk_test);
@@ -0,0 +1,242 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2017  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/disk.h>
+#include <grub/diskfilter.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define NDISKS 6
+#define NSECTORS 3
+#define MEMBER_SIZE (NSECTORS << GRUB_DISK_SECTOR_BITS)
+
+/* Members are kept in memory and read through a private disk device, so
+   that the recovery code goes through grub_disk_read as usual.  */
+static grub_uint8_t members[NDISKS][MEMBER_SIZE];
+static grub_uint8_t data[NDISKS][MEMBER_SIZE];
+static struct grub_disk disks[NDISKS];
+static struct grub_diskfilter_pv pvs[NDISKS];
+static struct grub_diskfilter_node nodes[NDISKS];
+static unsigned long generation;
+
+static grub_err_t
+member_read (grub_disk_t disk, grub_disk_addr_t sector,
+	     grub_size_t size, char *buf)
+{
+  grub_memcpy (buf, (grub_uint8_t *) disk->data
+	       + (sector << GRUB_DISK_SECTOR_BITS),
+	       size << GRUB_DISK_SECTOR_BITS);
+  return GRUB_ERR_NONE;
+}
+
+static struct grub_disk_dev member_dev =
+  {
+    .name = "raid_test",
+    .id = GRUB_DISK_DEVICE_MEMDISK_ID,
+    .read = member_read
+  };
+
+/* Plain shift-and-add multiplication in GF(2^8) with the RAID6
+   polynomial, independent of the tables used by raid6rec.  */
+static grub_uint8_t
+gf_mul (grub_uint8_t a, grub_uint8_t b)
+{
+  grub_uint8_t r = 0;
+
+  while (b)
+    {
+      if (b & 1)
+	r ^= a;
+      a = (a << 1) ^ ((a & 0x80) ? 0x1d : 0);
+      b >>= 1;
+    }
+  return r;
+}
+
+static grub_uint8_t
+gf_powx (int c)
+{
+  grub_uint8_t r = 1;
+
+  while (c--)
+    r = gf_mul (r, 2);
+  return r;
+}
+
+static void
+setup_members (struct grub_diskfilter_segment *seg)
+{
+  int i;
+
+  grub_memset (seg, 0, sizeof (*seg));
+  seg->node_count = NDISKS;
+  seg->nodes = nodes;
+  seg->stripe_size = NSECTORS;
+
+  for (i = 0; i < NDISKS; i++)
+    {
+      disks[i].name = "raid_test";
+      disks[i].dev = &member_dev;
+      disks[i].total_sectors = NSECTORS;
+      disks[i].log_sector_size = GRUB_DISK_SECTOR_BITS;
+      disks[i].data = members[i];
+      pvs[i].name = (char *) "raid_test";
+      pvs[i].disk = &disks[i];
+      grub_memset (&nodes[i], 0, sizeof (nodes[i]));
+      nodes[i].pv = &pvs[i];
+    }
+}
+
+static void
+fill_data (int seed)
+{
+  int i, j;
+
+  for (i = 0; i < NDISKS; i++)
+    for (j = 0; j < MEMBER_SIZE; j++)
+      data[i][j] = (j * 31 + i * 7 + seed * 13 + (j >> 5)) & 0xff;
+
+  /* The members are rewritten after this, so give them fresh ids to keep
+     stale sectors in the disk cache from being returned.  */
+  generation++;
+  for (i = 0; i < NDISKS; i++)
+    disks[i].id = (unsigned long) &disks[0] + generation * NDISKS + i;
+}
+
+/* Check that member DISKNR is rebuilt from the others while the members
+   in MISSING (a bit mask, DISKNR included) cannot be read.  */
+static void
+check_recover (struct grub_diskfilter_segment *seg, int disknr, int p,
+	       unsigned missing, const char *what)
+{
+  char buf[MEMBER_SIZE];
+  grub_err_t err;
+  int i;
+
+  for (i = 0; i < NDISKS; i++)
+    pvs[i].disk = (missing & (1 << i)) ? NULL : &disks[i];
+
+  grub_memset (buf, 0xaa, sizeof (buf));
+  if (seg->type == GRUB_DISKFILTER_RAID6)
+    err = grub_raid6_recover_func (seg, disknr, p, buf, 0, NSECTORS);
+  else
+    err = grub_raid5_recover_func (seg, disknr, buf, 0, NSECTORS);
+  grub_errno = GRUB_ERR_NONE;
+
+  grub_test_assert (err == GRUB_ERR_NONE,
+		    "%s: disk %d, p %d, missing 0x%x: error %d",
+		    what, disknr, p, missing, err);
+  grub_test_assert (grub_memcmp (buf, members[disknr], MEMBER_SIZE) == 0,
+		    "%s: disk %d, p %d, missing 0x%x: data mismatch",
+		    what, disknr, p, missing);
+}
+
+static void
+raid5_test_layout (struct grub_diskfilter_segment *seg)
+{
+  int p, i, j;
+
+  seg->type = GRUB_DISKFILTER_RAID5;
+  for (p = 0; p < NDISKS; p++)
+    {
+      fill_data (p);
+      grub_memset (members[p], 0, MEMBER_SIZE);
+      for (i = 0; i < NDISKS; i++)
+	{
+	  if (i == p)
+	    continue;
+	  grub_memcpy (members[i], data[i], MEMBER_SIZE);
+	  for (j = 0; j < MEMBER_SIZE; j++)
+	    members[p][j] ^= data[i][j];
+	}
+      for (i = 0; i < NDISKS; i++)
+	if (i != p)
+	  check_recover (seg, i, p, 1 << i, "raid5");
+    }
+}
+
+static void
+raid6_test_layout (struct grub_diskfilter_segment *seg, int layout)
+{
+  int p, q, i, j, k, c;
+
+  seg->type = GRUB_DISKFILTER_RAID6;
+  seg->layout = layout;
+  for (p = 0; p < NDISKS; p++)
+    {
+      q = (p + 1) % NDISKS;
+      fill_data (p + layout);
+      grub_memset (members[p], 0, MEMBER_SIZE);
+      grub_memset (members[q], 0, MEMBER_SIZE);
+
+      /* Syndromes as in the md driver: P is the XOR of the data blocks
+	 and Q the sum of x**c times each of them.  */
+      for (k = 0; k < NDISKS - 2; k++)
+	{
+	  grub_uint8_t g;
+
+	  i = (q + 1 + k) % NDISKS;
+	  c = (layout & GRUB_RAID_LAYOUT_MUL_FROM_POS) ? i : k;
+	  g = gf_powx (c);
+	  grub_memcpy (members[i], data[i], MEMBER_SIZE);
+	  for (j = 0; j < MEMBER_SIZE; j++)
+	    {
+	      members[p][j] ^= data[i][j];
+	      members[q][j] ^= gf_mul (g, data[i][j]);
+	    }
+	}
+
+      for (i = 0; i < NDISKS; i++)
+	{
+	  if (i == p || i == q)
+	    continue;
+	  check_recover (seg, i, p, 1 << i, "raid6 from P");
+	  check_recover (seg, i, p, (1 << i) | (1 << p), "raid6 from Q");
+	  for (k = 0; k < NDISKS; k++)
+	    if (k != i && k != p && k != q)
+	      check_recover (seg, i, p, (1 << i) | (1 << k),
+			     "raid6 from P and Q");
+	}
+    }
+}
+
+static void
+raid_test (void)
+{
+  struct grub_diskfilter_segment seg;
+
+  grub_dl_load ("raid5rec");
+  grub_dl_load ("raid6rec");
+  grub_errno = GRUB_ERR_NONE;
+  grub_test_assert (grub_raid5_recover_func && grub_raid6_recover_func,
+		    "RAID recovery modules not loaded");
+  if (!grub_raid5_recover_func || !grub_raid6_recover_func)
+    return;
+
+  setup_members (&seg);
+  raid5_test_layout (&seg);
+  raid6_test_layout (&seg, 0);
+  raid6_test_layout (&seg, GRUB_RAID_LAYOUT_MUL_FROM_POS);
+}
+
+/* Register raid_test method as a functional test.  */
+GRUB_FUNCTIONAL_TEST (raid_test, raid_test);
@@ -0,0 +1,148 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2017  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/crypto.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define MILLION_A ((const char *) 0)
+
+/* FIPS 180-2 appendix examples.  */
+static struct
+{
+  const char *md;
+  const char *msg;
+  const char *digest;
+} vectors[] = {
+  {
+    "sha1", "abc",
+    "\xa9\x99\x3e\x36\x47\x06\x81\x6a\xba\x3e\x25\x71\x78\x50\xc2\x6c"
+    "\x9c\xd0\xd8\x9d"
+  },
+  {
+    "sha1", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+    "\x84\x98\x3e\x44\x1c\x3b\xd2\x6e\xba\xae\x4a\xa1\xf9\x51\x29\xe5"
+    "\xe5\x46\x70\xf1"
+  },
+  {
+    "sha1", MILLION_A,
+    "\x34\xaa\x97\x3c\xd4\xc4\xda\xa4\xf6\x1e\xeb\x2b\xdb\xad\x27\x31"
+    "\x65\x34\x01\x6f"
+  },
+  {
+    "sha224", "abc",
+    "\x23\x09\x7d\x22\x34\x05\xd8\x22\x86\x42\xa4\x77\xbd\xa2\x55\xb3"
+    "\x2a\xad\xbc\xe4\xbd\xa0\xb3\xf7\xe3\x6c\x9d\xa7"
+  },
+  {
+    "sha224", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+    "\x75\x38\x8b\x16\x51\x27\x76\xcc\x5d\xba\x5d\xa1\xfd\x89\x01\x50"
+    "\xb0\xc6\x45\x5c\xb4\xf5\x8b\x19\x52\x52\x25\x25"
+  },
+  {
+    "sha224", MILLION_A,
+    "\x20\x79\x46\x55\x98\x0c\x91\xd8\xbb\xb4\xc1\xea\x97\x61\x8a\x4b"
+    "\xf0\x3f\x42\x58\x19\x48\xb2\xee\x4e\xe7\xad\x67"
+  },
+  {
+    "sha256", "abc",
+    "\xba\x78\x16\xbf\x8f\x01\xcf\xea\x41\x41\x40\xde\x5d\xae\x22\x23"
+    "\xb0\x03\x61\xa3\x96\x17\x7a\x9c\xb4\x10\xff\x61\xf2\x00\x15\xad"
+  },
+  {
+    "sha256", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+    "\x24\x8d\x6a\x61\xd2\x06\x38\xb8\xe5\xc0\x26\x93\x0c\x3e\x60\x39"
+    "\xa3\x3c\xe4\x59\x64\xff\x21\x67\xf6\xec\xed\xd4\x19\xdb\x06\xc1"
+  },
+  {
+    "sha256", MILLION_A,
+    "\xcd\xc7\x6e\x5c\x99\x14\xfb\x92\x81\xa1\xc7\xe2\x84\xd7\x3e\x67"
+    "\xf1\x80\x9a\x48\xa4\x97\x20\x0e\x04\x6d\x39\xcc\xc7\x11\x2c\xd0"
+  }
+};
+
+/* Write sizes cycled through when feeding a message piecewise, chosen to
+   straddle the 64-byte block boundary.  */
+static const grub_size_t pieces[] = { 1, 63, 64, 65, 127, 4096 };
+
+static void
+check_digest (const gcry_md_spec_t *md, const grub_uint8_t *msg,
+	      grub_size_t len, const char *expected, int split, int n)
+{
+  grub_uint64_t ctx[GRUB_CRYPTO_MAX_MD_CONTEXT_SIZE / 8];
+  grub_size_t off, piece, k = 0;
+
+  md->init (ctx);
+  for (off = 0; off < len; off += piece)
+    {
+      piece = split ? pieces[k++ % ARRAY_SIZE (pieces)] : len;
+      if (piece > len - off)
+	piece = len - off;
+      md->write (ctx, msg + off, piece);
+    }
+  md->final (ctx);
+  grub_test_assert (grub_memcmp (md->read (ctx), expected, md->mdlen) == 0,
+		    "vector %d: %s digest mismatch (%s writes)", n, md->name,
+		    split ? "split" : "single");
+}
+
+static void
+sha_test (void)
+{
+  grub_uint8_t *million;
+  grub_size_t i;
+
+  /* Reference the specs so that their modules are loaded before the
+     lookup by name below.  */
+  grub_test_assert (GRUB_MD_SHA1->mdlen == 20 && GRUB_MD_SHA256->mdlen == 32,
+		    "unexpected digest sizes");
+
+  million = grub_malloc (1000000);
+  grub_test_assert (million != NULL, "out of memory");
+  if (!million)
+    return;
+  grub_memset (million, 'a', 1000000);
+
+  for (i = 0; i < ARRAY_SIZE (vectors); i++)
+    {
+      const gcry_md_spec_t *md;
+      const grub_uint8_t *msg = million;
+      grub_size_t len = 1000000;
+
+      md = grub_crypto_lookup_md_by_name (vectors[i].md);
+      grub_test_assert (md != NULL, "%s not found", vectors[i].md);
+      if (!md)
+	continue;
+      if (vectors[i].msg != MILLION_A)
+	{
+	  msg = (const grub_uint8_t *) vectors[i].msg;
+	  len = grub_strlen (vectors[i].msg);
+	}
+      check_digest (md, msg, len, vectors[i].digest, 0, i);
+      check_digest (md, msg, len, vectors[i].digest, 1, i);
+    }
+
+  grub_free (million);
+}
+
+/* Register sha_test method as a functional test.  */
+GRUB_FUNCTIONAL_TEST (sha_test, sha_test);
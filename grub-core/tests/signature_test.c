@@ -24,6 +24,8 @@
 #include <grub/test.h>
 #include <grub/mm.h>
 #include <grub/procfs.h>
+#include <grub/disk.h>
+#include <grub/file.h>
 
 #include "signatures.h"
 
@@ -144,6 +146,163 @@ do_verify (const char *f, const char *sig, const char *pub, int is_valid)
   grub_errno = GRUB_ERR_NONE;
 
 }
+/* The signature filter leaves procfs and memdisk files alone, so files
+   checked through it are served from a small newc archive on a private
+   disk device.  */
+static grub_uint8_t archive[4096];
+static grub_size_t archive_len;
+
+static void
+archive_add (const char *name, const void *contents, grub_size_t size,
+	     grub_uint32_t mode)
+{
+  grub_size_t namesize = grub_strlen (name) + 1;
+
+  grub_snprintf ((char *) archive + archive_len, 111,
+		 "070701%08x%08x%08x%08x%08x%08x%08x%08x%08x%08x%08x%08x%08x",
+		 0, mode, 0, 0, 1, 0, (unsigned) size, 0, 0, 0, 0,
+		 (unsigned) namesize, 0);
+  archive_len += 110;
+  grub_memcpy (archive + archive_len, name, namesize);
+  archive_len = ALIGN_UP (archive_len + namesize, 4);
+  grub_memcpy (archive + archive_len, contents, size);
+  archive_len = ALIGN_UP (archive_len + size, 4);
+}
+
+static int
+sigtest_iterate (grub_disk_dev_iterate_hook_t hook __attribute__ ((unused)),
+		 void *hook_data __attribute__ ((unused)),
+		 grub_disk_pull_t pull __attribute__ ((unused)))
+{
+  return 0;
+}
+
+static grub_err_t
+sigtest_open (const char *name, grub_disk_t disk)
+{
+  if (grub_strcmp (name, "sigtest") != 0)
+    return grub_error (GRUB_ERR_UNKNOWN_DEVICE, "not a sigtest disk");
+  disk->total_sectors = sizeof (archive) >> GRUB_DISK_SECTOR_BITS;
+  disk->id = (unsigned long) archive;
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+sigtest_read (grub_disk_t disk __attribute__ ((unused)),
+	      grub_disk_addr_t sector, grub_size_t size, char *buf)
+{
+  grub_memcpy (buf, archive + (sector << GRUB_DISK_SECTOR_BITS),
+	       size << GRUB_DISK_SECTOR_BITS);
+  return GRUB_ERR_NONE;
+}
+
+static struct grub_disk_dev sigtest_dev =
+  {
+    .name = "sigtest",
+    .id = GRUB_DISK_DEVICE_LOOPBACK_ID,
+    .iterate = sigtest_iterate,
+    .open = sigtest_open,
+    .read = sigtest_read
+  };
+
+static void
+check_err (grub_err_t expected, const char *what)
+{
+  grub_test_assert (grub_errno == expected, "%s: got error %d (%s), expected %d",
+		    what, grub_errno, grub_errmsg, expected);
+  grub_errno = GRUB_ERR_NONE;
+}
+
+static void
+deferred_test (void)
+{
+  char *trust_args[] = { (char *) "(proc)/hi_rsa.pub", NULL };
+  char *distrust_args[] = { (char *) "77836a0d", NULL };
+  grub_file_t file;
+  char buf[4];
+
+  archive_len = 0;
+  grub_memset (archive, 0, sizeof (archive));
+  archive_add ("hi", "hi\n", 3, 0100644);
+  archive_add ("hi.sig", hi_rsa_sig, sizeof (hi_rsa_sig), 0100644);
+  archive_add ("hj", "hj\n", 3, 0100644);
+  archive_add ("hj.sig", hi_rsa_sig, sizeof (hi_rsa_sig), 0100644);
+  archive_add ("TRAILER!!!", NULL, 0, 0);
+
+  grub_dl_load ("newc");
+  grub_errno = GRUB_ERR_NONE;
+  grub_disk_dev_register (&sigtest_dev);
+
+  grub_command_execute ("trust", 1, trust_args);
+  check_err (GRUB_ERR_NONE, "trust");
+  grub_env_set ("check_signatures", "enforce");
+
+  /* Buffered check at open time.  */
+  file = grub_file_open ("(sigtest)/hj");
+  grub_test_assert (file == NULL, "bad file opened without deferral");
+  if (file)
+    grub_file_close (file);
+  check_err (GRUB_ERR_BAD_SIGNATURE, "open hj");
+
+  /* Good signature, read to the end and then again from the start.  */
+  grub_file_filter_defer_pubkey ();
+  file = grub_file_open ("(sigtest)/hi");
+  grub_test_assert (file != NULL, "deferred open of hi failed: %s",
+		    grub_errmsg);
+  if (file)
+    {
+      grub_test_assert (grub_file_read (file, buf, 3) == 3
+			&& grub_memcmp (buf, "hi\n", 3) == 0,
+			"deferred read of hi failed");
+      check_err (GRUB_ERR_NONE, "read hi");
+      grub_file_seek (file, 0);
+      grub_test_assert (grub_file_read (file, buf, 3) == 3
+			&& grub_memcmp (buf, "hi\n", 3) == 0,
+			"deferred re-read of hi failed");
+      check_err (GRUB_ERR_NONE, "re-read hi");
+      grub_file_close (file);
+      check_err (GRUB_ERR_NONE, "close hi");
+    }
+
+  /* Bad signature: the read reaching the end fails, and so does every
+     access after it.  */
+  grub_file_filter_defer_pubkey ();
+  file = grub_file_open ("(sigtest)/hj");
+  grub_test_assert (file != NULL, "deferred open of hj failed: %s",
+		    grub_errmsg);
+  if (file)
+    {
+      grub_test_assert (grub_file_read (file, buf, 3) < 0,
+			"deferred read of hj succeeded");
+      check_err (GRUB_ERR_BAD_SIGNATURE, "read hj");
+      grub_file_seek (file, 0);
+      grub_test_assert (grub_file_read (file, buf, 1) < 0,
+			"re-read of hj after a bad signature succeeded");
+      check_err (GRUB_ERR_BAD_SIGNATURE, "re-read hj");
+      grub_file_close (file);
+      check_err (GRUB_ERR_BAD_SIGNATURE, "close hj");
+    }
+
+  /* Closing before the end means nothing was verified.  */
+  grub_file_filter_defer_pubkey ();
+  file = grub_file_open ("(sigtest)/hi");
+  grub_test_assert (file != NULL, "deferred open of hi failed: %s",
+		    grub_errmsg);
+  if (file)
+    {
+      grub_test_assert (grub_file_read (file, buf, 1) == 1,
+			"partial read of hi failed");
+      check_err (GRUB_ERR_NONE, "partial read hi");
+      grub_file_close (file);
+      check_err (GRUB_ERR_BAD_SIGNATURE, "close partially read hi");
+    }
+
+  grub_env_set ("check_signatures", "no");
+  grub_command_execute ("distrust", 1, distrust_args);
+  grub_errno = GRUB_ERR_NONE;
+  grub_disk_dev_unregister (&sigtest_dev);
+}
+
 static void
 signature_test (void)
 {
@@ -161,10 +320,14 @@ signature_test (void)
   do_verify ("(proc)/hi", "(proc)/hi_rsa.sig", "(proc)/hi_rsa.pub", 1);
   do_verify ("(proc)/hj", "(proc)/hi_rsa.sig", "(proc)/hi_rsa.pub", 0);
 
+  deferred_test ();
+
   grub_procfs_unregister (&hi);
   grub_procfs_unregister (&hj);
   grub_procfs_unregister (&hi_dsa_sig_entry);
   grub_procfs_unregister (&hi_dsa_pub_entry);
+  grub_procfs_unregister (&hi_rsa_sig_entry);
+  grub_procfs_unregister (&hi_rsa_pub_entry);
 }
 
 GRUB_FUNCTIONAL_TEST (signature_test, signature_test);
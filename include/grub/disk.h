@@ -176,6 +176,11 @@ typedef struct grub_disk_memberlist *grub_disk_memberlist_t;
 /* This is called from the memory manager.  */
 void grub_disk_cache_invalidate_all (void);
 
+/* Incremented whenever data cached from disks may have become stale: when
+   the disk cache is flushed and on every write.  Caches kept above the
+   disk layer compare it to know when to drop their contents.  */
+extern unsigned long EXPORT_VAR(grub_disk_generation);
+
 void EXPORT_FUNC(grub_disk_dev_register) (grub_disk_dev_t dev);
 void EXPORT_FUNC(grub_disk_dev_unregister) (grub_disk_dev_t dev);
 static inline int
@@ -81,6 +81,7 @@ typedef grub_file_t (*grub_file_filter_t) (grub_file_t in, const char *filename)
 
 extern grub_file_filter_t EXPORT_VAR(grub_file_filters_all)[GRUB_FILE_FILTER_MAX];
 extern grub_file_filter_t EXPORT_VAR(grub_file_filters_enabled)[GRUB_FILE_FILTER_MAX];
+extern int EXPORT_VAR(grub_file_pubkey_deferred);
 
 static inline void
 grub_file_filter_register (grub_file_filter_id_t id, grub_file_filter_t filter)
@@ -128,6 +129,17 @@ grub_file_filter_disable_pubkey (void)
   grub_file_filters_enabled[GRUB_FILE_FILTER_PUBKEY] = 0;
 }
 
+/* Let the signature filter check the next opened file while it is being
+   read rather than buffering all of it at open time.  A bad signature then
+   only shows up as a failure of the read reaching the end of the file, so
+   this is for callers that read the whole file and act on it only after
+   every read has succeeded.  */
+static inline void
+grub_file_filter_defer_pubkey (void)
+{
+  grub_file_pubkey_deferred = 1;
+}
+
 /* Get a device name from NAME.  */
 char *EXPORT_FUNC(grub_file_get_device_name) (const char *name);
 
@@ -73,6 +73,89 @@ EXPORT_FUNC(grub_fshelp_find_file_lookup) (const char *path,
 					   char *(*read_symlink) (grub_fshelp_node_t node),
 					   enum grub_fshelp_filetype expect);
 
+/* Directory entry cache.  It remembers, per disk, what a name in a
+   directory resolved to, so that opening many files under the same
+   directories doesn't scan them over and over.  Directories and their
+   entries are identified by opaque keys of at most
+   GRUB_FSHELP_DCACHE_KEY_MAX bytes chosen by the filesystem; FS tells
+   filesystems sharing a disk apart.  Entries are dropped once
+   grub_disk_generation changes.  */
+#define GRUB_FSHELP_DCACHE_KEY_MAX	32
+
+enum grub_fshelp_dcache_result
+  {
+    GRUB_FSHELP_DCACHE_MISS,
+    GRUB_FSHELP_DCACHE_FOUND,
+    GRUB_FSHELP_DCACHE_ABSENT
+  };
+
+/* Look NAME (NAME_LEN bytes) up in directory DIR.  On
+   GRUB_FSHELP_DCACHE_FOUND the entry key is copied to CHILD, which must
+   be CHILD_SIZE bytes; GRUB_FSHELP_DCACHE_ABSENT means the name is known
+   not to exist.  */
+enum grub_fshelp_dcache_result
+EXPORT_FUNC(grub_fshelp_dcache_lookup) (grub_disk_t disk, const void *fs,
+					const void *dir, grub_size_t dir_size,
+					const char *name, grub_size_t name_len,
+					void *child, grub_size_t child_size);
+
+/* Remember that NAME in DIR resolves to CHILD, or, if CHILD is NULL, that
+   it doesn't exist.  Failing to allocate an entry is not an error.  */
+void
+EXPORT_FUNC(grub_fshelp_dcache_insert) (grub_disk_t disk, const void *fs,
+					const void *dir, grub_size_t dir_size,
+					const char *name, grub_size_t name_len,
+					const void *child, grub_size_t child_size);
+
+/* How grub_fshelp_find_file_dcache maps nodes to cache keys.  NODE_KEY
+   returns the number identifying NODE (e.g. its inode number) and
+   NODE_FROM_KEY creates a new node for the entry KEY found in DIR.  */
+struct grub_fshelp_dcache_ops
+{
+  grub_uint64_t (*node_key) (grub_fshelp_node_t node);
+  grub_fshelp_node_t (*node_from_key) (grub_fshelp_node_t dir,
+				       grub_uint64_t key);
+};
+
+/* Like grub_fshelp_find_file, but resolve names through the directory
+   entry cache of DISK using OPS.  */
+grub_err_t
+EXPORT_FUNC(grub_fshelp_find_file_dcache) (const char *path,
+					   grub_fshelp_node_t rootnode,
+					   grub_fshelp_node_t *foundnode,
+					   int (*iterate_dir) (grub_fshelp_node_t dir,
+							       grub_fshelp_iterate_dir_hook_t hook,
+							       void *hook_data),
+					   char *(*read_symlink) (grub_fshelp_node_t node),
+					   enum grub_fshelp_filetype expect,
+					   grub_disk_t disk,
+					   const struct grub_fshelp_dcache_ops *ops);
+
+/* Look NAME up in directory DIR through the directory's on-disk index.
+   Return 1 with *FOUNDNODE set to a new node, or to NULL if NAME doesn't
+   exist, and *FOUNDTYPE set as ITERATE_DIR would.  Return 0 if DIR has no
+   index or it can't be used, so that DIR is scanned instead.  */
+typedef int (*grub_fshelp_lookup_name_t) (grub_fshelp_node_t dir,
+					  const char *name,
+					  grub_fshelp_node_t *foundnode,
+					  enum grub_fshelp_filetype *foundtype);
+
+/* Like grub_fshelp_find_file_dcache, but try LOOKUP_NAME before scanning
+   a directory.  DISK and OPS may be NULL to not use the directory entry
+   cache.  */
+grub_err_t
+EXPORT_FUNC(grub_fshelp_find_file_index) (const char *path,
+					  grub_fshelp_node_t rootnode,
+					  grub_fshelp_node_t *foundnode,
+					  int (*iterate_dir) (grub_fshelp_node_t dir,
+							      grub_fshelp_iterate_dir_hook_t hook,
+							      void *hook_data),
+					  grub_fshelp_lookup_name_t lookup_name,
+					  char *(*read_symlink) (grub_fshelp_node_t node),
+					  enum grub_fshelp_filetype expect,
+					  grub_disk_t disk,
+					  const struct grub_fshelp_dcache_ops *ops);
+
 /* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
    beginning with the block POS.  READ_HOOK should be set before
    reading a block from the file.  GET_BLOCK is used to translate file
@@ -88,4 +171,26 @@ EXPORT_FUNC(grub_fshelp_read_file) (grub_disk_t disk, grub_fshelp_node_t node,
 				    grub_off_t filesize, int log2blocksize,
 				    grub_disk_addr_t blocks_start);
 
+/* Map file block BLOCK of NODE to a disk block, 0 for a hole.  On entry
+   *COUNT is the number of blocks the caller wants; on return it is the
+   number of blocks from BLOCK on that map to consecutive disk blocks (or
+   are all holes).  It may be less than asked for, but at least 1.  */
+typedef grub_disk_addr_t (*grub_fshelp_get_extent_t) (grub_fshelp_node_t node,
+						      grub_disk_addr_t block,
+						      grub_disk_addr_t *count);
+
+/* Like grub_fshelp_read_file, but map the file with GET_EXTENT so runs of
+   blocks are looked up once and read with a single disk read.  */
+grub_ssize_t
+EXPORT_FUNC(grub_fshelp_read_file_extents) (grub_disk_t disk,
+					    grub_fshelp_node_t node,
+					    grub_disk_read_hook_t read_hook,
+					    void *read_hook_data,
+					    grub_off_t pos, grub_size_t len,
+					    char *buf,
+					    grub_fshelp_get_extent_t get_extent,
+					    grub_off_t filesize,
+					    int log2blocksize,
+					    grub_disk_addr_t blocks_start);
+
 #endif /* ! GRUB_FSHELP_HEADER */
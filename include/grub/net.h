@@ -140,6 +140,12 @@ struct grub_net_card
       struct grub_efi_simple_network *efi_net;
       grub_efi_handle_t efi_handle;
       grub_size_t last_pkt_size;
+      /* Ring of received frames and spare receive buffers.  */
+      struct grub_net_buff **rx_ring;
+      unsigned rx_head;
+      unsigned rx_count;
+      /* Oldest in-flight transmit buffer; txbusy counts in-flight ones.  */
+      unsigned tx_head;
     };
 #endif
     void *data;
@@ -276,6 +282,11 @@ typedef struct grub_net
   grub_fs_t fs;
   int eof;
   int stall;
+  /* In-memory copy of the file, if it is being cached.  */
+  struct grub_net_cache_entry *cache;
+  /* Set when the whole file came from the cache and no protocol stream
+     has been opened.  */
+  int from_cache;
 } *grub_net_t;
 
 extern grub_net_t (*EXPORT_VAR (grub_net_open)) (const char *name);
@@ -378,14 +389,59 @@ grub_net_card_unregister (struct grub_net_card *card);
 #define FOR_NET_CARDS(var) for (var = grub_net_cards; var; var = var->next)
 #define FOR_NET_CARDS_SAFE(var, next) for (var = grub_net_cards, next = (var ? var->next : 0); var; var = next, next = (var ? var->next : 0))
 
+/* Counters kept by the network stack for the netbench command.  Times are
+   sums of millisecond deltas: each sample is coarse but over many packets
+   the totals are unbiased.  */
+struct grub_net_stats
+{
+  grub_uint64_t rx_packets;
+  grub_uint64_t rx_bytes;
+  grub_uint64_t tx_packets;
+  grub_uint64_t tx_bytes;
+  /* Packets dropped because of a bad checksum.  */
+  grub_uint64_t bad_checksums;
+  /* Segments or blocks received again after they were already consumed.  */
+  grub_uint64_t duplicates;
+  /* Segments or blocks received ahead of the one expected next.  */
+  grub_uint64_t out_of_order;
+  grub_uint64_t retransmits;
+  /* Round-trip samples, taken only for packets sent once (Karn's rule).  */
+  grub_uint64_t rtt_samples;
+  grub_uint64_t rtt_total_ms;
+  grub_uint64_t rtt_min_ms;
+  grub_uint64_t rtt_max_ms;
+  /* Time spent in the card drivers' recv hooks returning a packet, in recv
+     hooks finding nothing and in the protocol stack respectively.  */
+  grub_uint64_t driver_ms;
+  grub_uint64_t idle_ms;
+  grub_uint64_t stack_ms;
+};
+
+extern struct grub_net_stats grub_net_stats;
+
+static inline void
+grub_net_stats_rtt (grub_uint64_t rtt)
+{
+  if (!grub_net_stats.rtt_samples || rtt < grub_net_stats.rtt_min_ms)
+    grub_net_stats.rtt_min_ms = rtt;
+  if (rtt > grub_net_stats.rtt_max_ms)
+    grub_net_stats.rtt_max_ms = rtt;
+  grub_net_stats.rtt_samples++;
+  grub_net_stats.rtt_total_ms += rtt;
+}
+
 
 extern struct grub_net_route *grub_net_routes;
 
+void
+grub_net_route_cache_flush (void);
+
 static inline void
 grub_net_route_register (struct grub_net_route *route)
 {
   grub_list_push (GRUB_AS_LIST_P (&grub_net_routes),
 		  GRUB_AS_LIST (route));
+  grub_net_route_cache_flush ();
 }
 
 #define FOR_NET_ROUTES(var) for (var = grub_net_routes; var; var = var->next)
@@ -525,6 +581,7 @@ grub_net_network_level_interface_unregister (struct grub_net_network_level_inter
     inter->next->prev = inter->prev;
   inter->next = 0;
   inter->prev = 0;
+  grub_net_route_cache_flush ();
 }
 
 void
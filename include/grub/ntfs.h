@@ -127,14 +127,40 @@ struct grub_ntfs_bpb
   grub_uint32_t checksum;
 } GRUB_PACKED;
 
+/* A decoded data run.  LCN is 0 for a sparse run.  */
+struct grub_ntfs_run
+{
+  grub_disk_addr_t vcn;
+  grub_disk_addr_t len;
+  grub_disk_addr_t lcn;
+};
+
+#define GRUB_NTFS_MAX_RUNS		65536
+
+/* A decompressed compression unit of 16 clusters.  */
+struct grub_ntfs_comp_unit
+{
+  grub_disk_addr_t vcn;
+  grub_uint64_t used;
+  grub_uint8_t *buf;
+};
+
+#define GRUB_NTFS_COMP_UNITS		4
+
 struct grub_ntfs_attr
 {
   int flags;
   grub_uint8_t *emft_buf, *edat_buf;
   grub_uint8_t *attr_cur, *attr_nxt, *attr_end;
-  grub_uint32_t save_pos;
-  grub_uint8_t *sbuf;
   struct grub_ntfs_file *mft;
+
+  /* Runs of the non-resident attribute of type RUNS_TYPE decoded so far,
+     sorted by VCN, and its recently used compression units.  */
+  grub_uint8_t runs_type;
+  struct grub_ntfs_run *runs;
+  grub_size_t n_runs, n_runs_allocated;
+  struct grub_ntfs_comp_unit units[GRUB_NTFS_COMP_UNITS];
+  grub_uint64_t units_clock;
 };
 
 struct grub_ntfs_file
@@ -180,6 +206,9 @@ struct grub_ntfs_rlst
 {
   int flags;
   grub_disk_addr_t target_vcn, curr_vcn, next_vcn, curr_lcn;
+  /* Where decoding of the run list stands.  Runs found in the cache of
+     ATTR are returned without advancing it.  */
+  grub_disk_addr_t dec_vcn, dec_lcn;
   grub_uint8_t *cur_run;
   struct grub_ntfs_attr *attr;
   struct grub_ntfs_comp comp;
@@ -194,5 +223,7 @@ typedef grub_err_t (*grub_ntfscomp_func_t) (grub_uint8_t *dest,
 extern grub_ntfscomp_func_t grub_ntfscomp_func;
 
 grub_err_t grub_ntfs_read_run_list (struct grub_ntfs_rlst *ctx);
+grub_err_t grub_ntfs_seek_run_list (struct grub_ntfs_rlst *ctx,
+				    grub_disk_addr_t vcn);
 
 #endif /* ! GRUB_NTFS_H */
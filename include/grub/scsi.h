@@ -103,6 +103,10 @@ struct grub_scsi
   /* Size of one block.  */
   grub_uint32_t blocksize;
 
+  /* Largest transfer, in bytes, the device takes in one command.  0
+     for the conservative default.  */
+  grub_size_t maxbuffer;
+
   /* Device-specific data.  */
   void *data;
 };
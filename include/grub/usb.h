@@ -130,6 +130,10 @@ struct grub_usb_controller_dev
   /* Value is calculated/estimated in driver - some TDs should be */
   /* reserved for posible concurrent control or "interrupt" transfers */
   grub_size_t max_bulk_tds;
+
+  /* Max. number of bytes one bulk transaction (TD) may carry, it is */
+  /* split into packets by the controller.  Zero means one packet.  */
+  grub_size_t max_bulk_transaction_len;
   
   /* The next host controller.  */
   struct grub_usb_controller_dev *next;
@@ -0,0 +1,110 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2010,2011  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <grub/misc.h>
+#include <grub/net/ip.h>
+#include <grub/test.h>
+
+/* Jumbo frame plus room for misaligning the start.  */
+#define BUF_SIZE (9000 + 8)
+
+/* The plain 16-bit at a time sum the optimized one must agree with.  */
+static grub_uint16_t
+chksum_reference (void *ipv, grub_size_t len)
+{
+  grub_uint16_t *ip = (grub_uint16_t *) ipv;
+  grub_uint32_t sum = 0;
+
+  for (; len >= 2; len -= 2)
+    {
+      sum += grub_be_to_cpu16 (grub_get_unaligned16 (ip++));
+      if (sum > 0xFFFF)
+	sum -= 0xFFFF;
+    }
+  if (len)
+    {
+      sum += *((grub_uint8_t *) ip) << 8;
+      if (sum > 0xFFFF)
+	sum -= 0xFFFF;
+    }
+
+  if (sum >= 0xFFFF)
+    sum -= 0xFFFF;
+
+  return grub_cpu_to_be16 ((~sum) & 0x0000FFFF);
+}
+
+static void
+chksum_check (grub_uint8_t *buf, grub_size_t len)
+{
+  grub_uint16_t expected, got;
+
+  expected = chksum_reference (buf, len);
+  got = grub_net_ip_chksum (buf, len);
+  grub_test_assert (got == expected,
+		    "checksum of %" PRIuGRUB_SIZE " bytes at offset %d: "
+		    "%04x instead of %04x", len,
+		    (int) ((grub_addr_t) buf & 7), got, expected);
+}
+
+static void
+chksum_test (void)
+{
+  static grub_uint8_t buf[BUF_SIZE];
+  grub_size_t lengths[] = { 1500, 1480, 9000, 8980 };
+  grub_size_t len;
+  unsigned i, off;
+
+  /* All zeros, all ones and sums hitting 0xffff exactly.  */
+  grub_memset (buf, 0, sizeof (buf));
+  for (len = 0; len < 80; len++)
+    chksum_check (buf, len);
+  grub_memset (buf, 0xff, sizeof (buf));
+  for (len = 0; len < 80; len++)
+    chksum_check (buf, len);
+  chksum_check (buf, 9000);
+  buf[0] = 0x12;
+  buf[1] = 0x34;
+  buf[2] = 0xed;
+  buf[3] = 0xcb;
+  chksum_check (buf, 4);
+
+  srand (42);
+  for (i = 0; i < sizeof (buf); i++)
+    buf[i] = rand ();
+
+  for (off = 0; off < 8; off++)
+    {
+      for (len = 0; len < 300; len++)
+	chksum_check (buf + off, len);
+      for (i = 0; i < ARRAY_SIZE (lengths); i++)
+	chksum_check (buf + off, lengths[i]);
+    }
+
+  for (i = 0; i < 10000; i++)
+    {
+      off = rand () % 8;
+      len = rand () % (BUF_SIZE - 8);
+      chksum_check (buf + off, len);
+    }
+}
+
+GRUB_UNIT_TEST ("chksum_unit_test", chksum_test);